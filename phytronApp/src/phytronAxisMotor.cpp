@@ -13,20 +13,28 @@ Cosylab d.d. 2014
 #include <iostream>
 #include <string.h>
 #include <stdlib.h>
+#include <ctype.h>
 #include <vector>
 #include <math.h>
 #ifndef _WIN32
 #include <unistd.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 #endif
 
 #include <drvAsynIPPort.h>
 #include <iocsh.h>
 #include <epicsThread.h>
 #include <cantProceed.h>
+#include <epicsString.h>
 
 #include <asynOctetSyncIO.h>
 
 #include "phytronAxisMotor.h"
+#include "phytronConfig.h"
+#include "phytronIoCtrl.h"
 #include <epicsExport.h>
 
 using namespace std;
@@ -44,14 +52,64 @@ using namespace std;
  */
 static vector<phytronController*> controllers;
 
+static double profileTaskC(void *drvPvt)
+{
+  phytronController *pC = (phytronController*)drvPvt;
+  return pC->profileTask();
+}
+
+static double snapshotTaskC(void *drvPvt)
+{
+  phytronController *pC = (phytronController*)drvPvt;
+  return pC->snapshotTask();
+}
+
+static double healthTaskC(void *drvPvt)
+{
+  phytronController *pC = (phytronController*)drvPvt;
+  return pC->healthTask();
+}
+
+/** Axis parameters mapped to controller parameters. Reads, writes, the diagnostic
+  * snapshot and the health monitor are driven by this table.
+  */
+const phytronParamDesc phytronController::paramTable_[] = {
+// name                        reason                                    P   type              scale  readOnly cacheable pollClass
+  {axisModeString,             &phytronController::axisMode_,             1, asynParamInt32,   1,     false,   true,     pollSnapshot},
+  {mopOffsetPosString,         &phytronController::mopOffsetPos_,        11, asynParamInt32,   1,     false,   true,     pollSnapshot},
+  {mopOffsetNegString,         &phytronController::mopOffsetNeg_,        12, asynParamInt32,   1,     false,   true,     pollSnapshot},
+  {initRecoveryTimeString,     &phytronController::initRecoveryTime_,    13, asynParamInt32,   1,     false,   true,     pollSnapshot},
+  {positionRecoveryTimeString, &phytronController::positionRecoveryTime_,16, asynParamInt32,   1,     false,   true,     pollSnapshot},
+  {boostConditionString,       &phytronController::boost_,               17, asynParamInt32,   1,     false,   true,     pollSnapshot},
+  {encoderRateString,          &phytronController::encoderRate_,         26, asynParamInt32,   1,     false,   true,     pollSnapshot},
+  {switchTypString,            &phytronController::switchTyp_,           27, asynParamInt32,   1,     false,   true,     pollSnapshot},
+  {pwrStageModeString,         &phytronController::pwrStageMode_,        28, asynParamInt32,   1,     false,   true,     pollSnapshot},
+  {encoderTypeString,          &phytronController::encoderType_,         34, asynParamInt32,   1,     false,   true,     pollSnapshot},
+  {encoderResolutionString,    &phytronController::encoderRes_,          35, asynParamInt32,   1,     false,   true,     pollSnapshot},
+  {encoderFunctionString,      &phytronController::encoderFunc_,         36, asynParamInt32,   1,     false,   true,     pollSnapshot},
+  {encoderSFIWidthString,      &phytronController::encoderSFIWidth_,     37, asynParamInt32,   1,     false,   true,     pollSnapshot},
+  {encoderDirectionString,     &phytronController::encoderDirection_,    38, asynParamInt32,   1,     false,   true,     pollSnapshot},
+  {stopCurrentString,          &phytronController::stopCurrent_,         40, asynParamInt32,   10,    false,   true,     pollSnapshot}, //Records in mA, controller in 10 mA
+  {runCurrentString,           &phytronController::runCurrent_,          41, asynParamInt32,   10,    false,   true,     pollSnapshot},
+  {boostCurrentString,         &phytronController::boostCurrent_,        42, asynParamInt32,   10,    false,   true,     pollSnapshot},
+  {currentDelayTimeString,     &phytronController::currentDelayTime_,    43, asynParamInt32,   1,     false,   true,     pollSnapshot},
+  {stepResolutionString,       &phytronController::stepResolution_,      45, asynParamInt32,   1,     false,   true,     pollSnapshot},
+  {powerStageTempString,       &phytronController::powerStageTemp_,      49, asynParamFloat64, 0.1,   true,    true,     pollHealth},   //Records in °C, controller in 0.1 °C
+  {powerStagetMonitorString,   &phytronController::powerStageMonitor_,   53, asynParamInt32,   1,     false,   true,     pollHealth},
+  {motorTempString,            &phytronController::motorTemp_,           54, asynParamFloat64, 0.1,   true,    true,     pollHealth}
+};
+const int phytronController::paramTableSize_ = sizeof(paramTable_)/sizeof(paramTable_[0]);
+
 /** Creates a new phytronController object.
   * \param[in] portName          The name of the asyn port that will be created for this driver
   * \param[in] phytronPortName   The name of the drvAsynIPPort that was created previously to connect to the phytron controller
   * \param[in] movingPollPeriod  The time between polls when any axis is moving
   * \param[in] idlePollPeriod    The time between polls when no axis is moving
+  * \param[in] slowAsynPortName  Optional second connection to the same controller, used for diagnostics and configuration
   */
 phytronController::phytronController(const char *phytronPortName, const char *asynPortName,
-                                 double movingPollPeriod, double idlePollPeriod, double timeout)
+                                 double movingPollPeriod, double idlePollPeriod, double timeout,
+                                 const char *slowAsynPortName, int busAddress)
   :  asynMotorController(phytronPortName,
                          0xFF,
                          NUM_PHYTRON_PARAMS,
@@ -68,49 +126,109 @@ phytronController::phytronController(const char *phytronPortName, const char *as
 
   //Timeout is defined in milliseconds, but sendPhytronCommand expects seconds
   timeout_ = timeout/1000;
+  //The configured timeout is kept until phytronSetAdaptiveTimeout enables the adaptive timeouts
+  rtt_.configure(timeout_, 0, 0);
+
+  epicsTimeGetCurrent(&lastRequestTime_);
+  lastReplyTime_ = lastRequestTime_;
+
+  estimatorPeriod_ = 0;
+  //Completion wakeups must not wait behind the sweeps of other controllers
+  profileTask_ = new phytronTask("phytronProfile", profileTaskC, this, epicsThreadPriorityMedium, false);
+  pasynUserSlow_ = NULL;
+  lastSlowStatus_ = phytronSuccess;
+  slowMutex_ = epicsMutexMustCreate();
+
+  batchSize_ = DEFAULT_BATCH_SIZE;
+  batchMismatches_ = 0;
+  batchFallbacks_ = 0;
+  snapshotPeriod_ = 0;
+  snapshotTask_ = new phytronTask("phytronSnapshot", snapshotTaskC, this, epicsThreadPriorityLow);
+  epicsTimeGetCurrent(&snapshotStart_);
+  snapshotNext_ = 0;
+
+  healthPeriod_ = 0;
+  healthTask_ = new phytronTask("phytronHealth", healthTaskC, this, epicsThreadPriorityLow);
+  epicsTimeGetCurrent(&healthStart_);
+  healthNext_ = 0;
+  statusValid_ = false;
 
   //pyhtronCreateAxis uses portName to identify the controller
   this->controllerName_ = (char *) mallocMustSucceed(sizeof(char)*(strlen(portName)+1),
       "phytronController::phytronController: Controller name memory allocation failed.\n");
 
   strcpy(this->controllerName_, portName);
+  this->asynPortName_ = epicsStrDup(asynPortName);
+  inventoryValid_ = false;
+
+  telegramLog_ = new phytronTelegramLog(portName);
+
+  //Units sharing a serial line take turns polling
+  if(busAddress < 0 || busAddress > MAX_BUS_ADDRESS){
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+      "%s: invalid bus address %d, must be in range 0 to %d, using 0\n",
+      functionName, busAddress, MAX_BUS_ADDRESS);
+    busAddress = 0;
+  }
+  busAddress_ = "0123456789ABCDEF"[busAddress];
+  bus_ = phytronBus::attach(asynPortName);
+  busUnit_ = bus_->addUnit(portName, busAddress, true);
+  pollSkipped_ = false;
+  lastPolledAxis_ = NULL;
+  pollActive_ = false;
+
+  pollerPriority_ = -1;
+  pollerPolicy_ = pollerPolicyKeep;
+  pollerConfigPending_ = false;
+  cycleEndValid_ = false;
+  cycleMoving_ = false;
+  cyclePeriod_ = 0;
+  jitterSamples_ = 0;
+  jitterMax_ = 0;
+  earlyPolls_ = 0;
+  jitterSorted_.reserve(POLL_JITTER_SAMPLES);
+  epicsTimeGetCurrent(&jitterPublished_);
+  shm_ = NULL;
 
   //Create Controller parameters
   createParam(controllerStatusString,     asynParamInt32, &this->controllerStatus_);
   createParam(controllerStatusResetString,asynParamInt32, &this->controllerStatusReset_);
   createParam(resetControllerString,      asynParamInt32, &this->resetController_);
+  createParam(pollJitterP50String,        asynParamFloat64, &this->pollJitterP50_);
+  createParam(pollJitterP99String,        asynParamFloat64, &this->pollJitterP99_);
+  createParam(pollJitterMaxString,        asynParamFloat64, &this->pollJitterMax_);
+  createParam(pollJitterResetString,      asynParamInt32, &this->pollJitterReset_);
 
   //Create Axis parameters
   createParam(axisStatusResetString,      asynParamInt32, &this->axisStatusReset_);
   createParam(axisResetString,            asynParamInt32, &this->axisReset_);
   createParam(axisStatusString,           asynParamInt32, &this->axisStatus_);
   createParam(homingProcedureString,      asynParamInt32, &this->homingProcedure_);
-  createParam(axisModeString,             asynParamInt32, &this->axisMode_);
-  createParam(mopOffsetPosString,         asynParamInt32, &this->mopOffsetPos_);
-  createParam(mopOffsetNegString,         asynParamInt32, &this->mopOffsetNeg_);
-  createParam(stepResolutionString,       asynParamInt32, &this->stepResolution_);
-  createParam(stopCurrentString,          asynParamInt32, &this->stopCurrent_);
-  createParam(runCurrentString,           asynParamInt32, &this->runCurrent_);
-  createParam(boostCurrentString,         asynParamInt32, &this->boostCurrent_);
-  createParam(encoderTypeString,          asynParamInt32, &this->encoderType_);
-  createParam(initRecoveryTimeString,     asynParamInt32, &this->initRecoveryTime_);
-  createParam(positionRecoveryTimeString, asynParamInt32, &this->positionRecoveryTime_);
-  createParam(boostConditionString,       asynParamInt32, &this->boost_);
-  createParam(encoderRateString,          asynParamInt32, &this->encoderRate_);
-  createParam(switchTypString,            asynParamInt32, &this->switchTyp_);
-  createParam(pwrStageModeString,         asynParamInt32, &this->pwrStageMode_);
-  createParam(encoderResolutionString,    asynParamInt32, &this->encoderRes_);
-  createParam(encoderFunctionString,      asynParamInt32, &this->encoderFunc_);
-  createParam(encoderSFIWidthString,      asynParamInt32, &this->encoderSFIWidth_);
-  createParam(encoderDirectionString,     asynParamInt32, &this->encoderDirection_);
-  createParam(powerStagetMonitorString,   asynParamInt32, &this->powerStageMonitor_);
-  createParam(currentDelayTimeString,     asynParamInt32, &this->currentDelayTime_);
-  createParam(powerStageTempString,       asynParamFloat64, &this->powerStageTemp_);
-  createParam(motorTempString,            asynParamFloat64, &this->motorTemp_);
+  createParam(positionEstimateString,     asynParamFloat64, &this->positionEstimate_);
+  createParam(positionEstimatedString,    asynParamInt32, &this->positionEstimated_);
+  createParam(pollEncoderDividerString,   asynParamInt32, &this->pollEncoderDivider_);
+  createParam(pollStatusDividerString,    asynParamInt32, &this->pollStatusDivider_);
+  createParam(powerStageTempMinString,    asynParamFloat64, &this->powerStageTempMin_);
+  createParam(powerStageTempMaxString,    asynParamFloat64, &this->powerStageTempMax_);
+  createParam(powerStageTempRateString,   asynParamFloat64, &this->powerStageTempRate_);
+  createParam(motorTempMinString,         asynParamFloat64, &this->motorTempMin_);
+  createParam(motorTempMaxString,         asynParamFloat64, &this->motorTempMax_);
+  createParam(motorTempRateString,        asynParamFloat64, &this->motorTempRate_);
+  createParam(healthResetString,          asynParamInt32, &this->healthReset_);
+
+  //Axis parameters mapped to controller parameters
+  for(int i = 0; i < paramTableSize_; i++){
+    createParam(paramTable_[i].name, paramTable_[i].type, &(this->*paramTable_[i].reason));
+    if((size_t) (this->*paramTable_[i].reason) >= paramByReason_.size()){
+      paramByReason_.resize(this->*paramTable_[i].reason + 1, NULL);
+    }
+    paramByReason_[this->*paramTable_[i].reason] = &paramTable_[i];
+  }
 
 
   /* Connect to phytron controller */
   status = pasynOctetSyncIO->connect(asynPortName, 0, &pasynUserController_, NULL);
+  if (!status) status = framer_.connect(asynPortName, 0);
   if (status) {
     asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
       "%s: cannot connect to phytron controller\n",
@@ -119,6 +237,18 @@ phytronController::phytronController(const char *phytronPortName, const char *as
     //phytronCreateAxis will search for the controller for axis registration
     controllers.push_back(this);
 
+    /* Connect the slow path, diagnostics and configuration use the fast path if there is none */
+    if(slowAsynPortName && strlen(slowAsynPortName)){
+      status = pasynOctetSyncIO->connect(slowAsynPortName, 0, &pasynUserSlow_, NULL);
+      if (!status) status = slowFramer_.connect(slowAsynPortName, 0);
+      if (status) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+          "%s: cannot connect to phytron controller on slow path port %s\n",
+          functionName, slowAsynPortName);
+        pasynUserSlow_ = NULL;
+      }
+    }
+
     //RESET THE CONTROLLER
     sprintf(this->outString_, "CR");
     phyStatus = sendPhytronCommand(this->outString_, this->inString_, MAX_CONTROLLER_STRING_SIZE, &response_len);
@@ -131,6 +261,8 @@ phytronController::phytronController(const char *phytronPortName, const char *as
     epicsThreadSleep(10.0);
 
     startPoller(movingPollPeriod, idlePollPeriod, 5);
+
+    profileTask_->wake();
   }
 
 }
@@ -142,11 +274,15 @@ phytronController::phytronController(const char *phytronPortName, const char *as
   * \param[in] numController     number of axes that this controller supports is numController*AXES_PER_CONTROLLER
   * \param[in] movingPollPeriod  The time in ms between polls when any axis is moving
   * \param[in] idlePollPeriod    The time in ms between polls when no axis is moving
+  * \param[in] slowAsynPortName  Optional asyn port with a second connection to the same controller
+  * \param[in] busAddress        Address of the unit on the serial line, 0..15
   */
 extern "C" int phytronCreateController(const char *phytronPortName, const char *asynPortName,
-                                   int movingPollPeriod, int idlePollPeriod, double timeout)
+                                   int movingPollPeriod, int idlePollPeriod, double timeout,
+                                   const char *slowAsynPortName, int busAddress)
 {
-  new phytronController(phytronPortName, asynPortName, movingPollPeriod/1000., idlePollPeriod/1000., timeout);
+  new phytronController(phytronPortName, asynPortName, movingPollPeriod/1000., idlePollPeriod/1000., timeout,
+                        slowAsynPortName, busAddress);
   return asynSuccess;
 }
 
@@ -157,19 +293,26 @@ extern "C" int phytronCreateController(const char *phytronPortName, const char *
 asynStatus phytronController::readInt32(asynUser *pasynUser, epicsInt32 *value)
 {
   phytronAxis   *pAxis;
+  const phytronParamDesc *pDesc;
   phytronStatus phyStatus;
+  char          command[MAX_CONTROLLER_STRING_SIZE];
+  char          response[MAX_CONTROLLER_STRING_SIZE];
+  size_t        response_len;
 
   //Call base implementation first
   asynPortDriver::readInt32(pasynUser, value);
 
   //Check if this is a call to read a controller parameter
-  if(pasynUser->reason == resetController_ || pasynUser->reason == controllerStatusReset_){
-    //Called only on initialization of bo records RESET and RESET-STATUS
+  if(pasynUser->reason == resetController_ || pasynUser->reason == controllerStatusReset_ ||
+     pasynUser->reason == pollJitterReset_){
+    //Called only on initialization of bo records RESET, RESET-STATUS and POLL-JITTER-RESET
     return asynSuccess;
   } else if (pasynUser->reason == controllerStatus_){
-    size_t response_len;
-    sprintf(this->outString_, "ST");
-    phyStatus = sendPhytronCommand(this->outString_, this->inString_, MAX_CONTROLLER_STRING_SIZE, &response_len);
+    //Served from the parameter library while the health monitor is running
+    if(statusValid_) return asynSuccess;
+
+    sprintf(command, "ST");
+    phyStatus = sendSlowPhytronCommand(command, response, MAX_CONTROLLER_STRING_SIZE, &response_len);
     if(phyStatus){
       if (phyStatus != lastStatus) {
         asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
@@ -181,7 +324,7 @@ asynStatus phytronController::readInt32(asynUser *pasynUser, epicsInt32 *value)
     }
     lastStatus = phyStatus;
 
-    *value = atoi(this->inString_);
+    *value = atoi(response);
     return asynSuccess;
   }
 
@@ -193,56 +336,21 @@ asynStatus phytronController::readInt32(asynUser *pasynUser, epicsInt32 *value)
     return asynError;
   }
 
-  if(pasynUser->reason == homingProcedure_){
+  pDesc = findParam(pasynUser->reason);
+  if(pDesc){
+    //Served from the parameter library while the snapshot or health monitor is current
+    if(isCached(pAxis, pDesc)) return asynSuccess;
+    sprintf(command, "M%.1fP%02dR", pAxis->axisModuleNo_, pDesc->pNumber);
+  } else if(pasynUser->reason == homingProcedure_){
     getIntegerParam(pAxis->axisNo_, homingProcedure_, value);
     return asynSuccess;
-  } else if (pasynUser->reason == axisReset_ || pasynUser->reason == axisStatusReset_){
-    //Called only on initialization of AXIS-RESET and AXIS-STATUS-RESET bo records
+  } else {
+    //Parameters maintained by the driver, the base implementation already returned their value.
+    //AXIS-RESET, AXIS-STATUS-RESET and HEALTH-RESET bo records call this only on initialization
     return asynSuccess;
-  } else if (pasynUser->reason == axisMode_){
-    sprintf(this->outString_, "M%.1fP01R", pAxis->axisModuleNo_);
-  } else if(pasynUser->reason == mopOffsetPos_){
-    sprintf(this->outString_, "M%.1fP11R", pAxis->axisModuleNo_);
-  } else if(pasynUser->reason == mopOffsetNeg_){
-    sprintf(this->outString_, "M%.1fP12R", pAxis->axisModuleNo_);
-  } else if (pasynUser->reason == stepResolution_){
-    sprintf(this->outString_, "M%.1fP45R", pAxis->axisModuleNo_);
-  } else if (pasynUser->reason == stopCurrent_){
-    sprintf(this->outString_, "M%.1fP40R", pAxis->axisModuleNo_);
-  } else if (pasynUser->reason == runCurrent_){
-    sprintf(this->outString_, "M%.1fP41R", pAxis->axisModuleNo_);
-  } else if (pasynUser->reason == boostCurrent_){
-    sprintf(this->outString_, "M%.1fP42R", pAxis->axisModuleNo_);
-  } else if (pasynUser->reason == encoderType_){
-    sprintf(this->outString_, "M%.1fP34R", pAxis->axisModuleNo_);
-  } else if(pasynUser->reason == initRecoveryTime_){
-    sprintf(this->outString_, "M%.1fP13R", pAxis->axisModuleNo_);
-  } else if(pasynUser->reason == positionRecoveryTime_){
-    sprintf(this->outString_, "M%.1fP16R", pAxis->axisModuleNo_);
-  } else if(pasynUser->reason == boost_){
-    sprintf(this->outString_, "M%.1fP17R", pAxis->axisModuleNo_);
-  } else if(pasynUser->reason == encoderRate_){
-    sprintf(this->outString_, "M%.1fP26R", pAxis->axisModuleNo_);
-  } else if(pasynUser->reason == switchTyp_){
-    sprintf(this->outString_, "M%.1fP27R", pAxis->axisModuleNo_);
-  } else if(pasynUser->reason == pwrStageMode_){
-    sprintf(this->outString_, "M%.1fP28R", pAxis->axisModuleNo_);
-  } else if(pasynUser->reason == encoderRes_){
-    sprintf(this->outString_, "M%.1fP35R", pAxis->axisModuleNo_);
-  } else if(pasynUser->reason == encoderFunc_){
-    sprintf(this->outString_, "M%.1fP36R", pAxis->axisModuleNo_);
-  } else if(pasynUser->reason == encoderSFIWidth_){
-    sprintf(this->outString_, "M%.1fP37R", pAxis->axisModuleNo_);
-  } else if(pasynUser->reason == encoderDirection_){
-    sprintf(this->outString_, "M%.1fP38R", pAxis->axisModuleNo_);
-  } else if(pasynUser->reason == currentDelayTime_){
-    sprintf(this->outString_, "M%.1fP43R", pAxis->axisModuleNo_);
-  } else if(pasynUser->reason == powerStageMonitor_){
-    sprintf(this->outString_, "M%.1fP53R", pAxis->axisModuleNo_);
   }
 
-
-  phyStatus = sendPhytronCommand(this->outString_, this->inString_, MAX_CONTROLLER_STRING_SIZE, &pAxis->response_len);
+  phyStatus = sendSlowPhytronCommand(command, response, MAX_CONTROLLER_STRING_SIZE, &response_len);
   if(phyStatus){
     if (phyStatus != lastStatus) {
       asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
@@ -253,15 +361,7 @@ asynStatus phytronController::readInt32(asynUser *pasynUser, epicsInt32 *value)
   }
   lastStatus = phyStatus;
 
-  *value = atoi(this->inString_);
-
-  //{STOP,RUN,BOOST} current records have EGU set to mA, but device returns 10mA
-  if(pasynUser->reason == stopCurrent_ || pasynUser->reason == runCurrent_ ||
-      pasynUser->reason == boostCurrent_)
-  {
-    *value *= 10;
-  } // else if
-
+  *value = NINT(atof(response)*pDesc->scale);
 
   return asynSuccess;
 }
@@ -273,7 +373,11 @@ asynStatus phytronController::readInt32(asynUser *pasynUser, epicsInt32 *value)
 asynStatus phytronController::writeInt32(asynUser *pasynUser, epicsInt32 value)
 {
   phytronAxis   *pAxis;
+  const phytronParamDesc *pDesc;
   phytronStatus phyStatus;
+  char          command[MAX_CONTROLLER_STRING_SIZE];
+  char          response[MAX_CONTROLLER_STRING_SIZE];
+  size_t        response_len;
 
   //Call base implementation first
   asynMotorController::writeInt32(pasynUser, value);
@@ -282,9 +386,8 @@ asynStatus phytronController::writeInt32(asynUser *pasynUser, epicsInt32 value)
    * Check if this is a call to reset the controller, else it is an axis request
    */
   if(pasynUser->reason == resetController_){
-    size_t response_len;
-    sprintf(this->outString_, "CR");
-    phyStatus = sendPhytronCommand(this->outString_, this->inString_, MAX_CONTROLLER_STRING_SIZE, &response_len);
+    sprintf(command, "CR");
+    phyStatus = sendSlowPhytronCommand(command, response, MAX_CONTROLLER_STRING_SIZE, &response_len);
     if(phyStatus){
       if (phyStatus != lastStatus) {
         asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
@@ -295,9 +398,9 @@ asynStatus phytronController::writeInt32(asynUser *pasynUser, epicsInt32 value)
     resetAxisEncoderRatio();
     return phyToAsyn(phyStatus);
   } else if(pasynUser->reason == controllerStatusReset_){
-    size_t response_len;
-    sprintf(this->outString_, "STC");
-    phyStatus = sendPhytronCommand(this->outString_, this->inString_, MAX_CONTROLLER_STRING_SIZE, &response_len);
+    statusValid_ = false;
+    sprintf(command, "STC");
+    phyStatus = sendSlowPhytronCommand(command, response, MAX_CONTROLLER_STRING_SIZE, &response_len);
     if(phyStatus){
       if (phyStatus != lastStatus) {
         asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
@@ -306,6 +409,9 @@ asynStatus phytronController::writeInt32(asynUser *pasynUser, epicsInt32 value)
     }
     lastStatus = phyStatus;
     return phyToAsyn(phyStatus);
+  } else if(pasynUser->reason == pollJitterReset_){
+    resetJitter();
+    return asynSuccess;
   }
   /*
    * This is an axis request, find the axis
@@ -321,59 +427,46 @@ asynStatus phytronController::writeInt32(asynUser *pasynUser, epicsInt32 value)
     setIntegerParam(pAxis->axisNo_, pasynUser->reason, value);
     callParamCallbacks();
     return asynSuccess;
+  } else if(pasynUser->reason == pollEncoderDivider_){
+    pAxis->setPollProfile(value, pAxis->statusDivider_);
+    return asynSuccess;
+  } else if(pasynUser->reason == pollStatusDivider_){
+    pAxis->setPollProfile(pAxis->encoderDivider_, value);
+    return asynSuccess;
+  } else if(pasynUser->reason == healthReset_){
+    resetTemperature(&pAxis->psTempStats_);
+    resetTemperature(&pAxis->motorTempStats_);
+    setDoubleParam(pAxis->axisNo_, powerStageTempMin_,  pAxis->psTempStats_.min);
+    setDoubleParam(pAxis->axisNo_, powerStageTempMax_,  pAxis->psTempStats_.max);
+    setDoubleParam(pAxis->axisNo_, powerStageTempRate_, pAxis->psTempStats_.rate);
+    setDoubleParam(pAxis->axisNo_, motorTempMin_,       pAxis->motorTempStats_.min);
+    setDoubleParam(pAxis->axisNo_, motorTempMax_,       pAxis->motorTempStats_.max);
+    setDoubleParam(pAxis->axisNo_, motorTempRate_,      pAxis->motorTempStats_.rate);
+    callParamCallbacks(pAxis->axisNo_);
+    return asynSuccess;
   } else if(pasynUser->reason == axisReset_){
-    sprintf(this->outString_, "M%.1fC", pAxis->axisModuleNo_);
+    sprintf(command, "M%.1fC", pAxis->axisModuleNo_);
   } else if(pasynUser->reason == axisStatusReset_){
-    sprintf(this->outString_, "SEC%.1f", pAxis->axisModuleNo_);
-  } else if(pasynUser->reason == axisMode_){
-    sprintf(this->outString_, "M%.1fP01=%d", pAxis->axisModuleNo_,value);
-  } else if(pasynUser->reason == mopOffsetPos_){
-    sprintf(this->outString_, "M%.1fP11=%d", pAxis->axisModuleNo_,value);
-  } else if(pasynUser->reason == mopOffsetNeg_){
-    sprintf(this->outString_, "M%.1fP12=%d", pAxis->axisModuleNo_,value);
-  } else if (pasynUser->reason == stepResolution_){
-    sprintf(this->outString_, "M%.1fP45=%d", pAxis->axisModuleNo_,value);
-  }  else if (pasynUser->reason == stopCurrent_){
-    value /= 10; //STOP_CURRENT record has EGU mA, device expects 10mA
-    sprintf(this->outString_, "M%.1fP40=%d", pAxis->axisModuleNo_,value);
-  } else if (pasynUser->reason == runCurrent_){
-    value /= 10; //RUN_CURRENT record has EGU mA, device expects 10mA
-    sprintf(this->outString_, "M%.1fP41=%d", pAxis->axisModuleNo_,value);
-  } else if (pasynUser->reason == boostCurrent_){
-    value /= 10; //BOOST_CURRENT record has EGU mA, device expects 10mA
-    sprintf(this->outString_, "M%.1fP42=%d", pAxis->axisModuleNo_,value);
-  } else if (pasynUser->reason == encoderType_){
-    sprintf(this->outString_, "M%.1fP34=%d", pAxis->axisModuleNo_, value);
-  } else if (pasynUser->reason == initRecoveryTime_){
-    sprintf(this->outString_, "M%.1fP13=%d", pAxis->axisModuleNo_, value);
-  } else if (pasynUser->reason == positionRecoveryTime_){
-    sprintf(this->outString_, "M%.1fP16=%d", pAxis->axisModuleNo_, value);
-  } else if (pasynUser->reason == boost_){
-    sprintf(this->outString_, "M%.1fP17=%d", pAxis->axisModuleNo_, value);
-  } else if (pasynUser->reason == encoderRate_){
-    sprintf(this->outString_, "M%.1fP26=%d", pAxis->axisModuleNo_, value);
-  } else if (pasynUser->reason == switchTyp_){
-    sprintf(this->outString_, "M%.1fP27=%d", pAxis->axisModuleNo_, value);
-  } else if (pasynUser->reason == pwrStageMode_){
-    sprintf(this->outString_, "M%.1fP28=%d", pAxis->axisModuleNo_, value);
-  } else if (pasynUser->reason == encoderRes_){
-    sprintf(this->outString_, "M%.1fP35=%d", pAxis->axisModuleNo_, value);
-  } else if (pasynUser->reason == encoderFunc_){
+    sprintf(command, "SEC%.1f", pAxis->axisModuleNo_);
+  } else if(pasynUser->reason == encoderFunc_){
     //Value is VAL field of parameter P37 record. If P37 is positive P36 is set to 1, else 0
-    sprintf(this->outString_, "M%.1fP36=%d", pAxis->axisModuleNo_, value > 0 ? 1 : 0);
-  } else if(pasynUser->reason == encoderSFIWidth_){
-    sprintf(this->outString_, "M%.1fP37=%d", pAxis->axisModuleNo_, value);
-  } else if(pasynUser->reason == encoderSFIWidth_){
-    sprintf(this->outString_, "M%.1fP38=%d", pAxis->axisModuleNo_, value);
-  } else if(pasynUser->reason == powerStageMonitor_){
-    sprintf(this->outString_, "M%.1fP53=%d", pAxis->axisModuleNo_, value);
-  } else if(pasynUser->reason == currentDelayTime_){
-    sprintf(this->outString_, "M%.1fP43=%d", pAxis->axisModuleNo_, value);
-  } else if(pasynUser->reason == encoderDirection_){
-    sprintf(this->outString_, "M%.1fP38=%d", pAxis->axisModuleNo_, value);
-  }
-
-  phyStatus = sendPhytronCommand(this->outString_, this->inString_, MAX_CONTROLLER_STRING_SIZE, &pAxis->response_len);
+    sprintf(command, "M%.1fP36=%d", pAxis->axisModuleNo_, value > 0 ? 1 : 0);
+  } else if((pDesc = findParam(pasynUser->reason))){
+    if(pDesc->readOnly){
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+        "phytronAxis::writeInt32: Parameter %s is read only\n", pDesc->name);
+      return asynError;
+    }
+    sprintf(command, "M%.1fP%02d=%d", pAxis->axisModuleNo_, pDesc->pNumber, NINT(value/pDesc->scale));
+  } else {
+    return asynSuccess;
+  }
+
+  //The written value is read back from the controller until the next snapshot
+  pAxis->snapshotValid_ = false;
+  pAxis->healthValid_ = false;
+
+  phyStatus = sendSlowPhytronCommand(command, response, MAX_CONTROLLER_STRING_SIZE, &response_len);
   if(phyStatus){
     phyStatus = phytronInvalidCommand;
     if (phyStatus != lastStatus) {
@@ -394,7 +487,16 @@ asynStatus phytronController::writeInt32(asynUser *pasynUser, epicsInt32 value)
  */
 asynStatus phytronController::readFloat64(asynUser *pasynUser, epicsFloat64 *value){
   phytronAxis   *pAxis;
+  const phytronParamDesc *pDesc;
   phytronStatus phyStatus;
+  char          command[MAX_CONTROLLER_STRING_SIZE];
+  char          response[MAX_CONTROLLER_STRING_SIZE];
+  size_t        response_len;
+
+  //Controller parameters maintained by the driver
+  if(pasynUser->reason == pollJitterP50_ || pasynUser->reason == pollJitterP99_ || pasynUser->reason == pollJitterMax_){
+    return asynPortDriver::readFloat64(pasynUser, value);
+  }
 
   pAxis = getAxis(pasynUser);
   if(!pAxis){
@@ -406,13 +508,17 @@ asynStatus phytronController::readFloat64(asynUser *pasynUser, epicsFloat64 *val
   //Call base implementation first
   asynPortDriver::readFloat64(pasynUser, value);
 
-  if(pasynUser->reason == powerStageTemp_){
-    sprintf(this->outString_, "M%.1fP49R", pAxis->axisModuleNo_);
-  } else if(pasynUser->reason == motorTemp_){
-    sprintf(this->outString_, "M%.1fP54R", pAxis->axisModuleNo_);
+  pDesc = findParam(pasynUser->reason);
+  if(pDesc){
+    //Served from the parameter library while the snapshot or health monitor is current
+    if(isCached(pAxis, pDesc)) return asynSuccess;
+    sprintf(command, "M%.1fP%02dR", pAxis->axisModuleNo_, pDesc->pNumber);
+  } else {
+    //Parameters maintained by the driver, the base implementation already returned their value
+    return asynSuccess;
   }
 
-  phyStatus = sendPhytronCommand(this->outString_, this->inString_, MAX_CONTROLLER_STRING_SIZE, &pAxis->response_len);
+  phyStatus = sendSlowPhytronCommand(command, response, MAX_CONTROLLER_STRING_SIZE, &response_len);
   if(phyStatus){
     if (phyStatus != pAxis->lastStatus) {
       asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
@@ -423,10 +529,7 @@ asynStatus phytronController::readFloat64(asynUser *pasynUser, epicsFloat64 *val
   }
   pAxis->lastStatus = phyStatus;
 
-  *value = atof(this->inString_);
-
-  //Power stage and motor temperature records have EGU °C, but device returns 0.1 °C
-  *value /= 10;
+  *value = atof(response)*pDesc->scale;
 
   return phyToAsyn(phyStatus);
 
@@ -442,213 +545,1375 @@ void phytronController::resetAxisEncoderRatio(){
 }
 
 
-/** Reports on status of the driver
-  * \param[in] fp The file pointer on which report information will be written
-  * \param[in] level The level of report detail desired
-  *
-  * If details > 0 then information is printed about each axis.
-  * After printing controller-specific information it calls asynMotorController::report()
+/** Estimates the time at which the controller sampled the reply to the last
+  * command. The controller is assumed to answer half way through the measured
+  * round trip, so the estimate is the midpoint between sending the request and
+  * receiving the reply.
+  * \param[out] pSampleTime Estimated controller-side sample time
   */
-void phytronController::report(FILE *fp, int level)
+void phytronController::getSampleTime(epicsTimeStamp *pSampleTime)
 {
-  fprintf(fp, "PhyMotion motor driver %s, numAxes=%d, moving poll period=%f, idle poll period=%f\n",
-    this->portName, numAxes_, movingPollPeriod_, idlePollPeriod_);
+  *pSampleTime = lastRequestTime_;
+  epicsTimeAddSeconds(pSampleTime, epicsTimeDiffInSeconds(&lastReplyTime_, &lastRequestTime_)/2);
+}
 
-  // Call the base class method
-  asynMotorController::report(fp, level);
+/** Sets the period at which extrapolated positions are published between polls
+  * \param[in] period  Period in seconds, 0 disables the estimator
+  */
+void phytronController::setEstimatorPeriod(double period)
+{
+  lock();
+  estimatorPeriod_ = period > 0 ? period : 0;
+  unlock();
+  profileTask_->wake();
 }
 
-/** Returns a pointer to an phytronAxis object.
-  * Returns NULL if the axis number encoded in pasynUser is invalid.
-  * \param[in] pasynUser asynUser structure that encodes the axis index number.
+/** Follows the modelled moves between polls.
+  * - Wakes up the poller when a move is predicted to complete, so the end of
+  *   the move is detected without waiting for the next moving poll. If the
+  *   axis is still moving, polling continues at the moving poll period.
+  * - Publishes extrapolated positions of moving axes if the estimator is
+  *   enabled. Estimates are written to POSITION_ESTIMATE with
+  *   POSITION_ESTIMATED set to 1, every poll overwrites them with the measured
+  *   position and clears the flag.
   */
-phytronAxis* phytronController::getAxis(asynUser *pasynUser)
+double phytronController::profileTask()
 {
-  return dynamic_cast<phytronAxis*>(asynMotorController::getAxis(pasynUser));
+  epicsTimeStamp now;
+  double position;
+  double timeout;
+  double remaining;
+  bool completed = false;
+
+  lock();
+  epicsTimeGetCurrent(&now);
+  for(uint32_t i = 0; i < axes.size(); i++){
+    if(axes[i]->completionPending_ && epicsTimeDiffInSeconds(&now, &axes[i]->profileEnd_) >= 0){
+      axes[i]->completionPending_ = false;
+      completed = true;
+    }
+  }
+  if(completed) wakeupPoller();
+
+  if(estimatorPeriod_ > 0){
+    for(uint32_t i = 0; i < axes.size(); i++){
+      if(!axes[i]->estimatePosition(&now, &position)) continue;
+      setDoubleParam(axes[i]->axisNo_, positionEstimate_, position);
+      setIntegerParam(axes[i]->axisNo_, positionEstimated_, 1);
+      setTimeStamp(&now);
+      callParamCallbacks(axes[i]->axisNo_);
+    }
+  }
+
+  //Run again at the next estimate or the next predicted completion, whichever comes first
+  timeout = estimatorPeriod_ > 0 ? estimatorPeriod_ : -1;
+  for(uint32_t i = 0; i < axes.size(); i++){
+    if(!axes[i]->completionPending_) continue;
+    remaining = max(epicsTimeDiffInSeconds(&axes[i]->profileEnd_, &now), 0.);
+    if(timeout < 0 || remaining < timeout) timeout = remaining;
+  }
+  unlock();
+
+  return timeout;
 }
 
-/** Returns a pointer to an phytronAxis object.
-  * Returns NULL if the axis number encoded in pasynUser is invalid.
-  * \param[in] axisNo Axis index number.
+/** Sends several commands in as few telegrams as possible. Up to batchSize_
+  * commands are sent in one telegram, separated by blanks, and the controller
+  * is expected to answer with one blank separated value per command. If the
+  * reply does not contain one value per command, the commands of that telegram
+  * are sent one by one; batching is disabled for this controller only after
+  * BATCH_MISMATCH_LIMIT such replies in a row. If a telegram is refused with
+  * NAK, its commands are sent one by one to find the failing one.
+  * \param[in]  commands   Commands to send
+  * \param[out] replies    Reply of each command
+  * \param[out] statuses   Status of each command
+  * \param[in]  slow       Send on the slow path connection, see sendSlowPhytronCommand
+  * \param[in]  writes     Commands only set parameters, an acknowledge without values acknowledges all of them
+  * \param[out] telegrams  Incremented by the number of telegrams sent, may be NULL
+  * \return phytronSuccess if all commands succeeded, else the last error
   */
-phytronAxis* phytronController::getAxis(int axisNo)
+phytronStatus phytronController::sendPhytronBatch(const vector<string> &commands, vector<string> &replies,
+                                                  vector<phytronStatus> &statuses, bool slow, bool writes,
+                                                  int *telegrams)
 {
-  return dynamic_cast<phytronAxis*>(asynMotorController::getAxis(axisNo));
+  char telegram[MAX_CONTROLLER_STRING_SIZE];
+  char response[MAX_CONTROLLER_STRING_SIZE];
+  size_t response_len;
+  size_t first = 0;
+  size_t count;
+  size_t length;
+  phytronStatus phyStatus;
+  phytronStatus status = phytronSuccess;
+  vector<string> fields;
+  //sendSlowPhytronCommand falls back to the fast path without a slow path connection
+  phytronFramer *pFramer = (slow && pasynUserSlow_) ? &slowFramer_ : &framer_;
+
+  replies.assign(commands.size(), "");
+  statuses.assign(commands.size(), phytronSuccess);
+  //The telegrams of a batch and batchSize_ are not shared with other slow callers
+  if(slow) lockSlowPath();
+
+  while(first < commands.size()){
+    //Pack as many commands as fit into one telegram
+    length = 0;
+    count = 0;
+    while(first + count < commands.size() && count < (size_t) batchSize_ &&
+          length + commands[first + count].size() + 1 < MAX_BATCH_LENGTH){
+      if(count) telegram[length++] = ' ';
+      strcpy(telegram + length, commands[first + count].c_str());
+      length += commands[first + count].size();
+      count++;
+    }
+
+    if(count > 1){
+      phyStatus = slow ? sendSlowPhytronCommand(telegram, response, MAX_CONTROLLER_STRING_SIZE, &response_len)
+                       : sendPhytronCommand(telegram, response, MAX_CONTROLLER_STRING_SIZE, &response_len);
+      if(telegrams) (*telegrams)++;
+      if(phyStatus == phytronSuccess){
+        phytronSplitReply(response, fields);
+        if(writes && fields.empty()){
+          batchMismatches_ = 0;
+          first += count;
+          continue;
+        } else if(fields.size() == count){
+          for(size_t i = 0; i < count; i++) replies[first + i] = fields[i];
+          batchMismatches_ = 0;
+          first += count;
+          continue;
+        }
+        batchMismatch((int) fields.size(), (int) count);
+      } else if(pFramer->mismatched()){
+        //Only replies that did not fit arrived, e.g. late answers to an earlier request
+        batchMismatch(-1, (int) count);
+      } else if(phyStatus != phytronInvalidReturn){
+        //No answer at all, sending the commands one by one would only multiply the timeouts
+        for(size_t i = 0; i < count; i++) statuses[first + i] = phyStatus;
+        status = phyStatus;
+        first += count;
+        continue;
+      }
+    }
+
+    //Send one by one, either not batched or the controller refused the batch
+    if(count == 0) count = 1;
+    for(size_t i = 0; i < count; i++){
+      phyStatus = slow ? sendSlowPhytronCommand(commands[first + i].c_str(), response, MAX_CONTROLLER_STRING_SIZE, &response_len)
+                       : sendPhytronCommand(commands[first + i].c_str(), response, MAX_CONTROLLER_STRING_SIZE, &response_len);
+      if(telegrams) (*telegrams)++;
+      statuses[first + i] = phyStatus;
+      if(phyStatus) status = phyStatus;
+      else replies[first + i] = response;
+    }
+    first += count;
+  }
+  if(slow) epicsMutexUnlock(slowMutex_);
+
+  return status;
 }
 
-/**
- * @brief implements phytron specific data fromat
- * @param output
- * @param input
- * @param maxChars
- * @param nread
- * @param timeout
- * @return
- */
+/** Counts a batch reply that did not fit its commands and disables batching
+  * after BATCH_MISMATCH_LIMIT of them in a row. The commands of the batch are
+  * then sent one by one by the caller.
+  * \param[in] values    Values received, -1 if no fitting reply arrived at all
+  * \param[in] commands  Commands sent in the telegram
+  */
+void phytronController::batchMismatch(int values, int commands)
+{
+  static const char *functionName = "phytronController::batchMismatch";
+
+  batchFallbacks_++;
+  if(++batchMismatches_ < BATCH_MISMATCH_LIMIT || batchSize_ == 1){
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_WARNING,
+      "%s: Controller %s answered %d values to %d commands, sending them one by one\n",
+      functionName, this->controllerName_, values, commands);
+    return;
+  }
+  asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+    "%s: Controller %s answered %d batches in a row with a reply that did not fit, batching disabled\n",
+    functionName, this->controllerName_, batchMismatches_);
+  batchSize_ = 1;
+}
 
-phytronStatus phytronController::sendPhytronCommand(const char *command, char *response_buffer, size_t response_max_len, size_t *nread)
+/** Applies configuration commands in batched telegrams on the slow path and
+  * reports every command that failed
+  * \param[in] commands  Commands that set parameters, e.g. M1.1P45=4
+  * \return asynSuccess if all commands were acknowledged
+  */
+asynStatus phytronController::applyConfig(const vector<string> &commands)
 {
-    char buffer[255];
-    char* buffer_end=buffer;
-    static const char *functionName = "phytronController::sendPhytronCommand";
+  vector<string> replies;
+  vector<phytronStatus> statuses;
+  phytronStatus phyStatus;
+  int telegrams = 0;
+  int failed = 0;
+
+  lock();
+  phyStatus = sendPhytronBatch(commands, replies, statuses, true, true, &telegrams);
+  //Parameters may have changed behind the snapshot
+  for(uint32_t i = 0; i < axes.size(); i++) axes[i]->snapshotValid_ = false;
+  unlock();
+
+  for(uint32_t i = 0; i < commands.size(); i++){
+    if(!statuses[i]) continue;
+    printf("%s: '%s' failed with error code: %d\n", this->controllerName_, commands[i].c_str(), statuses[i]);
+    failed++;
+  }
+  printf("%s: %d configuration commands applied in %d telegrams, %d failed\n",
+         this->controllerName_, (int) commands.size(), telegrams, failed);
 
-    *(buffer_end++)=0x02;                               //STX
-    *(buffer_end++)='0';                                //Module address TODO: add class member
-    buffer_end += sprintf(buffer_end,"%s",command);     //Append command
-    *(buffer_end++)=0x3a;                               //Append separator
+  return phyToAsyn(phyStatus);
+}
 
-    buffer_end += sprintf(buffer_end,"%c%c",'X','X');   //XX disables checksum
-    *(buffer_end++)=0x03;                               //Append ETX
-    *(buffer_end)=0x0;                                  //Null terminate message for saftey
+/** Saves the writable parameters of all axes, as read from the controller, to a
+  * configuration file that restoreParams and phytronApplyConfig accept
+  * \param[in] fileName  File to write
+  */
+asynStatus phytronController::saveParams(const char *fileName)
+{
+  char command[MAX_CONTROLLER_STRING_SIZE];
+  char time[40];
+  vector<string> commands;
+  vector<string> replies;
+  vector<phytronStatus> statuses;
+  epicsTimeStamp now;
+  int telegrams = 0;
+  int failed = 0;
+  FILE *fp;
 
-    phytronStatus status = (phytronStatus) writeReadController(buffer,buffer,255,nread, timeout_);
-    if(status){
-        return status;
+  for(uint32_t i = 0; i < axes.size(); i++){
+    for(int j = 0; j < paramTableSize_; j++){
+      if(paramTable_[j].readOnly) continue;
+      sprintf(command, "M%.1fP%02dR", axes[i]->axisModuleNo_, paramTable_[j].pNumber);
+      commands.push_back(command);
     }
+  }
 
-    char* nack_ack = strchr(buffer,0x02); //Find STX
-    if(!nack_ack){
-        nread=0;
-        status = phytronInvalidReturn;
-        if (status != lastStatus) {
-          asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
-          "%s: Communication failed\n",
-          functionName);
-        }
-        lastStatus = status;
-        return status;
+  lock();
+  sendPhytronBatch(commands, replies, statuses, true, false, &telegrams);
+  unlock();
+
+  fp = fopen(fileName, "w");
+  if(!fp){
+    printf("ERROR: %s: Cannot write %s\n", this->controllerName_, fileName);
+    return asynError;
+  }
+  epicsTimeGetCurrent(&now);
+  epicsTimeToStrftime(time, sizeof(time), "%Y/%m/%d %H:%M:%S", &now);
+  fprintf(fp, "# Axis parameters of %s, saved %s\n", this->controllerName_, time);
+
+  for(uint32_t i = 0; i < commands.size(); i++){
+    //M<m.a>P<nn>R is restored with M<m.a>P<nn>=<value>
+    string name = commands[i].substr(0, commands[i].size() - 1);
+    if(statuses[i]){
+      fprintf(fp, "# %s not read, error code: %d\n", name.c_str(), statuses[i]);
+      failed++;
+    } else {
+      fprintf(fp, "%s=%s\n", name.c_str(), replies[i].c_str());
     }
-    lastStatus = phytronSuccess;
-    nack_ack++; //NACK/ACK is one
-    //ACK, extract response
-    if(*nack_ack==0x06){
-        char* separator = strchr(nack_ack,0x3a);          //find separator
+  }
+  fclose(fp);
 
-        /* Copy data from nack_ack to
-         * separator into buffer */
-        uint32_t len = separator-nack_ack-1;              //calculate length of message
-        if(len > response_max_len) len=response_max_len;
+  printf("%s: %d axis parameters saved to %s, read in %d telegrams, %d failed\n",
+         this->controllerName_, (int) commands.size() - failed, fileName, telegrams, failed);
 
-        memcpy(response_buffer,nack_ack+1,len);           //copy payload to destination
-        response_buffer[separator-nack_ack-1]=0;          //Add NULL terminator
+  return failed ? asynError : asynSuccess;
+}
 
-        *nread=strlen(response_buffer);
-    }
-    //NAK return error
-    else if(*nack_ack==0x15){
-        nread=0;
-        status = phytronInvalidReturn;
-        if (status != lastStatus) {
-          asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
-          "%s: Nack sent by the controller\n",
-          functionName);
-        }
-        lastStatus = status;
-        return status;
+/** Restores axis parameters saved by saveParams. The current values are read
+  * from the controller first and only parameters that differ are written, in
+  * batched telegrams. Prints how long reading and writing took.
+  * \param[in] commands  Commands of the form M<m.a>P<nn>=<value>
+  */
+asynStatus phytronController::restoreParams(const vector<string> &commands)
+{
+  vector<string> reads;
+  vector<string> writes;
+  vector<string> values;
+  vector<string> replies;
+  vector<phytronStatus> statuses;
+  epicsTimeStamp start, read, written;
+  phytronStatus phyStatus = phytronSuccess;
+  int readTelegrams = 0;
+  int writeTelegrams = 0;
+  int failed = 0;
+  size_t separator;
+
+  for(uint32_t i = 0; i < commands.size(); i++){
+    separator = commands[i].find('=');
+    if(separator == string::npos || commands[i][0] != 'M'){
+      printf("%s: '%s' is not an axis parameter, skipped\n", this->controllerName_, commands[i].c_str());
+      continue;
     }
-    lastStatus = phytronSuccess;
+    reads.push_back(commands[i].substr(0, separator) + "R");
+    values.push_back(commands[i].substr(separator + 1));
+  }
 
-    return status;
+  lock();
+  epicsTimeGetCurrent(&start);
+  sendPhytronBatch(reads, replies, statuses, true, false, &readTelegrams);
+  epicsTimeGetCurrent(&read);
 
-}
+  //Unreadable parameters are written anyway
+  for(uint32_t i = 0; i < reads.size(); i++){
+    if(!statuses[i] && atof(replies[i].c_str()) == atof(values[i].c_str())) continue;
+    writes.push_back(reads[i].substr(0, reads[i].size() - 1) + "=" + values[i]);
+  }
 
-/** Castst phytronStatus to asynStatus enumeration
- * \param[in] phyStatus
- */
-asynStatus phytronController::phyToAsyn(phytronStatus phyStatus){
-  if(phyStatus == phytronInvalidReturn || phyStatus == phytronInvalidCommand) return asynError;
-  return (asynStatus) phyStatus;
-}
+  if(!writes.empty()) phyStatus = sendPhytronBatch(writes, replies, statuses, true, true, &writeTelegrams);
+  epicsTimeGetCurrent(&written);
+  for(uint32_t i = 0; i < axes.size(); i++) axes[i]->snapshotValid_ = false;
+  unlock();
 
+  for(uint32_t i = 0; i < writes.size(); i++){
+    if(!statuses[i]) continue;
+    printf("%s: '%s' failed with error code: %d\n", this->controllerName_, writes[i].c_str(), statuses[i]);
+    failed++;
+  }
+  printf("%s: %d axis parameters read in %d telegrams (%.1f ms), %d differed, written in %d telegrams (%.1f ms), %d failed\n",
+         this->controllerName_, (int) reads.size(), readTelegrams, epicsTimeDiffInSeconds(&read, &start)*1000,
+         (int) writes.size(), writeTelegrams, epicsTimeDiffInSeconds(&written, &read)*1000, failed);
 
-//******************************************************************************
-//                   PHYTRON AXIS IMPLEMENTATION
-//******************************************************************************
+  return phyToAsyn(phyStatus);
+}
 
-/** Creates a new phytronAxis object.
-  * Configuration command, called directly or from iocsh
-  * \param[in] controllerName    Name of the asyn port created by calling phytronCreateController from st.cmd
-  * \param[in] module            Index of the I1AM01 module controlling this axis
-  * \param[in] axis              Axis index
+/** Reads the module of each slot (IM1..IM16) in batched telegrams on the slow
+  * path. The inventory is read once and kept, unless refresh is set.
+  * \param[in] refresh  Read the inventory even if it was read before
   */
-extern "C" int phytronCreateAxis(const char* controllerName, int module, int axis){
+asynStatus phytronController::discoverModules(bool refresh)
+{
+  char command[MAX_CONTROLLER_STRING_SIZE];
+  vector<string> commands;
+  vector<string> replies;
+  vector<phytronStatus> statuses;
+  int telegrams = 0;
+  int answered = 0;
+
+  if(inventoryValid_ && !refresh) return asynSuccess;
+
+  for(int i = 1; i <= MAX_MODULE_SLOTS; i++){
+    sprintf(command, "IM%d", i);
+    commands.push_back(command);
+  }
 
-  phytronAxis *pAxis;
+  lock();
+  sendPhytronBatch(commands, replies, statuses, true, false, &telegrams);
+  unlock();
 
-  //Find the controller
-  uint32_t i;
-  for(i = 0; i < controllers.size(); i++){
-    if(!strcmp(controllers[i]->controllerName_, controllerName)) {
-      pAxis = new phytronAxis(controllers[i], module*10 + axis);
-      controllers[i]->axes.push_back(pAxis);
-      break;
-    }
+  //Empty slots refuse IMn
+  for(uint32_t i = 0; i < commands.size(); i++){
+    if(statuses[i] == phytronSuccess) answered++;
+    else replies[i] = "";
   }
-
-  //If controller is not found, report error
-  if(i == controllers.size()){
-    printf("ERROR: phytronCreateAxis: Controller %s is not registered\n", controllerName);
+  if(!answered){
+    printf("ERROR: %s: No module answered IM1..IM%d\n", this->controllerName_, MAX_MODULE_SLOTS);
     return asynError;
   }
 
+  phytronBuildInventory(replies, inventory_);
+  inventoryValid_ = true;
+  printf("%s: %d slots read in %d telegrams\n", this->controllerName_, MAX_MODULE_SLOTS, telegrams);
+  phytronReportInventory(stdout, inventory_);
+
   return asynSuccess;
 }
 
-/** Creates a new phytronAxis object.
-  * \param[in] pC Pointer to the phytronController to which this axis belongs.
-  * \param[in] axisNo Index number of this axis, range 0 to pC->numAxes_-1.
-  *
-  * Initializes register numbers, etc.
+/** Creates the axes of all power stages and, if ioPrefix is set, an IO port for
+  * every IO module of the inventory. Axes and ports that exist are skipped.
+  * \param[in] pattern   Glob pattern; only modules whose type or axes whose
+  *                      address (M<module>.<axis>) match are used, "" for all
+  * \param[in] ioPrefix  IO ports are named <ioPrefix>DIO<n> and <ioPrefix>AIO<n>, "" creates none
+  * \return Number of axes and ports created
   */
-phytronAxis::phytronAxis(phytronController *pC, int axisNo)
-  : asynMotorAxis(pC, axisNo),
-    axisModuleNo_((float)axisNo/10),
-    pC_(pC),
-    response_len(0)
+int phytronController::createFromInventory(const char *pattern, const char *ioPrefix)
 {
+  char name[MAX_CONTROLLER_STRING_SIZE];
+  const char *io;
+  bool all = !pattern || !strlen(pattern);
+  bool typeMatches;
+  int busAddress = isdigit(busAddress_) ? busAddress_ - '0' : busAddress_ - 'A' + 10;
+  int created = 0;
+  phytronAxis *pAxis;
 
-  //Controller always supports encoder. Encoder enable/disable is set through UEIP
-  setIntegerParam(pC_->motorStatusHasEncoder_, 1);
+  for(uint32_t i = 0; i < inventory_.size(); i++){
+    const phytronModule &module = inventory_[i];
+    typeMatches = all || epicsStrGlobMatch(module.type.c_str(), pattern);
+
+    if(module.kind == modulePowerStage){
+      for(int axis = 1; axis <= module.axes; axis++){
+        sprintf(name, "M%d.%d", module.index, axis);
+        if(!typeMatches && !epicsStrGlobMatch(name, pattern)) continue;
+        if(module.index*10 + axis >= numAxes_){
+          printf("ERROR: %s: %s exceeds the axis range, skipped\n", this->controllerName_, name);
+          continue;
+        }
+        //The poller is running, it walks pAxes_ and axes with the controller locked
+        lock();
+        if(getAxis(module.index*10 + axis)){
+          unlock();
+          continue;
+        }
+        pAxis = new phytronAxis(this, module.index*10 + axis);
+        axes.push_back(pAxis);
+        pAxis->setPollProfile(1, 1);
+        unlock();
+        printf("%s: axis %s (%s in slot %d) created\n", this->controllerName_, name, module.type.c_str(), i + 1);
+        created++;
+      }
+    }
+    else if(module.kind == moduleDigitalIo || module.kind == moduleAnalogIo){
+      if(!ioPrefix || !strlen(ioPrefix) || !typeMatches) continue;
+      io = (module.kind == moduleDigitalIo) ? "DIO" : "AIO";
+      sprintf(name, "%.*s%s%d", MAX_CONTROLLER_STRING_SIZE - 8, ioPrefix, io, module.index);
+      if(findController(name)) continue;
+      phytronCreateIoCtrl(asynPortName_, name, module.index, (int) (timeout_*1000), "", busAddress);
+      printf("%s: IO port %s (%s in slot %d) created\n", this->controllerName_, name, module.type.c_str(), i + 1);
+      created++;
+    }
+  }
 
-  setDoubleParam(pC_->motorEncoderRatio_, 1);
+  return created;
+}
 
+/** Returns false if the inventory was read and has no such axis
+  * \param[in] module  Index of the power stage
+  * \param[in] axis    Axis index on the power stage
+  */
+bool phytronController::hasAxis(int module, int axis)
+{
+  if(!inventoryValid_) return true;
+  for(uint32_t i = 0; i < inventory_.size(); i++){
+    if(inventory_[i].kind == modulePowerStage && inventory_[i].index == module) return axis >= 1 && axis <= inventory_[i].axes;
+  }
+  return false;
 }
 
+/** Sets the maximum number of commands sent in one telegram
+  * \param[in] batchSize  Number of commands, 1 disables batching
+  */
+void phytronController::setBatchSize(int batchSize)
+{
+  lock();
+  batchSize_ = max(batchSize, 1);
+  batchMismatches_ = 0;
+  unlock();
+}
 
-/** Reports on status of the axis
-  * \param[in] fp The file pointer on which report information will be written
-  * \param[in] level The level of report detail desired
-  *
-  * After printing device-specific information calls asynMotorAxis::report()
+/** Returns the descriptor of a parameter mapped to a controller parameter
+  * \param[in] reason  Parameter index
+  * \return Descriptor in paramTable_, NULL if the parameter is maintained by the driver
   */
-void phytronAxis::report(FILE *fp, int level)
+const phytronParamDesc* phytronController::findParam(int reason)
 {
-  if (level > 0) {
-    fprintf(fp, "  axis %d\n",
-            axisNo_);
-  }
+  if(reason < 0 || (size_t) reason >= paramByReason_.size()) return NULL;
+  return paramByReason_[reason];
+}
 
-  // Call the base class method
-  asynMotorAxis::report(fp, level);
+/** Returns true if the parameter library holds a current value of the parameter
+  * \param[in] pAxis  Axis
+  * \param[in] pDesc  Parameter descriptor
+  */
+bool phytronController::isCached(phytronAxis *pAxis, const phytronParamDesc *pDesc)
+{
+  if(!pDesc->cacheable) return false;
+  if(pDesc->pollClass == pollSnapshot) return pAxis->snapshotValid_;
+  if(pDesc->pollClass == pollHealth)   return pAxis->healthValid_;
+  return false;
 }
 
-/** Sets velocity parameters before the move is executed. Controller produces a
- * trapezoidal speed profile defined by these parmeters.
- * \param[in] minVelocity   Start velocity
- * \param[in] maxVelocity   Maximum velocity
- * \param[in] moveType      Type of movement determines which controller speed parameters are set
- */
-phytronStatus phytronAxis::setVelocity(double minVelocity, double maxVelocity, int moveType)
+/** Reads all diagnostic parameters of an axis in batched telegrams on the slow
+  * path and publishes them. Must be called with the controller locked.
+  * \param[in] pAxis  Axis to read
+  */
+asynStatus phytronController::readSnapshot(phytronAxis *pAxis)
 {
+  char command[MAX_CONTROLLER_STRING_SIZE];
+  vector<const phytronParamDesc*> params;
+  vector<string> commands;
+  vector<string> replies;
+  vector<phytronStatus> statuses;
+  phytronStatus phyStatus;
 
-  phytronStatus maxStatus = phytronSuccess;
-  phytronStatus minStatus = phytronSuccess;
-  maxVelocity = fabs(maxVelocity);
-  minVelocity = fabs(minVelocity);
+  for(int i = 0; i < paramTableSize_; i++){
+    if(paramTable_[i].pollClass != pollSnapshot) continue;
+    sprintf(command, "M%.1fP%02dR", pAxis->axisModuleNo_, paramTable_[i].pNumber);
+    commands.push_back(command);
+    params.push_back(&paramTable_[i]);
+  }
 
-  if(maxVelocity > MAX_VELOCITY){
-    maxVelocity = MAX_VELOCITY;
-    asynPrint(pC_->pasynUserSelf, ASYN_TRACE_WARNING,
+  phyStatus = sendPhytronBatch(commands, replies, statuses, true);
+
+  for(uint32_t i = 0; i < params.size(); i++){
+    if(!statuses[i]) setParamFromReply(pAxis, params[i], replies[i].c_str());
+  }
+  pAxis->snapshotValid_ = (phyStatus == phytronSuccess);
+  //The poller stamps its values with their sample time, these are stamped now
+  updateTimeStamp();
+  callParamCallbacks(pAxis->axisNo_);
+
+  if(phyStatus){
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+      "phytronController::readSnapshot: Reading diagnostic parameters of axis %d failed with error code: %d\n",
+      pAxis->axisNo_, phyStatus);
+  }
+
+  return phyToAsyn(phyStatus);
+}
+
+/** Sets a parameter of an axis from the reply of the controller
+  * \param[in] pAxis  Axis
+  * \param[in] pDesc  Parameter descriptor
+  * \param[in] reply  Value returned by the controller
+  */
+void phytronController::setParamFromReply(phytronAxis *pAxis, const phytronParamDesc *pDesc, const char *reply)
+{
+  double value = atof(reply)*pDesc->scale;
+
+  if(pDesc->type == asynParamFloat64) setDoubleParam(pAxis->axisNo_, this->*pDesc->reason, value);
+  else                                setIntegerParam(pAxis->axisNo_, this->*pDesc->reason, NINT(value));
+}
+
+/** Sets the period of the diagnostic snapshot. The first snapshot of all axes
+  * is taken before returning, so records initialized at iocInit are served
+  * from the parameter library.
+  * \param[in] period  Period in seconds, 0 disables the snapshot
+  */
+void phytronController::setSnapshotPeriod(double period)
+{
+  lock();
+  snapshotPeriod_ = period > 0 ? period : 0;
+  if(snapshotPeriod_ > 0){
+    for(uint32_t i = 0; i < axes.size(); i++) readSnapshot(axes[i]);
+    epicsTimeGetCurrent(&snapshotStart_);
+    snapshotNext_ = 0;
+  } else {
+    for(uint32_t i = 0; i < axes.size(); i++) axes[i]->snapshotValid_ = false;
+  }
+
+  if(snapshotPeriod_ > 0 || snapshotTask_->started()) snapshotTask_->wake();
+  unlock();
+}
+
+/** Refreshes the diagnostic parameters of all axes every snapshotPeriod_ seconds.
+  * Records reading them can use SCAN=I/O Intr. Each run reads one axis and
+  * asks to run again at once for the next, so a worker of the pool is not held
+  * for the whole sweep.
+  */
+double phytronController::snapshotTask()
+{
+  double delay;
+
+  lock();
+  delay = nextSweepStep(snapshotPeriod_, &snapshotStart_, &snapshotNext_);
+  if(delay == 0){
+    if(axes.empty()){
+      delay = snapshotPeriod_;
+    } else {
+      readSnapshot(axes[snapshotNext_]);
+      delay = endSweepStep(snapshotPeriod_, &snapshotStart_, &snapshotNext_);
+    }
+  }
+  unlock();
+
+  return delay;
+}
+
+/** Starts a step of a sweep over the axes in a background task
+  * \param[in]     period  Sweep period in s, 0 if the sweep is disabled
+  * \param[in,out] pStart  Time the current sweep started
+  * \param[in,out] pNext   Index of the next axis, 0 at the start of a sweep
+  * \return 0 if axis *pNext is to be read now, else the delay until the next run, -1 to sleep
+  */
+double phytronController::nextSweepStep(double period, epicsTimeStamp *pStart, uint32_t *pNext)
+{
+  epicsTimeStamp now;
+  double delay;
+
+  if(period <= 0){
+    *pNext = 0;
+    return -1;
+  }
+  if(*pNext >= axes.size()) *pNext = 0;
+  if(*pNext == 0){
+    epicsTimeGetCurrent(&now);
+    delay = period - epicsTimeDiffInSeconds(&now, pStart);
+    if(delay > 0) return delay;
+    *pStart = now;
+  }
+
+  return 0;
+}
+
+/** Ends a step of a sweep, see nextSweepStep
+  * \return 0 to continue with the next axis at once, else the delay until the next sweep
+  */
+double phytronController::endSweepStep(double period, epicsTimeStamp *pStart, uint32_t *pNext)
+{
+  epicsTimeStamp now;
+
+  (*pNext)++;
+  if(*pNext < axes.size()) return 0;
+
+  *pNext = 0;
+  epicsTimeGetCurrent(&now);
+  return max(period - epicsTimeDiffInSeconds(&now, pStart), 0.);
+}
+
+/** Resets the statistics of a temperature to the last value read
+  * \param[in] pTemp  Temperature statistics
+  */
+void phytronController::resetTemperature(phytronTemperature *pTemp)
+{
+  pTemp->min = pTemp->last;
+  pTemp->max = pTemp->last;
+  pTemp->rate = 0;
+}
+
+/** Adds a temperature reading to the statistics of an axis and sets the parameters
+  * \param[in] pAxis        Axis the temperature belongs to
+  * \param[in] pTemp        Temperature statistics
+  * \param[in] value        Temperature in °C
+  * \param[in] dt           Time since the previous sweep in s
+  * \param[in] valueReason  Parameter of the temperature
+  * \param[in] minReason    Parameter of the minimum
+  * \param[in] maxReason    Parameter of the maximum
+  * \param[in] rateReason   Parameter of the rate of change
+  */
+void phytronController::updateTemperature(phytronAxis *pAxis, phytronTemperature *pTemp, double value, double dt,
+                                          int valueReason, int minReason, int maxReason, int rateReason)
+{
+  if(!pTemp->valid){
+    pTemp->last = value;
+    resetTemperature(pTemp);
+    pTemp->valid = true;
+  } else {
+    if(dt > 0) pTemp->rate = (value - pTemp->last)/dt*60;
+    pTemp->last = value;
+    pTemp->min = min(pTemp->min, value);
+    pTemp->max = max(pTemp->max, value);
+  }
+
+  setDoubleParam(pAxis->axisNo_, valueReason, pTemp->last);
+  setDoubleParam(pAxis->axisNo_, minReason,   pTemp->min);
+  setDoubleParam(pAxis->axisNo_, maxReason,   pTemp->max);
+  setDoubleParam(pAxis->axisNo_, rateReason,  pTemp->rate);
+}
+
+/** Reads power stage temperature (P49), power stage monitoring (P53) and motor
+  * temperature (P54) of a range of axes in batched telegrams on the slow path,
+  * and publishes them with their statistics. The range that ends with the last
+  * axis also reads the controller status (ST).
+  * Must be called with the controller locked.
+  * \param[in] first  Index of the first axis in axes
+  * \param[in] last   Index after the last axis
+  */
+asynStatus phytronController::readHealth(uint32_t first, uint32_t last)
+{
+  char command[MAX_CONTROLLER_STRING_SIZE];
+  vector<string> commands;
+  vector<string> replies;
+  vector<phytronStatus> statuses;
+  phytronStatus phyStatus;
+  phytronAxis *pAxis;
+  epicsTimeStamp now;
+  double dt;
+  uint32_t i;
+  vector<const phytronParamDesc*> params;
+  bool valid;
+  bool withStatus;
+
+  for(int j = 0; j < paramTableSize_; j++){
+    if(paramTable_[j].pollClass == pollHealth) params.push_back(&paramTable_[j]);
+  }
+
+  for(i = first; i < last; i++){
+    for(uint32_t j = 0; j < params.size(); j++){
+      sprintf(command, "M%.1fP%02dR", axes[i]->axisModuleNo_, params[j]->pNumber);
+      commands.push_back(command);
+    }
+  }
+  withStatus = last == axes.size();
+  if(withStatus) commands.push_back("ST");
+  if(commands.empty()) return asynSuccess;
+
+  phyStatus = sendPhytronBatch(commands, replies, statuses, true);
+  epicsTimeGetCurrent(&now);
+
+  for(i = first; i < last; i++){
+    pAxis = axes[i];
+    const string        *reply  = &replies[(i - first)*params.size()];
+    const phytronStatus *status = &statuses[(i - first)*params.size()];
+
+    valid = true;
+    for(uint32_t j = 0; j < params.size(); j++) valid = valid && !status[j];
+    pAxis->healthValid_ = valid;
+    if(!valid) continue;
+
+    dt = epicsTimeDiffInSeconds(&now, &pAxis->healthTime_);
+    pAxis->healthTime_ = now;
+
+    for(uint32_t j = 0; j < params.size(); j++){
+      if(params[j]->reason == &phytronController::powerStageTemp_){
+        updateTemperature(pAxis, &pAxis->psTempStats_, atof(reply[j].c_str())*params[j]->scale, dt,
+                          powerStageTemp_, powerStageTempMin_, powerStageTempMax_, powerStageTempRate_);
+      } else if(params[j]->reason == &phytronController::motorTemp_){
+        updateTemperature(pAxis, &pAxis->motorTempStats_, atof(reply[j].c_str())*params[j]->scale, dt,
+                          motorTemp_, motorTempMin_, motorTempMax_, motorTempRate_);
+      } else {
+        setParamFromReply(pAxis, params[j], reply[j].c_str());
+      }
+    }
+    //The poller stamps its values with their sample time, these are stamped now
+    updateTimeStamp();
+    callParamCallbacks(pAxis->axisNo_);
+  }
+
+  if(withStatus){
+    statusValid_ = !statuses.back();
+    if(statusValid_){
+      setIntegerParam(0, controllerStatus_, atoi(replies.back().c_str()));
+      updateTimeStamp();
+      callParamCallbacks(0);
+    }
+  }
+
+  if(phyStatus && phyStatus != lastStatus){
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+      "phytronController::readHealth: Health sweep of controller %s failed with error code: %d\n",
+      this->controllerName_, phyStatus);
+  }
+  lastStatus = phyStatus;
+
+  return phyToAsyn(phyStatus);
+}
+
+/** Sets the period of the health monitor. The first sweep is done before
+  * returning, so records initialized at iocInit are served from the parameter
+  * library.
+  * \param[in] period  Period in seconds, 0 disables the health monitor
+  */
+void phytronController::setHealthPeriod(double period)
+{
+  lock();
+  healthPeriod_ = period > 0 ? period : 0;
+  if(healthPeriod_ > 0){
+    readHealth(0, axes.size());
+    epicsTimeGetCurrent(&healthStart_);
+    healthNext_ = 0;
+  } else {
+    for(uint32_t i = 0; i < axes.size(); i++) axes[i]->healthValid_ = false;
+    statusValid_ = false;
+  }
+
+  if(healthPeriod_ > 0 || healthTask_->started()) healthTask_->wake();
+  unlock();
+}
+
+/** Sweeps temperatures, power stage monitoring and controller status every
+  * healthPeriod_ seconds. Records reading them can use SCAN=I/O Intr. Each run
+  * reads one axis, the controller status is read with the last one.
+  */
+double phytronController::healthTask()
+{
+  double delay;
+
+  lock();
+  delay = nextSweepStep(healthPeriod_, &healthStart_, &healthNext_);
+  if(delay == 0){
+    if(axes.empty()){
+      readHealth(0, 0);
+      delay = healthPeriod_;
+    } else {
+      readHealth(healthNext_, healthNext_ + 1);
+      delay = endSweepStep(healthPeriod_, &healthStart_, &healthNext_);
+    }
+  }
+  unlock();
+
+  return delay;
+}
+
+/** Reports on status of the driver
+  * \param[in] fp The file pointer on which report information will be written
+  * \param[in] level The level of report detail desired
+  *
+  * If details > 0 then information is printed about each axis.
+  * After printing controller-specific information it calls asynMotorController::report()
+  */
+void phytronController::report(FILE *fp, int level)
+{
+  fprintf(fp, "PhyMotion motor driver %s, numAxes=%d, moving poll period=%f, idle poll period=%f, bus address=%c\n",
+    this->portName, numAxes_, movingPollPeriod_, idlePollPeriod_, busAddress_);
+  if (level > 0) {
+    rtt_.report(fp);
+    framer_.report(fp, "fast path");
+    if(pasynUserSlow_) slowFramer_.report(fp, "slow path");
+    if(inventoryValid_) phytronReportInventory(fp, inventory_);
+    fprintf(fp, "  batch size %d, %lu batches sent one by one as the reply did not fit%s\n",
+            batchSize_, batchFallbacks_, batchMismatches_ >= BATCH_MISMATCH_LIMIT ? ", batching disabled" : "");
+    fprintf(fp, "  poller: priority %d, policy %s, %d CPUs; jitter over %lu cycles: max %.3f ms, %lu early cycles\n",
+            pollerPriority_, pollerPolicy_ == pollerPolicyFifo ? "FIFO" : pollerPolicy_ == pollerPolicyOther ? "OTHER" : "default",
+            (int) pollerCpus_.size(), jitterSamples_, jitterMax_*1000, earlyPolls_);
+    if(shm_) shm_->report(fp);
+  }
+
+  // Call the base class method
+  asynMotorController::report(fp, level);
+}
+
+/** Called by the poller at the start of every poll cycle, before the axes are polled.
+  * Waits for the turn of this unit on a shared serial line; the last axis polled
+  * hands the line on. The axes skip the cycle if the unit is over its poll budget.
+  */
+asynStatus phytronController::poll()
+{
+  epicsTimeStamp now;
+  double late;
+
+  if(pollerConfigPending_) applyPollerConfig();
+
+  epicsTimeGetCurrent(&now);
+  if(cycleEndValid_){
+    late = epicsTimeDiffInSeconds(&now, &cycleEnd_) - cyclePeriod_;
+    if(late < -cyclePeriod_/2) earlyPolls_++;
+    else                       sampleJitter(fabs(late), &now);
+  }
+  cycleEndValid_ = false;
+  cycleMoving_ = false;
+
+  lastPolledAxis_ = NULL;
+  for(uint32_t i = 0; i < axes.size(); i++){
+    if(!lastPolledAxis_ || axes[i]->axisNo_ > lastPolledAxis_->axisNo_) lastPolledAxis_ = axes[i];
+  }
+  if(!lastPolledAxis_) return asynSuccess;
+
+  unlock();
+  pollSkipped_ = !bus_->beginPoll(busUnit_);
+  lock();
+
+  return asynSuccess;
+}
+
+/** Called by the last axis polled at the end of every poll cycle. Keeps the time
+  * and the period the poller waits for now: the moving poll period if an axis
+  * moved or forced fast polls are left, else the idle poll period.
+  */
+void phytronController::endPollCycle()
+{
+  epicsTimeGetCurrent(&cycleEnd_);
+  cyclePeriod_ = (cycleMoving_ || forcedFastPolls_ > 0) ? movingPollPeriod_ : idlePollPeriod_;
+  cycleEndValid_ = true;
+}
+
+/** Adds the jitter of a poll cycle. The poller runs with the controller locked,
+  * so the percentiles are only worked out and published every POLL_JITTER_PUBLISH_PERIOD.
+  * \param[in] jitter  Deviation of the cycle start from the poll period in s
+  * \param[in] pNow    Start of the cycle
+  */
+void phytronController::sampleJitter(double jitter, epicsTimeStamp *pNow)
+{
+  jitter_[jitterSamples_ % POLL_JITTER_SAMPLES] = jitter;
+  jitterSamples_++;
+  jitterMax_ = max(jitterMax_, jitter);
+  if(epicsTimeDiffInSeconds(pNow, &jitterPublished_) >= POLL_JITTER_PUBLISH_PERIOD) publishJitter();
+}
+
+/** Publishes median, 99th percentile and maximum of the poll jitter in ms */
+void phytronController::publishJitter()
+{
+  size_t n = min(jitterSamples_, (unsigned long) POLL_JITTER_SAMPLES);
+  double p50 = 0, p99 = 0;
+
+  if(n > 0){
+    jitterSorted_.assign(jitter_, jitter_ + n);
+    nth_element(jitterSorted_.begin(), jitterSorted_.begin() + n*99/100, jitterSorted_.end());
+    p99 = jitterSorted_[n*99/100];
+    nth_element(jitterSorted_.begin(), jitterSorted_.begin() + n/2, jitterSorted_.begin() + n*99/100);
+    p50 = jitterSorted_[n/2];
+  }
+  setDoubleParam(0, pollJitterP50_, p50*1000);
+  setDoubleParam(0, pollJitterP99_, p99*1000);
+  setDoubleParam(0, pollJitterMax_, jitterMax_*1000);
+  epicsTimeGetCurrent(&jitterPublished_);
+  updateTimeStamp();
+  callParamCallbacks(0);
+}
+
+/** Clears the poll jitter statistics. The next cycle is not measured, its
+  * predecessor may have ended before the reset.
+  */
+void phytronController::resetJitter()
+{
+  jitterSamples_ = 0;
+  jitterMax_ = 0;
+  earlyPolls_ = 0;
+  cycleEndValid_ = false;
+  publishJitter();
+}
+
+/** Configures the poller thread. The poller applies the configuration itself
+  * at the start of its next cycle, as its thread belongs to asynMotorController.
+  * \param[in] priority  EPICS priority 0 to 99, -1 keeps the priority
+  * \param[in] policy    "FIFO" for SCHED_FIFO, "OTHER" for SCHED_OTHER, empty keeps the policy
+  * \param[in] cpus      CPUs the poller may run on, e.g. "2,3", empty keeps the affinity
+  */
+asynStatus phytronController::setPollerThread(int priority, const char *policy, const char *cpus)
+{
+  phytronPollerPolicy newPolicy;
+  vector<int> newCpus;
+  const char *p;
+  char *end;
+  long cpu;
+
+  if(priority < -1 || priority > (int) epicsThreadPriorityMax) return asynError;
+
+  if(!policy || !strlen(policy))             newPolicy = pollerPolicyKeep;
+  else if(!epicsStrCaseCmp(policy, "OTHER")) newPolicy = pollerPolicyOther;
+  else if(!epicsStrCaseCmp(policy, "FIFO"))  newPolicy = pollerPolicyFifo;
+  else return asynError;
+
+  for(p = cpus; p && *p; p = end){
+    if(*p == ',' || isspace(*p)){
+      end = (char *) p + 1;
+      continue;
+    }
+    cpu = strtol(p, &end, 10);
+    if(end == p || cpu < 0 || cpu >= MAX_POLLER_CPUS) return asynError;
+    newCpus.push_back((int) cpu);
+  }
+
+  lock();
+  pollerPriority_ = priority;
+  pollerPolicy_ = newPolicy;
+  pollerCpus_ = newCpus;
+  pollerConfigPending_ = true;
+  //The jitter before the change is of no interest
+  resetJitter();
+  unlock();
+
+  return asynSuccess;
+}
+
+/** Publishes the state of every axis in a shared memory segment after each poll
+  * \param[in] name  Name of the segment, empty for "/phytron_<controller>"
+  */
+asynStatus phytronController::setSharedMemory(const char *name)
+{
+  string segmentName = (name && strlen(name)) ? string(name) : string("/phytron_") + controllerName_;
+  phytronShm *pShm;
+
+  if(shm_) return asynError;
+  pShm = phytronShm::create(segmentName.c_str(), controllerName_);
+  if(!pShm) return asynError;
+
+  lock();
+  shm_ = pShm;
+  unlock();
+
+  return asynSuccess;
+}
+
+/** Applies the poller thread configuration to the calling thread, called by the poller */
+void phytronController::applyPollerConfig()
+{
+  static const char *functionName = "phytronController::applyPollerConfig";
+
+  pollerConfigPending_ = false;
+  if(pollerPriority_ >= 0) epicsThreadSetPriority(epicsThreadGetIdSelf(), pollerPriority_);
+
+#ifdef __linux__
+  struct sched_param param;
+  cpu_set_t cpuSet;
+  int policy, lo, hi, err;
+
+  if(pollerPolicy_ != pollerPolicyKeep){
+    policy = pollerPolicy_ == pollerPolicyFifo ? SCHED_FIFO : SCHED_OTHER;
+    lo = sched_get_priority_min(policy);
+    hi = sched_get_priority_max(policy);
+    //EPICS priorities are mapped onto the range of the policy as EPICS does for its own threads
+    param.sched_priority = lo + (hi - lo) * (int) epicsThreadGetPrioritySelf() / (int) epicsThreadPriorityMax;
+    err = pthread_setschedparam(pthread_self(), policy, &param);
+    if(err){
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+        "%s: cannot set the scheduling policy of the poller of %s: %s\n", functionName, controllerName_, strerror(err));
+    }
+  }
+
+  if(!pollerCpus_.empty()){
+    CPU_ZERO(&cpuSet);
+    for(size_t i = 0; i < pollerCpus_.size(); i++) CPU_SET(pollerCpus_[i], &cpuSet);
+    err = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+    if(err){
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+        "%s: cannot set the CPU affinity of the poller of %s: %s\n", functionName, controllerName_, strerror(err));
+    }
+  }
+#else
+  if(pollerPolicy_ != pollerPolicyKeep || !pollerCpus_.empty()){
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+      "%s: scheduling policy and CPU affinity of the poller are only supported on Linux\n", functionName);
+  }
+#endif
+}
+
+/** Configures the adaptive timeouts
+  * \param[in] minTimeout  Lower bound in s, 0 disables the adaptive timeouts
+  * \param[in] retries     Retries of reads after a timeout
+  */
+void phytronController::setAdaptiveTimeout(double minTimeout, int retries)
+{
+  rtt_.configure(timeout_, minTimeout, retries);
+}
+
+/** Sets the number of telegrams per second the poller of this unit may send
+  * \param[in] telegramsPerSecond  Poll budget, 0 for no limit
+  */
+void phytronController::setPollBudget(double telegramsPerSecond)
+{
+  bus_->setBudget(busUnit_, telegramsPerSecond);
+}
+
+/** Returns a pointer to an phytronAxis object.
+  * Returns NULL if the axis number encoded in pasynUser is invalid.
+  * \param[in] pasynUser asynUser structure that encodes the axis index number.
+  */
+phytronAxis* phytronController::getAxis(asynUser *pasynUser)
+{
+  return dynamic_cast<phytronAxis*>(asynMotorController::getAxis(pasynUser));
+}
+
+/** Returns a pointer to an phytronAxis object.
+  * Returns NULL if the axis number encoded in pasynUser is invalid.
+  * \param[in] axisNo Axis index number.
+  */
+phytronAxis* phytronController::getAxis(int axisNo)
+{
+  return dynamic_cast<phytronAxis*>(asynMotorController::getAxis(axisNo));
+}
+
+/**
+ * @brief sends a command on the fast path connection used by poll, move and stop
+ * @param command
+ * @param response_buffer
+ * @param response_max_len
+ * @param nread
+ * @return
+ */
+phytronStatus phytronController::sendPhytronCommand(const char *command, char *response_buffer, size_t response_max_len, size_t *nread)
+{
+    phytronStatus status;
+
+    status = sendPhytronCommand(pasynUserController_, command, response_buffer, response_max_len, nread,
+                                pollActive_ ? linkPoll : linkCommand, &lastRequestTime_, &lastReplyTime_);
+
+    return status;
+}
+
+/**
+ * @brief sends a diagnostic or configuration command. If a slow path connection
+ * was configured, the command is sent on it with the controller unlocked, so
+ * the poller is not blocked while waiting for the reply. Without a slow path
+ * connection the command is sent on the fast path. The command waits unlocked
+ * while the link budget of diagnostic traffic is used up. Slow commands of all
+ * threads are serialised by slowMutex_. Must be called with the controller locked.
+ * @param command
+ * @param response_buffer  Must not be outString_/inString_ - these are used by the poller
+ * @param response_max_len
+ * @param nread
+ * @return
+ */
+phytronStatus phytronController::sendSlowPhytronCommand(const char *command, char *response_buffer, size_t response_max_len, size_t *nread)
+{
+    phytronStatus status;
+
+    //slowMutex_ is taken before the controller lock, never the other way round
+    unlock();
+    epicsMutexMustLock(slowMutex_);
+    bus_->throttle(linkDiagnostic);
+
+    if(!pasynUserSlow_){
+      //The poller's request and reply times are left alone, they date its samples
+      lock();
+      status = sendPhytronCommand(pasynUserController_, command, response_buffer, response_max_len, nread, linkDiagnostic);
+    } else {
+      status = sendPhytronCommand(pasynUserSlow_, command, response_buffer, response_max_len, nread, linkDiagnostic);
+      lock();
+    }
+    epicsMutexUnlock(slowMutex_);
+
+    return status;
+}
+
+/** Takes slowMutex_ for a sequence of slow commands, so the commands of other
+  * threads cannot come in between. Must be called with the controller locked,
+  * which is given up while waiting. Released with epicsMutexUnlock(slowMutex_).
+  */
+void phytronController::lockSlowPath()
+{
+  if(epicsMutexTryLock(slowMutex_) == epicsMutexLockOK) return;
+  unlock();
+  epicsMutexMustLock(slowMutex_);
+  lock();
+}
+
+/**
+ * @brief implements phytron specific data fromat
+ * @param pasynUser  Connection to the controller
+ * @param command
+ * @param response_buffer
+ * @param response_max_len
+ * @param nread
+ * @param linkClass  Traffic class the wire time is accounted to
+ * @param pSent      Optional, time the request of the last attempt was sent
+ * @param pReceived  Optional, time the reply of the last attempt was received
+ * @return
+ */
+phytronStatus phytronController::sendPhytronCommand(asynUser *pasynUser, const char *command, char *response_buffer, size_t response_max_len, size_t *nread,
+                                                    phytronLinkClass linkClass, epicsTimeStamp *pSent, epicsTimeStamp *pReceived)
+{
+    char buffer[255];
+    char reply[255];
+    char* buffer_end=buffer;
+    epicsTimeStamp sent, received;
+    phytronFramer *pFramer = (pasynUser == pasynUserSlow_) ? &slowFramer_ : &framer_;
+    //The slow path runs with the controller unlocked, so it keeps its error state apart from the poller's
+    phytronStatus *pLastStatus = (pasynUser == pasynUserSlow_) ? &lastSlowStatus_ : &lastStatus;
+    static const char *functionName = "phytronController::sendPhytronCommand";
+
+    *(buffer_end++)=0x02;                               //STX
+    *(buffer_end++)=busAddress_;                        //Address of the unit on the serial line
+    buffer_end += sprintf(buffer_end,"%s",command);     //Append command
+    *(buffer_end++)=0x3a;                               //Append separator
+
+    buffer_end += sprintf(buffer_end,"%c%c",'X','X');   //XX disables checksum
+    *(buffer_end++)=0x03;                               //Append ETX
+    *(buffer_end)=0x0;                                  //Null terminate message for saftey
+
+    //Reads are idempotent, so a lost reply is retried with a timeout derived from the measured round trips
+    phytronCommandClass commandClass = phytronRtt::classify(command);
+    int retries = rtt_.retries(commandClass);
+    //Replies carry no sequence number, a late reply to an earlier request is told apart by its values
+    int values;
+    phytronReplyShape shape = phytronExpectedReply(command, phytronRtt::isRead, &values);
+    //Round trips are timed without the wire time, which grows with the length of a batched reply
+    size_t expected = buffer_end - buffer + RTT_REPLY_OVERHEAD + (shape == replyEmpty ? 0 : values*RTT_VALUE_BYTES);
+    double wireTime = bus_->wireTime(expected);
+    phytronStatus status;
+    while(1){
+        epicsTimeGetCurrent(&sent);
+        status = (phytronStatus) pFramer->writeRead(buffer, buffer_end-buffer, reply, sizeof(reply),
+                                                    rtt_.timeout(commandClass, wireTime), nread, shape, values);
+        epicsTimeGetCurrent(&received);
+        telegramLog_->record(pasynUser == pasynUserSlow_, buffer, buffer_end-buffer, reply, status ? 0 : *nread,
+                             &sent, &received, status);
+        if(pasynUser != pasynUserSlow_) bus_->count(busUnit_, linkClass);
+        bus_->account(linkClass, buffer_end-buffer, status ? 0 : *nread);
+
+        if(status == phytronSuccess)
+            rtt_.sample(commandClass, epicsTimeDiffInSeconds(&received, &sent), bus_->wireTime(buffer_end - buffer + *nread));
+        if(status != phytronTimeout) break;
+        rtt_.timedOut(commandClass, retries > 0);
+        if(retries-- <= 0) break;
+    }
+    //The sample time is the midpoint of the attempt that got the reply, not of the lost ones before
+    if(pSent) *pSent = sent;
+    if(pReceived) *pReceived = received;
+    if(status){
+        return status;
+    }
+
+    char* nack_ack = strchr(reply,0x02); //Find STX
+    if(!nack_ack){
+        nread=0;
+        status = phytronInvalidReturn;
+        if (status != *pLastStatus) {
+          asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+          "%s: Communication failed\n",
+          functionName);
+        }
+        *pLastStatus = status;
+        return status;
+    }
+    *pLastStatus = phytronSuccess;
+    nack_ack++; //NACK/ACK is one
+    //ACK, extract response
+    if(*nack_ack==0x06){
+        char* separator = strchr(nack_ack,0x3a);          //find separator
+
+        /* Copy data from nack_ack to
+         * separator into buffer */
+        uint32_t len = separator-nack_ack-1;              //calculate length of message
+        if(len > response_max_len) len=response_max_len;
+
+        memcpy(response_buffer,nack_ack+1,len);           //copy payload to destination
+        response_buffer[separator-nack_ack-1]=0;          //Add NULL terminator
+
+        *nread=strlen(response_buffer);
+    }
+    //NAK return error
+    else if(*nack_ack==0x15){
+        nread=0;
+        status = phytronInvalidReturn;
+        if (status != *pLastStatus) {
+          asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+          "%s: Nack sent by the controller\n",
+          functionName);
+        }
+        *pLastStatus = status;
+        return status;
+    }
+    *pLastStatus = phytronSuccess;
+
+    return status;
+
+}
+
+/** Castst phytronStatus to asynStatus enumeration
+ * \param[in] phyStatus
+ */
+asynStatus phytronController::phyToAsyn(phytronStatus phyStatus){
+  if(phyStatus == phytronInvalidReturn || phyStatus == phytronInvalidCommand) return asynError;
+  return (asynStatus) phyStatus;
+}
+
+
+//******************************************************************************
+//                   PHYTRON AXIS IMPLEMENTATION
+//******************************************************************************
+
+/** Creates a new phytronAxis object.
+  * Configuration command, called directly or from iocsh
+  * \param[in] controllerName    Name of the asyn port created by calling phytronCreateController from st.cmd
+  * \param[in] module            Index of the I1AM01 module controlling this axis
+  * \param[in] axis              Axis index
+  * \param[in] encoderDivider    Read the encoder every n-th poll, -1 for axes without encoder, 0 or 1 on every poll
+  * \param[in] statusDivider     Read the status word every n-th poll while idle, 0 or 1 on every poll
+  */
+extern "C" int phytronCreateAxis(const char* controllerName, int module, int axis,
+                                 int encoderDivider, int statusDivider){
+
+  phytronAxis *pAxis;
+
+  //Find the controller
+  uint32_t i;
+  for(i = 0; i < controllers.size(); i++){
+    if(!strcmp(controllers[i]->controllerName_, controllerName)) {
+      if(!controllers[i]->hasAxis(module, axis)){
+        printf("WARNING: phytronCreateAxis: %s has no axis M%d.%d in its inventory\n", controllerName, module, axis);
+      }
+      //The poller is running, it walks pAxes_ and axes with the controller locked
+      controllers[i]->lock();
+      pAxis = new phytronAxis(controllers[i], module*10 + axis);
+      controllers[i]->axes.push_back(pAxis);
+      pAxis->setPollProfile(encoderDivider, statusDivider);
+      controllers[i]->unlock();
+      break;
+    }
+  }
+
+  //If controller is not found, report error
+  if(i == controllers.size()){
+    printf("ERROR: phytronCreateAxis: Controller %s is not registered\n", controllerName);
+    return asynError;
+  }
+
+  return asynSuccess;
+}
+
+/** Creates a new phytronAxis object.
+  * \param[in] pC Pointer to the phytronController to which this axis belongs.
+  * \param[in] axisNo Index number of this axis, range 0 to pC->numAxes_-1.
+  *
+  * Initializes register numbers, etc.
+  */
+phytronAxis::phytronAxis(phytronController *pC, int axisNo)
+  : asynMotorAxis(pC, axisNo),
+    axisModuleNo_((float)axisNo/10),
+    pC_(pC),
+    response_len(0),
+    profileMinVel_(MIN_VELOCITY),
+    profileMaxVel_(MIN_VELOCITY),
+    profileAccel_(MIN_ACCELERATION),
+    profileActive_(false),
+    profileOrigin_(0),
+    profileTarget_(0),
+    profileCorrection_(0),
+    profileCorrectedAt_(0),
+    completionPending_(false),
+    encoderDivider_(1),
+    statusDivider_(1),
+    pollCount_(0),
+    wasMoving_(true),
+    snapshotValid_(false),
+    healthValid_(false)
+{
+  psTempStats_.valid = false;
+  motorTempStats_.valid = false;
+  epicsTimeGetCurrent(&healthTime_);
+
+  //Controller always supports encoder. Encoder enable/disable is set through UEIP
+  setIntegerParam(pC_->motorStatusHasEncoder_, 1);
+
+  setDoubleParam(pC_->motorEncoderRatio_, 1);
+
+}
+
+
+/** Selects which quantities are read on each poll
+  * \param[in] encoderDivider  Read the encoder every n-th poll, -1 never (axis without encoder), 0 or 1 on every poll
+  * \param[in] statusDivider   Read the status word every n-th poll while idle, 0 or 1 on every poll.
+  *                            While moving, and on the first poll after a move, it is always read.
+  */
+void phytronAxis::setPollProfile(int encoderDivider, int statusDivider)
+{
+  encoderDivider_ = encoderDivider < 0 ? -1 : max(encoderDivider, 1);
+  statusDivider_ = max(statusDivider, 1);
+
+  setIntegerParam(pC_->motorStatusHasEncoder_, encoderDivider_ > 0);
+  pC_->setIntegerParam(axisNo_, pC_->pollEncoderDivider_, encoderDivider_);
+  pC_->setIntegerParam(axisNo_, pC_->pollStatusDivider_, statusDivider_);
+  callParamCallbacks();
+}
+
+/** Reports on status of the axis
+  * \param[in] fp The file pointer on which report information will be written
+  * \param[in] level The level of report detail desired
+  *
+  * After printing device-specific information calls asynMotorAxis::report()
+  */
+void phytronAxis::report(FILE *fp, int level)
+{
+  if (level > 0) {
+    fprintf(fp, "  axis %d, encoder poll divider=%d, status poll divider=%d\n",
+            axisNo_, encoderDivider_, statusDivider_);
+    if(psTempStats_.valid && motorTempStats_.valid){
+      fprintf(fp, "  power stage temperature=%.1f (%.1f..%.1f, %.2f/min), motor temperature=%.1f (%.1f..%.1f, %.2f/min)\n",
+              psTempStats_.last, psTempStats_.min, psTempStats_.max, psTempStats_.rate,
+              motorTempStats_.last, motorTempStats_.min, motorTempStats_.max, motorTempStats_.rate);
+    }
+  }
+
+  // Call the base class method
+  asynMotorAxis::report(fp, level);
+}
+
+/** Sets velocity parameters before the move is executed. Controller produces a
+ * trapezoidal speed profile defined by these parmeters.
+ * \param[in] minVelocity   Start velocity
+ * \param[in] maxVelocity   Maximum velocity
+ * \param[in] moveType      Type of movement determines which controller speed parameters are set
+ */
+phytronStatus phytronAxis::setVelocity(double minVelocity, double maxVelocity, int moveType)
+{
+
+  phytronStatus maxStatus = phytronSuccess;
+  phytronStatus minStatus = phytronSuccess;
+  maxVelocity = fabs(maxVelocity);
+  minVelocity = fabs(minVelocity);
+
+  if(maxVelocity > MAX_VELOCITY){
+    maxVelocity = MAX_VELOCITY;
+    asynPrint(pC_->pasynUserSelf, ASYN_TRACE_WARNING,
               "phytronAxis::setVelocity: Failed for axis %d - Velocity %f is to high, setting to"
               "maximum velocity: %d!\n", axisNo_, maxVelocity, MAX_VELOCITY);
   } else if (maxVelocity < MIN_VELOCITY){
@@ -672,6 +1937,9 @@ phytronStatus phytronAxis::setVelocity(double minVelocity, double maxVelocity, i
 
 
   if(moveType == stdMove){
+    profileMaxVel_ = maxVelocity;
+    profileMinVel_ = minVelocity;
+
     //Set maximum velocity (P14)
     sprintf(pC_->outString_, "M%.1fP14=%f", axisModuleNo_, maxVelocity);
     maxStatus = pC_->sendPhytronCommand(pC_->outString_, pC_->inString_, MAX_CONTROLLER_STRING_SIZE, &this->response_len);
@@ -711,6 +1979,7 @@ phytronStatus phytronAxis::setAcceleration(double acceleration, int moveType)
   }
 
   if (moveType == stdMove){
+    profileAccel_ = acceleration;
     sprintf(pC_->outString_, "M%.1fP15=%f", axisModuleNo_, acceleration);
   } else if(moveType == homeMove){
     sprintf(pC_->outString_, "M%.1fP09=%f", axisModuleNo_, acceleration);
@@ -758,6 +2027,7 @@ asynStatus phytronAxis::move(double position, int relative, double minVelocity,
   }
   lastStatus = phyStatus;
 
+  pC_->getDoubleParam(axisNo_, pC_->motorPosition_, &profileOrigin_);
   if (relative) {
     sprintf(pC_->outString_, "M%.1f%c%d", axisModuleNo_, position>0 ? '+':'-', abs(NINT(position)));
   } else {
@@ -775,6 +2045,14 @@ asynStatus phytronAxis::move(double position, int relative, double minVelocity,
   }
   lastStatus = phyStatus;
 
+  startProfile(relative ? profileOrigin_ + NINT(position) : NINT(position));
+
+  //asynMotorController wakes the poller after the move, profileTask polls again at its predicted end
+  profileEnd_ = profileStart_;
+  epicsTimeAddSeconds(&profileEnd_, profileDuration());
+  completionPending_ = true;
+  pC_->profileTask_->wake();
+
   return asynSuccess;
 }
 
@@ -789,6 +2067,8 @@ asynStatus phytronAxis::home(double minVelocity, double maxVelocity, double acce
   phytronStatus phyStatus;
   int           homingType;
 
+  profileActive_ = false;
+  completionPending_ = false;
   pC_->getIntegerParam(axisNo_, pC_->homingProcedure_, &homingType);
 
   phyStatus =  setVelocity(minVelocity, maxVelocity, homeMove);
@@ -854,6 +2134,9 @@ asynStatus phytronAxis::moveVelocity(double minVelocity, double maxVelocity, dou
 {
   phytronStatus phyStatus;
 
+  profileActive_ = false;
+  completionPending_ = false;
+
   phyStatus = setVelocity(minVelocity, maxVelocity, stdMove);
   if(phyStatus){
 
@@ -892,6 +2175,9 @@ asynStatus phytronAxis::stop(double acceleration)
 {
   phytronStatus phyStatus;
 
+  profileActive_ = false;
+  completionPending_ = false;
+
   phyStatus = setAcceleration(acceleration, stopMove);
 
   if(phyStatus){
@@ -918,6 +2204,106 @@ asynStatus phytronAxis::stop(double acceleration)
   return asynSuccess;
 }
 
+/** Starts the position model of a move from the last polled position to
+ * target, using the velocities and acceleration sent by setVelocity and
+ * setAcceleration.
+ * \param[in] target  Absolute target position
+ */
+void phytronAxis::startProfile(double target)
+{
+  epicsTimeGetCurrent(&profileStart_);
+  profileTarget_ = target;
+  profileCorrection_ = 0;
+  profileCorrectedAt_ = fabs(target - profileOrigin_);
+  profileActive_ = true;
+}
+
+/** Returns the duration of the modelled move in seconds. The controller ramps
+ * from the start velocity (P04) to the run velocity (P14) with the ramp P15
+ * and back down; short moves never reach the run velocity.
+ */
+double phytronAxis::profileDuration()
+{
+  double distance = fabs(profileTarget_ - profileOrigin_);
+  double v0 = min(profileMinVel_, profileMaxVel_);
+  double v1 = profileMaxVel_;
+  double rampTime = (v1 - v0)/profileAccel_;
+  double rampDistance = (v0 + v1)/2*rampTime;
+
+  if(2*rampDistance > distance){
+    v1 = sqrt(v0*v0 + profileAccel_*distance);
+    return 2*(v1 - v0)/profileAccel_;
+  }
+  return 2*rampTime + (distance - 2*rampDistance)/v1;
+}
+
+/** Returns the distance travelled by the modelled move after time seconds
+ * \param[in] time  Time since the move was started
+ */
+double phytronAxis::profileDistance(double time)
+{
+  double distance = fabs(profileTarget_ - profileOrigin_);
+  double v0 = min(profileMinVel_, profileMaxVel_);
+  double v1 = profileMaxVel_;
+  double rampTime = (v1 - v0)/profileAccel_;
+  double rampDistance = (v0 + v1)/2*rampTime;
+  double runTime;
+
+  if(2*rampDistance > distance){
+    v1 = sqrt(v0*v0 + profileAccel_*distance);
+    rampTime = (v1 - v0)/profileAccel_;
+    rampDistance = distance/2;
+  }
+  runTime = (distance - 2*rampDistance)/v1;
+
+  if(time <= 0) return 0;
+  if(time < rampTime) return v0*time + profileAccel_*time*time/2;
+  time -= rampTime;
+  if(time < runTime) return rampDistance + v1*time;
+  time -= runTime;
+  if(time < rampTime) return distance - rampDistance + v1*time - profileAccel_*time*time/2;
+  return distance;
+}
+
+/** Corrects the position model against a polled position. The offset between
+ * the measured and the modelled position fades out towards the target, so the
+ * estimate always ends at the commanded position.
+ * \param[in] position     Polled motor position
+ * \param[in] pSampleTime  Estimated time at which the controller sampled the position
+ */
+void phytronAxis::correctProfile(double position, epicsTimeStamp *pSampleTime)
+{
+  double travelled;
+  double sign = profileTarget_ >= profileOrigin_ ? 1 : -1;
+
+  if(!profileActive_) return;
+
+  travelled = profileDistance(epicsTimeDiffInSeconds(pSampleTime, &profileStart_));
+  profileCorrection_ = position - (profileOrigin_ + sign*travelled);
+  profileCorrectedAt_ = fabs(profileTarget_ - profileOrigin_) - travelled;
+}
+
+/** Extrapolates the position of a running move
+ * \param[in]  pTime     Time of the estimate
+ * \param[out] position  Estimated motor position
+ * \return false if no move is being modelled
+ */
+bool phytronAxis::estimatePosition(epicsTimeStamp *pTime, double *position)
+{
+  double travelled;
+  double remaining;
+  double sign = profileTarget_ >= profileOrigin_ ? 1 : -1;
+
+  if(!profileActive_) return false;
+
+  travelled = profileDistance(epicsTimeDiffInSeconds(pTime, &profileStart_));
+  remaining = fabs(profileTarget_ - profileOrigin_) - travelled;
+  *position = profileOrigin_ + sign*travelled;
+  if(profileCorrectedAt_ > 0) *position += profileCorrection_*remaining/profileCorrectedAt_;
+
+  return true;
+}
+
 //NOTE: Use this for step-slip check?
 asynStatus phytronAxis::setEncoderRatio(double ratio){
 
@@ -967,14 +2353,84 @@ asynStatus phytronAxis::setPosition(double position)
   return asynSuccess;
 }
 
-/** Polls the axis.
+/** Copies the state left in the parameter library by the poll to the shared memory segment */
+void phytronAxis::publishShm()
+{
+  static const struct {int phytronController::*reason; epicsUInt32 bit;} bits[] = {
+    {&phytronController::motorStatusDone_,      PHYTRON_SHM_DONE},
+    {&phytronController::motorStatusHighLimit_, PHYTRON_SHM_HIGH_LIMIT},
+    {&phytronController::motorStatusLowLimit_,  PHYTRON_SHM_LOW_LIMIT},
+    {&phytronController::motorStatusAtHome_,    PHYTRON_SHM_AT_HOME},
+    {&phytronController::motorStatusHomed_,     PHYTRON_SHM_HOMED},
+    {&phytronController::motorStatusSlip_,      PHYTRON_SHM_SLIP},
+    {&phytronController::motorStatusProblem_,   PHYTRON_SHM_PROBLEM}
+  };
+  phytronShmAxis state;
+  epicsTimeStamp sampleTime;
+  epicsInt32 value;
+
+  memset(&state, 0, sizeof(state));
+  state.axisNo = axisNo_;
+  pC_->getDoubleParam(axisNo_, pC_->motorPosition_, &state.position);
+  pC_->getDoubleParam(axisNo_, pC_->motorEncoderPosition_, &state.encoderPosition);
+  for(size_t i = 0; i < sizeof(bits)/sizeof(bits[0]); i++){
+    value = 0;
+    pC_->getIntegerParam(axisNo_, pC_->*bits[i].reason, &value);
+    if(value) state.status |= bits[i].bit;
+  }
+  if(!(state.status & PHYTRON_SHM_DONE)) state.status |= PHYTRON_SHM_MOVING;
+  value = 0;
+  pC_->getIntegerParam(axisNo_, pC_->axisStatus_, &value);
+  state.axisStatus = value;
+  state.polls = pollCount_;
+  pC_->getSampleTime(&sampleTime);
+  state.sampleTime.sec = sampleTime.secPastEpoch + POSIX_TIME_AT_EPICS_EPOCH;
+  state.sampleTime.nsec = sampleTime.nsec;
+
+  pC_->shm_->publish(&state);
+}
+
+/** Polls the axis unless the controller skips this poll cycle, and hands
+  * the serial line to the next unit after the last axis of the controller.
+  * \param[out] moving A flag that is set indicating that the axis is moving (true) or done (false).
+  */
+asynStatus phytronAxis::poll(bool *moving)
+{
+  asynStatus status;
+  int done;
+
+  if(pC_->pollSkipped_){
+    pC_->getIntegerParam(axisNo_, pC_->motorStatusDone_, &done);
+    *moving = !done;
+    status = asynSuccess;
+  } else {
+    epicsTimeGetCurrent(&sampleTime_);
+    pC_->pollActive_ = true;
+    status = pollAxis(moving);
+    pC_->pollActive_ = false;
+    if(this == pC_->lastPolledAxis_) pC_->bus_->endPoll(pC_->busUnit_);
+
+    //All values of the poll are published at once, stamped with the sample time of the position.
+    //The time stamp is shared by all axes of the port, so it is set right before.
+    pC_->setTimeStamp(&sampleTime_);
+    callParamCallbacks();
+    if(pC_->shm_) publishShm();
+  }
+
+  if(*moving) pC_->cycleMoving_ = true;
+  if(this == pC_->lastPolledAxis_) pC_->endPollCycle();
+
+  return status;
+}
+
+/** Reads the axis state from the controller.
   * This function reads the motor position, the limit status, the home status, the moving status,
   * and the drive power-on status.
   * It calls setIntegerParam() and setDoubleParam() for each item that it polls,
-  * and then calls callParamCallbacks() at the end.
+  * poll() then calls callParamCallbacks() once for all of them.
   * \param[out] moving A flag that is set indicating that the axis is moving (true) or done (false).
   */
-asynStatus phytronAxis::poll(bool *moving)
+asynStatus phytronAxis::pollAxis(bool *moving)
 {
   int axisStatus;
   double position;
@@ -982,12 +2438,13 @@ asynStatus phytronAxis::poll(bool *moving)
   double encoderRatio;
   phytronStatus phyStatus;
 
+  pollCount_++;
+
   // Read the current motor position
   sprintf(pC_->outString_, "M%.1fP20R", axisModuleNo_);
   phyStatus = pC_->sendPhytronCommand(pC_->outString_, pC_->inString_, MAX_CONTROLLER_STRING_SIZE, &this->response_len);
   if(phyStatus){
     setIntegerParam(pC_->motorStatusProblem_, 1);
-    callParamCallbacks();
     if (phyStatus != lastStatus) {
       asynPrint(pC_->pasynUserSelf, ASYN_TRACE_ERROR,
              "phytronAxis::poll: Reading axis position failed for axis: %d!\n", axisNo_);
@@ -998,37 +2455,41 @@ asynStatus phytronAxis::poll(bool *moving)
   lastStatus = phyStatus;
   position = atof(pC_->inString_);
   setDoubleParam(pC_->motorPosition_, position);
-
-  // Read the current encoder value
-  sprintf(pC_->outString_, "M%.1fP22R", axisModuleNo_);
-  phyStatus = pC_->sendPhytronCommand(pC_->outString_, pC_->inString_, MAX_CONTROLLER_STRING_SIZE, &this->response_len);
-  if(phyStatus){
-    setIntegerParam(pC_->motorStatusProblem_, 1);
-    callParamCallbacks();
-    if (phyStatus != lastStatus) {
-      asynPrint(pC_->pasynUserSelf, ASYN_TRACE_ERROR,
-             "phytronAxis::poll: Reading encoder value failed for axis: %d!\n", axisNo_);
-      lastStatus = phyStatus;
+  pC_->setDoubleParam(axisNo_, pC_->positionEstimate_, position);
+  pC_->setIntegerParam(axisNo_, pC_->positionEstimated_, 0);
+  pC_->getSampleTime(&sampleTime_);
+  correctProfile(position, &sampleTime_);
+
+  // Read the current encoder value, if it is due in this poll
+  if(encoderDivider_ > 0 && pollCount_ % encoderDivider_ == 0){
+    sprintf(pC_->outString_, "M%.1fP22R", axisModuleNo_);
+    phyStatus = pC_->sendPhytronCommand(pC_->outString_, pC_->inString_, MAX_CONTROLLER_STRING_SIZE, &this->response_len);
+    if(phyStatus){
+      setIntegerParam(pC_->motorStatusProblem_, 1);
+      if (phyStatus != lastStatus) {
+        asynPrint(pC_->pasynUserSelf, ASYN_TRACE_ERROR,
+               "phytronAxis::poll: Reading encoder value failed for axis: %d!\n", axisNo_);
+        lastStatus = phyStatus;
+      }
+      return pC_->phyToAsyn(phyStatus);
     }
-    return pC_->phyToAsyn(phyStatus);
+    lastStatus = phyStatus;
+    encoderPosition = atof(pC_->inString_);
+
+    /*
+     * The encoder position returned by the controller is weighted by the controller
+     * resolutio. To get absolute encoder position, the received position must be
+     * multiplied by the encoder resolution.
+     */
+    pC_->getDoubleParam(axisNo_, pC_->motorEncoderRatio_, &encoderRatio);
+    setDoubleParam(pC_->motorEncoderPosition_, encoderPosition*encoderRatio);
   }
-  lastStatus = phyStatus;
-  encoderPosition = atof(pC_->inString_);
-
-  /*
-   * The encoder position returned by the controller is weighted by the controller
-   * resolutio. To get absolute encoder position, the received position must be
-   * multiplied by the encoder resolution.
-   */
-  pC_->getDoubleParam(axisNo_, pC_->motorEncoderRatio_, &encoderRatio);
-  setDoubleParam(pC_->motorEncoderPosition_, encoderPosition*encoderRatio);
 
   // Read the moving status of this motor
   sprintf(pC_->outString_, "M%.1f==H", axisModuleNo_);
   phyStatus = pC_->sendPhytronCommand(pC_->outString_, pC_->inString_, MAX_CONTROLLER_STRING_SIZE, &this->response_len);
   if(phyStatus){
     setIntegerParam(pC_->motorStatusProblem_, 1);
-    callParamCallbacks();
     if (phyStatus != lastStatus) {
       asynPrint(pC_->pasynUserSelf, ASYN_TRACE_ERROR,
               "phytronAxis::poll: Reading axis moving status failed for axis: %d!\n", axisNo_);
@@ -1039,12 +2500,19 @@ asynStatus phytronAxis::poll(bool *moving)
   lastStatus = phyStatus;
   *moving = (pC_->inString_[0] == 'E') ? 0:1;
   setIntegerParam(pC_->motorStatusDone_, !*moving);
+  if(!*moving) profileActive_ = false;
+
+  // Limits matter while moving, so the status word is skipped only when idle
+  if(!*moving && !wasMoving_ && pollCount_ % statusDivider_ != 0){
+    setIntegerParam(pC_->motorStatusProblem_, 0);
+    return asynSuccess;
+  }
+  wasMoving_ = *moving;
 
   sprintf(pC_->outString_, "M%.1fSE", axisModuleNo_);
   phyStatus = pC_->sendPhytronCommand(pC_->outString_, pC_->inString_, MAX_CONTROLLER_STRING_SIZE, &this->response_len);
   if(phyStatus){
     setIntegerParam(pC_->motorStatusProblem_, 1);
-    callParamCallbacks();
     if (phyStatus != lastStatus) {
       asynPrint(pC_->pasynUserSelf, ASYN_TRACE_ERROR,
              "phytronAxis::poll: Reading axis status failed for axis: %d!\n", axisNo_);
@@ -1069,17 +2537,258 @@ asynStatus phytronAxis::poll(bool *moving)
   //No problem occurred
   setIntegerParam(pC_->motorStatusProblem_, 0);
 
-  callParamCallbacks();
   return asynSuccess;
 }
 
+/** Enables position estimates between polls.
+  * Configuration command, called directly or from iocsh
+  * \param[in] controllerName    Name of the asyn port created by calling phytronCreateController from st.cmd
+  * \param[in] period            Period in ms of the published estimates, 0 disables them
+  */
+extern "C" int phytronSetPositionEstimator(const char* controllerName, int period){
+
+  uint32_t i;
+  for(i = 0; i < controllers.size(); i++){
+    if(!strcmp(controllers[i]->controllerName_, controllerName)) {
+      controllers[i]->setEstimatorPeriod(period/1000.);
+      return asynSuccess;
+    }
+  }
+
+  printf("ERROR: phytronSetPositionEstimator: Controller %s is not registered\n", controllerName);
+  return asynError;
+}
+
+/** Configures batching of diagnostic reads and the diagnostic snapshot.
+  * Configuration command, called directly or from iocsh
+  * \param[in] controllerName    Name of the asyn port created by calling phytronCreateController from st.cmd
+  * \param[in] period            Period in s of the diagnostic snapshot, 0 disables it
+  * \param[in] batchSize         Maximum number of commands per telegram, 0 keeps the default, 1 disables batching
+  */
+extern "C" int phytronSetSnapshot(const char* controllerName, double period, int batchSize){
+
+  uint32_t i;
+  for(i = 0; i < controllers.size(); i++){
+    if(!strcmp(controllers[i]->controllerName_, controllerName)) {
+      if(batchSize > 0) controllers[i]->setBatchSize(batchSize);
+      controllers[i]->setSnapshotPeriod(period);
+      return asynSuccess;
+    }
+  }
+
+  printf("ERROR: phytronSetSnapshot: Controller %s is not registered\n", controllerName);
+  return asynError;
+}
+
+/** Configures the health monitor, which sweeps temperatures, power stage
+  * monitoring and controller status of all axes.
+  * Configuration command, called directly or from iocsh
+  * \param[in] controllerName    Name of the asyn port created by calling phytronCreateController from st.cmd
+  * \param[in] period            Sweep period in s, 0 disables the health monitor
+  */
+extern "C" int phytronSetHealthMonitor(const char* controllerName, double period){
+
+  uint32_t i;
+  for(i = 0; i < controllers.size(); i++){
+    if(!strcmp(controllers[i]->controllerName_, controllerName)) {
+      controllers[i]->setHealthPeriod(period);
+      return asynSuccess;
+    }
+  }
+
+  printf("ERROR: phytronSetHealthMonitor: Controller %s is not registered\n", controllerName);
+  return asynError;
+}
+
+/** Enables the timeouts derived from the measured round trip times, which are disabled by default.
+  * Configuration command, called directly or from iocsh
+  * \param[in] controllerName    Name of the asyn port created by calling phytronCreateController from st.cmd
+  * \param[in] minTimeout        Lower bound of the timeouts in ms, 0 to always wait for the timeout of phytronCreateController
+  * \param[in] retries           Retries of reads after a timeout
+  */
+extern "C" int phytronSetAdaptiveTimeout(const char* controllerName, double minTimeout, int retries){
+
+  uint32_t i;
+  for(i = 0; i < controllers.size(); i++){
+    if(!strcmp(controllers[i]->controllerName_, controllerName)) {
+      controllers[i]->setAdaptiveTimeout(minTimeout/1000, retries);
+      return asynSuccess;
+    }
+  }
+
+  printf("ERROR: phytronSetAdaptiveTimeout: Controller %s is not registered\n", controllerName);
+  return asynError;
+}
+
+/** Limits the telegrams per second the poller of a controller sends on its serial line.
+  * Poll cycles are skipped while the controller is over budget.
+  * Configuration command, called directly or from iocsh
+  * \param[in] controllerName      Name of the asyn port created by calling phytronCreateController from st.cmd
+  * \param[in] telegramsPerSecond  Poll budget, 0 for no limit
+  */
+extern "C" int phytronSetPollBudget(const char* controllerName, double telegramsPerSecond){
+
+  uint32_t i;
+  for(i = 0; i < controllers.size(); i++){
+    if(!strcmp(controllers[i]->controllerName_, controllerName)) {
+      controllers[i]->setPollBudget(telegramsPerSecond);
+      return asynSuccess;
+    }
+  }
+
+  printf("ERROR: phytronSetPollBudget: Controller %s is not registered\n", controllerName);
+  return asynError;
+}
+
+/** Configures priority, scheduling policy and CPU affinity of the poller thread of a controller.
+  * Configuration command, called directly or from iocsh
+  * \param[in] controllerName    Name of the asyn port created by calling phytronCreateController from st.cmd
+  * \param[in] priority          EPICS priority 0 to 99, -1 keeps the priority
+  * \param[in] policy            "FIFO" or "OTHER", empty keeps the policy; Linux only
+  * \param[in] cpus              Comma separated CPUs the poller may run on, empty keeps the affinity; Linux only
+  */
+extern "C" int phytronSetPollerThread(const char* controllerName, int priority, const char *policy, const char *cpus){
+
+  uint32_t i;
+  for(i = 0; i < controllers.size(); i++){
+    if(!strcmp(controllers[i]->controllerName_, controllerName)) {
+      if(controllers[i]->setPollerThread(priority, policy, cpus)){
+        printf("ERROR: phytronSetPollerThread: Invalid priority %d, policy '%s' or CPU list '%s'\n",
+               priority, policy ? policy : "", cpus ? cpus : "");
+        return asynError;
+      }
+      return asynSuccess;
+    }
+  }
+
+  printf("ERROR: phytronSetPollerThread: Controller %s is not registered\n", controllerName);
+  return asynError;
+}
+
+/** Publishes the polled state of the axes of a controller in a POSIX shared memory segment.
+  * Configuration command, called directly or from iocsh
+  * \param[in] controllerName    Name of the asyn port created by calling phytronCreateController from st.cmd
+  * \param[in] name              Name of the segment, empty for "/phytron_<controllerName>"
+  */
+extern "C" int phytronSetSharedMemory(const char* controllerName, const char *name){
+
+  uint32_t i;
+  for(i = 0; i < controllers.size(); i++){
+    if(!strcmp(controllers[i]->controllerName_, controllerName)) {
+      if(controllers[i]->setSharedMemory(name)){
+        printf("ERROR: phytronSetSharedMemory: Cannot publish controller %s in shared memory\n", controllerName);
+        return asynError;
+      }
+      return asynSuccess;
+    }
+  }
+
+  printf("ERROR: phytronSetSharedMemory: Controller %s is not registered\n", controllerName);
+  return asynError;
+}
+
+/** Applies a configuration file to the controller in batched telegrams
+  * Configuration command, called directly or from iocsh
+  * \param[in] controllerName    Name of the asyn port created by calling phytronCreateController from st.cmd
+  * \param[in] fileName          Commands separated by ';' or new lines, '#' starts a comment
+  */
+extern "C" int phytronApplyConfig(const char* controllerName, const char *fileName){
+
+  vector<string> commands;
+  uint32_t i;
+
+  for(i = 0; i < controllers.size(); i++){
+    if(!strcmp(controllers[i]->controllerName_, controllerName)) {
+      if(phytronReadConfigFile(fileName, commands)){
+        printf("ERROR: phytronApplyConfig: Cannot read %s\n", fileName);
+        return asynError;
+      }
+      return controllers[i]->applyConfig(commands);
+    }
+  }
+
+  printf("ERROR: phytronApplyConfig: Controller %s is not registered\n", controllerName);
+  return asynError;
+}
+
+/** Saves the axis parameters of all axes of the controller to a file
+  * Configuration command, called directly or from iocsh
+  * \param[in] controllerName    Name of the asyn port created by calling phytronCreateController from st.cmd
+  * \param[in] fileName          File to write
+  */
+extern "C" int phytronSaveParams(const char* controllerName, const char *fileName){
+
+  uint32_t i;
+  for(i = 0; i < controllers.size(); i++){
+    if(!strcmp(controllers[i]->controllerName_, controllerName)) {
+      return controllers[i]->saveParams(fileName);
+    }
+  }
+
+  printf("ERROR: phytronSaveParams: Controller %s is not registered\n", controllerName);
+  return asynError;
+}
+
+/** Restores axis parameters saved by phytronSaveParams, writing only the differences
+  * Configuration command, called directly or from iocsh
+  * \param[in] controllerName    Name of the asyn port created by calling phytronCreateController from st.cmd
+  * \param[in] fileName          File written by phytronSaveParams
+  */
+extern "C" int phytronRestoreParams(const char* controllerName, const char *fileName){
+
+  vector<string> commands;
+  uint32_t i;
+
+  for(i = 0; i < controllers.size(); i++){
+    if(!strcmp(controllers[i]->controllerName_, controllerName)) {
+      if(phytronReadConfigFile(fileName, commands)){
+        printf("ERROR: phytronRestoreParams: Cannot read %s\n", fileName);
+        return asynError;
+      }
+      return controllers[i]->restoreParams(commands);
+    }
+  }
+
+  printf("ERROR: phytronRestoreParams: Controller %s is not registered\n", controllerName);
+  return asynError;
+}
+
+/** Reads the module inventory of the controller and creates the axes and IO ports found
+  * Configuration command, called directly or from iocsh
+  * \param[in] controllerName    Name of the asyn port created by calling phytronCreateController from st.cmd
+  * \param[in] pattern           Glob pattern for module types or axis addresses (M1.1), "" for all
+  * \param[in] ioPrefix          Prefix of the IO port names, "" creates no IO ports
+  */
+extern "C" int phytronDiscover(const char* controllerName, const char *pattern, const char *ioPrefix){
+
+  asynStatus status;
+  uint32_t i;
+
+  for(i = 0; i < controllers.size(); i++){
+    if(!strcmp(controllers[i]->controllerName_, controllerName)) {
+      status = controllers[i]->discoverModules(false);
+      if(status) return status;
+      printf("%s: %d axes and IO ports created\n", controllerName,
+             controllers[i]->createFromInventory(pattern, ioPrefix));
+      return asynSuccess;
+    }
+  }
+
+  printf("ERROR: phytronDiscover: Controller %s is not registered\n", controllerName);
+  return asynError;
+}
+
 /** Parameters for iocsh phytron axis registration*/
 static const iocshArg phytronCreateAxisArg0 = {"Controller Name", iocshArgString};
 static const iocshArg phytronCreateAxisArg1 = {"Module index", iocshArgInt};
 static const iocshArg phytronCreateAxisArg2 = {"Axis index", iocshArgInt};
+static const iocshArg phytronCreateAxisArg3 = {"Encoder poll divider", iocshArgInt};
+static const iocshArg phytronCreateAxisArg4 = {"Status poll divider", iocshArgInt};
 static const iocshArg* const phytronCreateAxisArgs[] = {&phytronCreateAxisArg0,
                                                       &phytronCreateAxisArg1,
-                                                      &phytronCreateAxisArg2};
+                                                      &phytronCreateAxisArg2,
+                                                      &phytronCreateAxisArg3,
+                                                      &phytronCreateAxisArg4};
 
 /** Parameters for iocsh phytron controller registration */
 static const iocshArg phytronCreateControllerArg0 = {"Port name", iocshArgString};
@@ -1087,29 +2796,178 @@ static const iocshArg phytronCreateControllerArg1 = {"PhytronAxis port name", io
 static const iocshArg phytronCreateControllerArg2 = {"Moving poll period (ms)", iocshArgInt};
 static const iocshArg phytronCreateControllerArg3 = {"Idle poll period (ms)", iocshArgInt};
 static const iocshArg phytronCreateControllerArg4 = {"Idle poll period (ms)", iocshArgDouble};
+static const iocshArg phytronCreateControllerArg5 = {"Slow path port name", iocshArgString};
+static const iocshArg phytronCreateControllerArg6 = {"Bus address", iocshArgInt};
 static const iocshArg * const phytronCreateControllerArgs[] = {&phytronCreateControllerArg0,
                                                              &phytronCreateControllerArg1,
                                                              &phytronCreateControllerArg2,
                                                              &phytronCreateControllerArg3,
-                                                             &phytronCreateControllerArg4};
-
-static const iocshFuncDef phytronCreateAxisDef = {"phytronCreateAxis", 3, phytronCreateAxisArgs};
-static const iocshFuncDef phytronCreateControllerDef = {"phytronCreateController", 5, phytronCreateControllerArgs};
+                                                             &phytronCreateControllerArg4,
+                                                             &phytronCreateControllerArg5,
+                                                             &phytronCreateControllerArg6};
+
+/** Parameters for iocsh phytron position estimator */
+static const iocshArg phytronSetPositionEstimatorArg0 = {"Controller Name", iocshArgString};
+static const iocshArg phytronSetPositionEstimatorArg1 = {"Estimate period (ms)", iocshArgInt};
+static const iocshArg* const phytronSetPositionEstimatorArgs[] = {&phytronSetPositionEstimatorArg0,
+                                                                 &phytronSetPositionEstimatorArg1};
+
+/** Parameters for iocsh phytron diagnostic snapshot */
+static const iocshArg phytronSetSnapshotArg0 = {"Controller Name", iocshArgString};
+static const iocshArg phytronSetSnapshotArg1 = {"Snapshot period (s)", iocshArgDouble};
+static const iocshArg phytronSetSnapshotArg2 = {"Commands per telegram", iocshArgInt};
+static const iocshArg* const phytronSetSnapshotArgs[] = {&phytronSetSnapshotArg0,
+                                                        &phytronSetSnapshotArg1,
+                                                        &phytronSetSnapshotArg2};
+
+/** Parameters for iocsh phytron health monitor */
+static const iocshArg phytronSetHealthMonitorArg0 = {"Controller Name", iocshArgString};
+static const iocshArg phytronSetHealthMonitorArg1 = {"Sweep period (s)", iocshArgDouble};
+static const iocshArg* const phytronSetHealthMonitorArgs[] = {&phytronSetHealthMonitorArg0,
+                                                             &phytronSetHealthMonitorArg1};
+
+/** Parameters for iocsh phytron configuration file */
+static const iocshArg phytronApplyConfigArg0 = {"Controller Name", iocshArgString};
+static const iocshArg phytronApplyConfigArg1 = {"Configuration file", iocshArgString};
+static const iocshArg* const phytronApplyConfigArgs[] = {&phytronApplyConfigArg0,
+                                                        &phytronApplyConfigArg1};
+
+static const iocshFuncDef phytronCreateAxisDef = {"phytronCreateAxis", 5, phytronCreateAxisArgs};
+static const iocshFuncDef phytronCreateControllerDef = {"phytronCreateController", 7, phytronCreateControllerArgs};
+static const iocshFuncDef phytronSetPositionEstimatorDef = {"phytronSetPositionEstimator", 2, phytronSetPositionEstimatorArgs};
+static const iocshFuncDef phytronSetSnapshotDef = {"phytronSetSnapshot", 3, phytronSetSnapshotArgs};
+static const iocshFuncDef phytronSetHealthMonitorDef = {"phytronSetHealthMonitor", 2, phytronSetHealthMonitorArgs};
+
+/** Parameters for iocsh phytron poll budget */
+static const iocshArg phytronSetPollBudgetArg0 = {"Controller Name", iocshArgString};
+static const iocshArg phytronSetPollBudgetArg1 = {"Telegrams per second", iocshArgDouble};
+static const iocshArg* const phytronSetPollBudgetArgs[] = {&phytronSetPollBudgetArg0,
+                                                          &phytronSetPollBudgetArg1};
+
+static const iocshFuncDef phytronSetPollBudgetDef = {"phytronSetPollBudget", 2, phytronSetPollBudgetArgs};
+
+/** Parameters for iocsh phytron poller thread */
+static const iocshArg phytronSetPollerThreadArg0 = {"Controller Name", iocshArgString};
+static const iocshArg phytronSetPollerThreadArg1 = {"Priority", iocshArgInt};
+static const iocshArg phytronSetPollerThreadArg2 = {"Policy (FIFO, OTHER)", iocshArgString};
+static const iocshArg phytronSetPollerThreadArg3 = {"CPUs", iocshArgString};
+static const iocshArg* const phytronSetPollerThreadArgs[] = {&phytronSetPollerThreadArg0,
+                                                            &phytronSetPollerThreadArg1,
+                                                            &phytronSetPollerThreadArg2,
+                                                            &phytronSetPollerThreadArg3};
+
+static const iocshFuncDef phytronSetPollerThreadDef = {"phytronSetPollerThread", 4, phytronSetPollerThreadArgs};
+
+/** Parameters for iocsh phytron shared memory */
+static const iocshArg phytronSetSharedMemoryArg0 = {"Controller Name", iocshArgString};
+static const iocshArg phytronSetSharedMemoryArg1 = {"Segment name", iocshArgString};
+static const iocshArg* const phytronSetSharedMemoryArgs[] = {&phytronSetSharedMemoryArg0,
+                                                            &phytronSetSharedMemoryArg1};
+
+static const iocshFuncDef phytronSetSharedMemoryDef = {"phytronSetSharedMemory", 2, phytronSetSharedMemoryArgs};
+
+/** Parameters for iocsh phytron adaptive timeouts */
+static const iocshArg phytronSetAdaptiveTimeoutArg0 = {"Controller Name", iocshArgString};
+static const iocshArg phytronSetAdaptiveTimeoutArg1 = {"Minimum timeout (ms)", iocshArgDouble};
+static const iocshArg phytronSetAdaptiveTimeoutArg2 = {"Read retries", iocshArgInt};
+static const iocshArg* const phytronSetAdaptiveTimeoutArgs[] = {&phytronSetAdaptiveTimeoutArg0,
+                                                               &phytronSetAdaptiveTimeoutArg1,
+                                                               &phytronSetAdaptiveTimeoutArg2};
+
+static const iocshFuncDef phytronSetAdaptiveTimeoutDef = {"phytronSetAdaptiveTimeout", 3, phytronSetAdaptiveTimeoutArgs};
+static const iocshFuncDef phytronApplyConfigDef = {"phytronApplyConfig", 2, phytronApplyConfigArgs};
+static const iocshFuncDef phytronSaveParamsDef = {"phytronSaveParams", 2, phytronApplyConfigArgs};
+static const iocshFuncDef phytronRestoreParamsDef = {"phytronRestoreParams", 2, phytronApplyConfigArgs};
+
+static const iocshArg phytronDiscoverArg0 = {"Controller Name", iocshArgString};
+static const iocshArg phytronDiscoverArg1 = {"Module pattern", iocshArgString};
+static const iocshArg phytronDiscoverArg2 = {"IO port prefix", iocshArgString};
+static const iocshArg* const phytronDiscoverArgs[] = {&phytronDiscoverArg0,
+                                                      &phytronDiscoverArg1,
+                                                      &phytronDiscoverArg2};
+static const iocshFuncDef phytronDiscoverDef = {"phytronDiscover", 3, phytronDiscoverArgs};
 
 static void phytronCreateControllerCallFunc(const iocshArgBuf *args)
 {
-  phytronCreateController(args[0].sval, args[1].sval, args[2].ival, args[3].ival, args[4].dval);
+  phytronCreateController(args[0].sval, args[1].sval, args[2].ival, args[3].ival, args[4].dval, args[5].sval,
+                          args[6].ival);
 }
 
 static void phytronCreateAxisCallFunc(const iocshArgBuf *args)
 {
-  phytronCreateAxis(args[0].sval, args[1].ival, args[2].ival);
+  phytronCreateAxis(args[0].sval, args[1].ival, args[2].ival, args[3].ival, args[4].ival);
+}
+
+static void phytronSetPositionEstimatorCallFunc(const iocshArgBuf *args)
+{
+  phytronSetPositionEstimator(args[0].sval, args[1].ival);
+}
+
+static void phytronSetSnapshotCallFunc(const iocshArgBuf *args)
+{
+  phytronSetSnapshot(args[0].sval, args[1].dval, args[2].ival);
+}
+
+static void phytronSetHealthMonitorCallFunc(const iocshArgBuf *args)
+{
+  phytronSetHealthMonitor(args[0].sval, args[1].dval);
+}
+
+static void phytronApplyConfigCallFunc(const iocshArgBuf *args)
+{
+  phytronApplyConfig(args[0].sval, args[1].sval);
+}
+
+static void phytronSaveParamsCallFunc(const iocshArgBuf *args)
+{
+  phytronSaveParams(args[0].sval, args[1].sval);
+}
+
+static void phytronRestoreParamsCallFunc(const iocshArgBuf *args)
+{
+  phytronRestoreParams(args[0].sval, args[1].sval);
+}
+
+static void phytronDiscoverCallFunc(const iocshArgBuf *args)
+{
+  phytronDiscover(args[0].sval, args[1].sval, args[2].sval);
+}
+
+static void phytronSetPollBudgetCallFunc(const iocshArgBuf *args)
+{
+  phytronSetPollBudget(args[0].sval, args[1].dval);
+}
+
+static void phytronSetPollerThreadCallFunc(const iocshArgBuf *args)
+{
+  phytronSetPollerThread(args[0].sval, args[1].ival, args[2].sval, args[3].sval);
+}
+
+static void phytronSetSharedMemoryCallFunc(const iocshArgBuf *args)
+{
+  phytronSetSharedMemory(args[0].sval, args[1].sval);
+}
+
+static void phytronSetAdaptiveTimeoutCallFunc(const iocshArgBuf *args)
+{
+  phytronSetAdaptiveTimeout(args[0].sval, args[1].dval, args[2].ival);
 }
 
 static void phytronRegister(void)
 {
   iocshRegister(&phytronCreateControllerDef, phytronCreateControllerCallFunc);
   iocshRegister(&phytronCreateAxisDef, phytronCreateAxisCallFunc);
+  iocshRegister(&phytronSetPositionEstimatorDef, phytronSetPositionEstimatorCallFunc);
+  iocshRegister(&phytronSetSnapshotDef, phytronSetSnapshotCallFunc);
+  iocshRegister(&phytronSetHealthMonitorDef, phytronSetHealthMonitorCallFunc);
+  iocshRegister(&phytronSetPollBudgetDef, phytronSetPollBudgetCallFunc);
+  iocshRegister(&phytronSetPollerThreadDef, phytronSetPollerThreadCallFunc);
+  iocshRegister(&phytronSetSharedMemoryDef, phytronSetSharedMemoryCallFunc);
+  iocshRegister(&phytronSetAdaptiveTimeoutDef, phytronSetAdaptiveTimeoutCallFunc);
+  iocshRegister(&phytronApplyConfigDef, phytronApplyConfigCallFunc);
+  iocshRegister(&phytronSaveParamsDef, phytronSaveParamsCallFunc);
+  iocshRegister(&phytronRestoreParamsDef, phytronRestoreParamsCallFunc);
+  iocshRegister(&phytronDiscoverDef, phytronDiscoverCallFunc);
 }
 
 extern "C" {
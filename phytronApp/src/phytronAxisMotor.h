@@ -7,12 +7,25 @@ Cosylab d.d. 2014
 
 */
 
+#include <string>
+#include <vector>
+
+#include <epicsTime.h>
+#include <epicsEvent.h>
+
 #include "asynMotorController.h"
 #include "asynMotorAxis.h"
+#include "phytronTelegramLog.h"
+#include "phytronBus.h"
+#include "phytronFrame.h"
+#include "phytronRtt.h"
+#include "phytronInventory.h"
+#include "phytronPool.h"
+#include "phytronShm.h"
 
 
 //Number of controller specific parameters
-#define NUM_PHYTRON_PARAMS 29
+#define NUM_PHYTRON_PARAMS 44
 
 #define MAX_VELOCITY      40000 //steps/s
 #define MIN_VELOCITY      1     //steps/s
@@ -20,10 +33,25 @@ Cosylab d.d. 2014
 #define MAX_ACCELERATION  500000  // steps/s^2
 #define MIN_ACCELERATION  4000    // steps/s^2
 
+//Commands sent in one telegram by sendPhytronBatch
+#define DEFAULT_BATCH_SIZE 10
+//Consecutive batch replies that do not fit their commands before batching is disabled
+#define BATCH_MISMATCH_LIMIT 3
+#define MAX_BATCH_LENGTH   200     // characters, the telegram buffer is 255
+
+//Poll cycles the jitter percentiles are taken over
+#define POLL_JITTER_SAMPLES 1000
+#define POLL_JITTER_PUBLISH_PERIOD 1.0  // s between updates of the published jitter statistics
+#define MAX_POLLER_CPUS     1024
+
 //Controller parameters
 #define controllerStatusString      "CONTROLLER_STATUS"
 #define controllerStatusResetString "CONTROLLER_STATUS_RESET"
 #define resetControllerString       "CONTROLLER_RESET"
+#define pollJitterP50String         "POLL_JITTER_P50"
+#define pollJitterP99String         "POLL_JITTER_P99"
+#define pollJitterMaxString         "POLL_JITTER_MAX"
+#define pollJitterResetString       "POLL_JITTER_RESET"
 
 //Axis parameters
 #define axisStatusString            "AXIS_STATUS"
@@ -52,6 +80,17 @@ Cosylab d.d. 2014
 #define currentDelayTimeString      "CURRENT_DELAY_TIME"
 #define axisResetString             "AXIS_RESET"
 #define axisStatusResetString       "AXIS_STATUS_RESET"
+#define positionEstimateString      "POSITION_ESTIMATE"
+#define positionEstimatedString     "POSITION_ESTIMATED"
+#define pollEncoderDividerString    "POLL_ENC_DIV"
+#define pollStatusDividerString     "POLL_STATUS_DIV"
+#define powerStageTempMinString     "PS_TEMPERATURE_MIN"
+#define powerStageTempMaxString     "PS_TEMPERATURE_MAX"
+#define powerStageTempRateString    "PS_TEMPERATURE_RATE"
+#define motorTempMinString          "MOTOR_TEMP_MIN"
+#define motorTempMaxString          "MOTOR_TEMP_MAX"
+#define motorTempRateString         "MOTOR_TEMP_RATE"
+#define healthResetString           "HEALTH_RESET"
 
 typedef enum {
   phytronSuccess,
@@ -64,6 +103,43 @@ typedef enum {
   phytronInvalidCommand
 } phytronStatus;
 
+//Scheduling policy of the poller thread
+typedef enum {
+  pollerPolicyKeep,   //As created by asynMotorController
+  pollerPolicyOther,  //SCHED_OTHER
+  pollerPolicyFifo    //SCHED_FIFO, Linux only
+} phytronPollerPolicy;
+
+class phytronController;
+
+/* Which thread keeps a controller parameter current */
+enum phytronPollClass{
+  pollOnDemand, //Read when a record is processed
+  pollSnapshot, //Refreshed by the diagnostic snapshot
+  pollHealth    //Refreshed by the health monitor
+};
+
+/* Axis parameter mapped to the controller parameter P<pNumber> of the axis */
+typedef struct {
+  const char             *name;
+  int phytronController::*reason;
+  int                    pNumber;   //Read with M<m.a>P<pNumber>R, written with M<m.a>P<pNumber>=
+  asynParamType          type;
+  double                 scale;     //Parameter value is the controller value multiplied by scale
+  bool                   readOnly;
+  bool                   cacheable; //Served from the parameter library while its poll class is current
+  phytronPollClass       pollClass;
+} phytronParamDesc;
+
+/* Temperature statistics kept by the health monitor */
+typedef struct {
+  double last;
+  double min;
+  double max;
+  double rate;  //Change in °C/min between the last two sweeps
+  bool   valid; //last holds a value read from the controller
+} phytronTemperature;
+
 enum movementType{
   stdMove,
   homeMove,
@@ -92,11 +168,14 @@ public:
   asynStatus home(double min_velocity, double max_velocity, double acceleration, int forwards);
   asynStatus stop(double acceleration);
   asynStatus poll(bool *moving);
+  asynStatus pollAxis(bool *moving);
   asynStatus setPosition(double position);
 
   asynStatus setEncoderRatio(double ratio);
   asynStatus setEncoderPosition(double position);
 
+  void setPollProfile(int encoderDivider, int statusDivider);
+
   float axisModuleNo_; //Used by sprintf to form commands
 
 private:
@@ -105,31 +184,97 @@ private:
 
   phytronStatus setVelocity(double minVelocity, double maxVelocity, int moveType);
   phytronStatus setAcceleration(double acceleration, int movementType);
+  void publishShm();
+
+  void   startProfile(double target);
+  double profileDuration();
+  double profileDistance(double time);
+  void   correctProfile(double position, epicsTimeStamp *pSampleTime);
+  bool   estimatePosition(epicsTimeStamp *pTime, double *position);
 
   phytronStatus lastStatus;
   size_t response_len;
 
+  //Trapezoidal profile of the last move (P04, P14, P15), used to extrapolate the position between polls
+  double profileMinVel_;
+  double profileMaxVel_;
+  double profileAccel_;
+  bool   profileActive_;
+  epicsTimeStamp profileStart_;
+  double profileOrigin_;
+  double profileTarget_;
+  double profileCorrection_;  //Measured minus modelled position at the last poll
+  double profileCorrectedAt_; //Distance remaining when the correction was taken
+  epicsTimeStamp profileEnd_; //Predicted completion of the move
+  bool   completionPending_;  //An extra poll is scheduled at profileEnd_
+
+  //Poll profile: the encoder (P22) is read every encoderDivider_ polls, never if -1. The
+  //status word (SE) is read every statusDivider_ polls while idle and on every poll while moving
+  int  encoderDivider_;
+  int  statusDivider_;
+  int  pollCount_;
+  bool wasMoving_;
+  epicsTimeStamp sampleTime_;   //Estimated time the controller sampled the position of the last poll
+
+  bool snapshotValid_; //Diagnostic parameters in the parameter library are current
+
+  //Health monitor
+  phytronTemperature psTempStats_;
+  phytronTemperature motorTempStats_;
+  epicsTimeStamp healthTime_; //Time of the last successful sweep
+  bool healthValid_;          //Temperatures and P53 in the parameter library are current
+
 friend class phytronController;
 };
 
 class phytronController : public asynMotorController {
 public:
-  phytronController(const char *portName, const char *phytronPortName, double movingPollPeriod, double idlePollPeriod, double timeout);
+  phytronController(const char *portName, const char *phytronPortName, double movingPollPeriod, double idlePollPeriod, double timeout,
+                    const char *slowAsynPortName = NULL, int busAddress = 0);
   asynStatus readInt32(asynUser *pasynUser, epicsInt32 *value);
   asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
   asynStatus readFloat64(asynUser *pasynUser, epicsFloat64 *value);
 
   void report(FILE *fp, int level);
+  asynStatus poll();
+  void setPollBudget(double telegramsPerSecond);
+  void setAdaptiveTimeout(double minTimeout, int retries);
+  asynStatus setPollerThread(int priority, const char *policy, const char *cpus);
+  asynStatus setSharedMemory(const char *name);
   phytronAxis* getAxis(asynUser *pasynUser);
   phytronAxis* getAxis(int axisNo);
 
   phytronStatus sendPhytronCommand(const char *command, char *response_buffer, size_t response_max_len, size_t *nread);
+  phytronStatus sendSlowPhytronCommand(const char *command, char *response_buffer, size_t response_max_len, size_t *nread);
+  void lockSlowPath();
 
   void resetAxisEncoderRatio();
+  void getSampleTime(epicsTimeStamp *pSampleTime);
 
   //casts phytronStatus to asynStatus
   asynStatus    phyToAsyn(phytronStatus phyStatus);
 
+  void setEstimatorPeriod(double period);
+  double profileTask();
+
+  phytronStatus sendPhytronBatch(const std::vector<std::string> &commands, std::vector<std::string> &replies,
+                                 std::vector<phytronStatus> &statuses, bool slow, bool writes = false,
+                                 int *telegrams = NULL);
+  asynStatus applyConfig(const std::vector<std::string> &commands);
+  asynStatus saveParams(const char *fileName);
+  asynStatus restoreParams(const std::vector<std::string> &commands);
+  asynStatus discoverModules(bool refresh);
+  int createFromInventory(const char *pattern, const char *ioPrefix);
+  bool hasAxis(int module, int axis);
+  void setBatchSize(int batchSize);
+  void setSnapshotPeriod(double period);
+  asynStatus readSnapshot(phytronAxis *pAxis);
+  double snapshotTask();
+
+  void setHealthPeriod(double period);
+  asynStatus readHealth(uint32_t first, uint32_t last);
+  double healthTask();
+
   char * controllerName_;
   std::vector<phytronAxis*> axes;
 
@@ -164,10 +309,104 @@ protected:
   int axisReset_;
   int axisStatusReset_;
   int controllerStatusReset_;
+  int positionEstimate_;
+  int positionEstimated_;
+  int pollEncoderDivider_;
+  int pollStatusDivider_;
+  int powerStageTempMin_;
+  int powerStageTempMax_;
+  int powerStageTempRate_;
+  int motorTempMin_;
+  int motorTempMax_;
+  int motorTempRate_;
+  int healthReset_;
+  int pollJitterP50_;
+  int pollJitterP99_;
+  int pollJitterMax_;
+  int pollJitterReset_;
 
 private:
-  double timeout_;
+  phytronStatus sendPhytronCommand(asynUser *pasynUser, const char *command, char *response_buffer, size_t response_max_len, size_t *nread,
+                                   phytronLinkClass linkClass, epicsTimeStamp *pSent = NULL, epicsTimeStamp *pReceived = NULL);
+
+  double timeout_;                 //Static timeout, used for CR and until round trips were measured
+  phytronRtt rtt_;
   phytronStatus lastStatus;
+  phytronStatus lastSlowStatus_;  //Error reported last on the slow path, guarded by slowMutex_
+  epicsMutexId slowMutex_;         //Serialises the slow path, taken before the controller lock
+  asynUser *pasynUserSlow_;        //Optional second connection for diagnostics and configuration
+  phytronFramer framer_;           //Exchanges on the fast path
+  phytronFramer slowFramer_;       //Exchanges on the slow path
+  phytronTelegramLog *telegramLog_; //Telegrams of both connections, channel 1 is the slow path
+
+  char *asynPortName_;             //Fast path port, IO ports created from the inventory use it too
+  char busAddress_;                //Address character of the unit on the serial line
+  phytronBus *bus_;                //Poll arbitration with the other units on the fast path port
+  int busUnit_;
+  bool pollSkipped_;               //This poll cycle is skipped, the unit is over its poll budget
+  phytronAxis *lastPolledAxis_;    //Hands the serial line on after its poll
+  bool pollActive_;                //Fast path telegrams are accounted as polls, not commands
+
+  //The poller thread is created by asynMotorController, it applies its configuration itself at the start of a cycle
+  int pollerPriority_;             //EPICS priority, -1 keeps the priority
+  phytronPollerPolicy pollerPolicy_;
+  std::vector<int> pollerCpus_;    //CPUs the poller may run on, empty keeps the affinity
+  bool pollerConfigPending_;
+  void applyPollerConfig();
+
+  //Poll jitter: start of a cycle after the end of the last one, less the poll period the poller waited for
+  epicsTimeStamp cycleEnd_;
+  double cyclePeriod_;             //Moving or idle poll period after the last cycle
+  bool cycleEndValid_;
+  bool cycleMoving_;               //An axis was moving in this cycle
+  double jitter_[POLL_JITTER_SAMPLES]; //Ring of the last cycles, s
+  std::vector<double> jitterSorted_;
+  unsigned long jitterSamples_;
+  double jitterMax_;
+  epicsTimeStamp jitterPublished_; //Time the statistics were last published
+  unsigned long earlyPolls_;       //Cycles started early by wakeupPoller, not sampled
+  void endPollCycle();
+  void sampleJitter(double jitter, epicsTimeStamp *pNow);
+  void publishJitter();
+  void resetJitter();
+
+  phytronShm *shm_;                //Axis state published after every poll, NULL if not configured
+
+  std::vector<phytronModule> inventory_; //Module of each slot, read by discoverModules
+  bool inventoryValid_;
+
+  epicsTimeStamp lastRequestTime_; //Time the last command was handed to the port
+  epicsTimeStamp lastReplyTime_;   //Time the reply to the last command was received
+
+  double estimatorPeriod_;         //Period of position estimates between polls, 0 disables them
+  phytronTask *profileTask_;       //Predicted completions and position estimates
+
+  int batchSize_;                  //Maximum number of commands per telegram, 1 disables batching
+  int batchMismatches_;            //Consecutive batch replies that did not fit their commands
+  unsigned long batchFallbacks_;   //Batches sent one by one as the reply did not fit
+  void batchMismatch(int values, int commands);
+  double snapshotPeriod_;          //Period of the diagnostic snapshot, 0 disables it
+  phytronTask *snapshotTask_;
+  epicsTimeStamp snapshotStart_;   //Start of the current snapshot sweep
+  uint32_t snapshotNext_;          //Next axis of the sweep
+
+  static const phytronParamDesc paramTable_[];
+  static const int paramTableSize_;
+  std::vector<const phytronParamDesc*> paramByReason_; //Descriptor of each reason, NULL if not in paramTable_
+  const phytronParamDesc* findParam(int reason);
+  bool isCached(phytronAxis *pAxis, const phytronParamDesc *pDesc);
+  void setParamFromReply(phytronAxis *pAxis, const phytronParamDesc *pDesc, const char *reply);
+
+  double healthPeriod_;            //Period of the health monitor sweep, 0 disables it
+  phytronTask *healthTask_;
+  epicsTimeStamp healthStart_;     //Start of the current health sweep
+  uint32_t healthNext_;            //Next axis of the sweep
+  double nextSweepStep(double period, epicsTimeStamp *pStart, uint32_t *pNext);
+  double endSweepStep(double period, epicsTimeStamp *pStart, uint32_t *pNext);
+  bool statusValid_;               //Controller status (ST) in the parameter library is current
+  void updateTemperature(phytronAxis *pAxis, phytronTemperature *pTemp, double value, double dt,
+                         int valueReason, int minReason, int maxReason, int rateReason);
+  void resetTemperature(phytronTemperature *pTemp);
 
 friend class phytronAxis;
 };
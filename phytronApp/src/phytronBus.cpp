@@ -0,0 +1,482 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <epicsThread.h>
+#include <iocsh.h>
+#include <cantProceed.h>
+#include <epicsExport.h>
+#include "phytronBus.h"
+
+/* All serial lines, one per asyn port */
+static std::vector<phytronBus*> buses;
+
+/* Names of the traffic classes, used by phytronSetLinkShare and the report */
+static const char *linkClassNames[LINK_CLASSES] = {"poll", "command", "io", "diagnostic"};
+static const double linkDefaultShares[LINK_CLASSES] = {0.5, 0.2, 0.15, 0.15};
+
+phytronBus::phytronBus(const char *asynPortName)
+  : owner_(-1)
+{
+  name_ = (char *) mallocMustSucceed(strlen(asynPortName)+1,
+      "phytronBus::phytronBus: Name memory allocation failed.\n");
+  strcpy(name_, asynPortName);
+  mutex_ = epicsMutexMustCreate();
+  epicsTimeGetCurrent(&reportTime_);
+
+  baud_ = 0;
+  window_ = LINK_DEFAULT_WINDOW;
+  windowStart_ = reportTime_;
+  peak_ = 0;
+  memset(usage_, 0, sizeof(usage_));
+  for(int i = 0; i < LINK_CLASSES; i++) usage_[i].share = linkDefaultShares[i];
+}
+
+/** Returns the bus of an asyn port, NULL if no unit uses the port
+  * \param[in] asynPortName  Name of the asyn port of the serial line
+  */
+phytronBus *phytronBus::find(const char *asynPortName)
+{
+  for(size_t i = 0; i < buses.size(); i++){
+    if(!strcmp(buses[i]->name_, asynPortName)) return buses[i];
+  }
+  return NULL;
+}
+
+/** Returns the bus of an asyn port, which is created for the first unit using it
+  * \param[in] asynPortName  Name of the asyn port of the serial line
+  */
+phytronBus *phytronBus::attach(const char *asynPortName)
+{
+  phytronBus *pBus = find(asynPortName);
+
+  if(!pBus){
+    pBus = new phytronBus(asynPortName);
+    buses.push_back(pBus);
+  }
+  return pBus;
+}
+
+/** Adds a unit to the bus
+  * \param[in] name     Name of the unit, printed by report()
+  * \param[in] address  Bus address of the unit, 0..MAX_BUS_ADDRESS
+  * \param[in] polling  The unit has a poller which calls beginPoll() and endPoll()
+  * \return Index of the unit, used by the other methods
+  */
+int phytronBus::addUnit(const char *name, int address, bool polling)
+{
+  phytronBusUnit unit;
+
+  epicsMutexMustLock(mutex_);
+  for(size_t i = 0; i < units_.size(); i++){
+    if(units_[i].address == address){
+      printf("WARNING: phytronBus: %s and %s both use address %X on %s\n",
+             units_[i].name, name, address, name_);
+    }
+  }
+
+  memset(&unit, 0, sizeof(unit));
+  unit.name = (char *) mallocMustSucceed(strlen(name)+1,
+      "phytronBus::addUnit: Name memory allocation failed.\n");
+  strcpy(unit.name, name);
+  unit.address = address;
+  unit.polling = polling;
+  unit.turn = epicsEventMustCreate(epicsEventEmpty);
+  epicsTimeGetCurrent(&unit.refill);
+
+  units_.push_back(unit);
+  reportTelegrams_.push_back(0);
+  epicsMutexUnlock(mutex_);
+
+  return (int) units_.size() - 1;
+}
+
+/** Sets the poll budget of a unit
+  * \param[in] unit                Index returned by addUnit()
+  * \param[in] telegramsPerSecond  Telegrams the unit may send per second, 0 for no limit
+  */
+void phytronBus::setBudget(int unit, double telegramsPerSecond)
+{
+  epicsMutexMustLock(mutex_);
+  units_[unit].budget = telegramsPerSecond > 0 ? telegramsPerSecond : 0;
+  units_[unit].tokens = units_[unit].budget;
+  epicsTimeGetCurrent(&units_[unit].refill);
+  epicsMutexUnlock(mutex_);
+}
+
+/** Waits until the unit may poll. Must be followed by endPoll() if it returns true.
+  * \param[in] unit  Index returned by addUnit()
+  * \return false if the unit is over budget and should skip this poll cycle
+  */
+bool phytronBus::beginPoll(int unit)
+{
+  epicsTimeStamp start, now;
+  double wait;
+  bool granted;
+
+  epicsMutexMustLock(mutex_);
+  epicsTimeGetCurrent(&start);
+  if(units_[unit].budget > 0){
+    units_[unit].tokens += units_[unit].budget*epicsTimeDiffInSeconds(&start, &units_[unit].refill);
+    if(units_[unit].tokens > units_[unit].budget) units_[unit].tokens = units_[unit].budget;
+  }
+  units_[unit].refill = start;
+
+  if(units_[unit].budget > 0 && units_[unit].tokens <= 0){
+    units_[unit].skipped++;
+    epicsMutexUnlock(mutex_);
+    return false;
+  }
+  units_[unit].polls++;
+
+  if(owner_ < 0){
+    owner_ = unit;
+    epicsMutexUnlock(mutex_);
+    return true;
+  }
+
+  waiting_.push_back(unit);
+  epicsMutexUnlock(mutex_);
+
+  granted = epicsEventWaitWithTimeout(units_[unit].turn, BUS_TURN_TIMEOUT) == epicsEventWaitOK;
+
+  epicsMutexMustLock(mutex_);
+  if(!granted){
+    std::deque<int>::iterator it = std::find(waiting_.begin(), waiting_.end(), unit);
+    if(it != waiting_.end()){
+      //Poll without a turn rather than stall behind a unit that does not finish
+      waiting_.erase(it);
+      units_[unit].timeouts++;
+    } else {
+      //Granted between the timeout and the lock
+      epicsEventTryWait(units_[unit].turn);
+    }
+  }
+  epicsTimeGetCurrent(&now);
+  wait = epicsTimeDiffInSeconds(&now, &start);
+  units_[unit].waitSum += wait;
+  if(wait > units_[unit].waitMax) units_[unit].waitMax = wait;
+  epicsMutexUnlock(mutex_);
+
+  return true;
+}
+
+/** Ends the poll cycle of a unit and hands the line to the next waiting unit
+  * \param[in] unit  Index returned by addUnit()
+  */
+void phytronBus::endPoll(int unit)
+{
+  epicsMutexMustLock(mutex_);
+  if(owner_ == unit){
+    if(waiting_.empty()){
+      owner_ = -1;
+    } else {
+      owner_ = waiting_.front();
+      waiting_.pop_front();
+      epicsEventSignal(units_[owner_].turn);
+    }
+  }
+  epicsMutexUnlock(mutex_);
+}
+
+/** Accounts telegrams sent by a unit, only polls use up its poll budget
+  * \param[in] unit       Index returned by addUnit()
+  * \param[in] linkClass  Traffic class of the telegrams
+  * \param[in] telegrams  Number of telegrams
+  */
+void phytronBus::count(int unit, phytronLinkClass linkClass, int telegrams)
+{
+  epicsMutexMustLock(mutex_);
+  units_[unit].telegrams += telegrams;
+  if(linkClass == linkPoll && units_[unit].budget > 0) units_[unit].tokens -= telegrams;
+  epicsMutexUnlock(mutex_);
+}
+
+/** Sets the link parameters the wire time is estimated from
+  * \param[in] baud    Baud rate of the serial line, 0 disables throttling
+  * \param[in] window  Period the shares of the traffic classes refer to in s
+  */
+void phytronBus::setLink(double baud, double window)
+{
+  epicsMutexMustLock(mutex_);
+  baud_ = baud > 0 ? baud : 0;
+  window_ = window > 0 ? window : LINK_DEFAULT_WINDOW;
+  epicsTimeGetCurrent(&windowStart_);
+  for(int i = 0; i < LINK_CLASSES; i++) usage_[i].used = 0;
+  epicsMutexUnlock(mutex_);
+}
+
+/** Sets the part of the window a traffic class may use
+  * \param[in] className  poll, command, io or diagnostic
+  * \param[in] share      0..1
+  * \return 0, -1 if the class is unknown
+  */
+int phytronBus::setShare(const char *className, double share)
+{
+  for(int i = 0; i < LINK_CLASSES; i++){
+    if(strcmp(linkClassNames[i], className)) continue;
+    epicsMutexMustLock(mutex_);
+    usage_[i].share = share < 0 ? 0 : (share > 1 ? 1 : share);
+    epicsMutexUnlock(mutex_);
+    return 0;
+  }
+  return -1;
+}
+
+/* Starts a new window if the current one has passed. Must be called with mutex_ locked. */
+void phytronBus::rollWindow(epicsTimeStamp *pNow)
+{
+  double utilization = 0;
+
+  if(epicsTimeDiffInSeconds(pNow, &windowStart_) < window_) return;
+
+  for(int i = 0; i < LINK_CLASSES; i++){
+    if(usage_[i].used > usage_[i].share*window_) usage_[i].overruns++;
+    utilization += usage_[i].used;
+    usage_[i].used = 0;
+  }
+  utilization /= window_;
+  if(utilization > peak_) peak_ = utilization;
+  windowStart_ = *pNow;
+}
+
+/** Waits until a telegram of the traffic class fits into the link budget.
+  * Poll and command telegrams are never delayed. Must not be called with a
+  * lock held that the poller needs.
+  * \param[in] linkClass  Traffic class of the telegram
+  */
+void phytronBus::throttle(phytronLinkClass linkClass)
+{
+  epicsTimeStamp now;
+  double used, wait;
+  bool throttled = false;
+
+  if(linkClass == linkPoll || linkClass == linkCommand) return;
+
+  while(1){
+    epicsMutexMustLock(mutex_);
+    if(baud_ <= 0){
+      epicsMutexUnlock(mutex_);
+      return;
+    }
+    epicsTimeGetCurrent(&now);
+    rollWindow(&now);
+
+    used = 0;
+    for(int i = 0; i < LINK_CLASSES; i++) used += usage_[i].used;
+    if(usage_[linkClass].used < usage_[linkClass].share*window_ &&
+       usage_[linkPoll].used < usage_[linkPoll].share*window_ && used < window_){
+      epicsMutexUnlock(mutex_);
+      return;
+    }
+
+    if(!throttled) usage_[linkClass].throttled++;
+    throttled = true;
+    wait = window_ - epicsTimeDiffInSeconds(&now, &windowStart_);
+    epicsMutexUnlock(mutex_);
+
+    epicsThreadSleep(wait > 0 ? wait : 0);
+  }
+}
+
+/** Accounts the wire time of a telegram to its traffic class
+  * \param[in] linkClass  Traffic class of the telegram
+  * \param[in] txBytes    Bytes of the request
+  * \param[in] rxBytes    Bytes of the reply
+  */
+void phytronBus::account(phytronLinkClass linkClass, size_t txBytes, size_t rxBytes)
+{
+  epicsTimeStamp now;
+  double wireTime;
+
+  epicsMutexMustLock(mutex_);
+  epicsTimeGetCurrent(&now);
+  rollWindow(&now);
+
+  wireTime = baud_ > 0 ? (txBytes + rxBytes)*LINK_BITS_PER_CHAR/baud_ : 0;
+  usage_[linkClass].used += wireTime;
+  usage_[linkClass].total += wireTime;
+  usage_[linkClass].bytes += txBytes + rxBytes;
+  usage_[linkClass].telegrams++;
+  epicsMutexUnlock(mutex_);
+}
+
+/** Returns the time in s the given number of bytes take on the line, 0 if the baud rate is not set
+  * \param[in] bytes  Bytes of a request and its reply
+  */
+double phytronBus::wireTime(size_t bytes)
+{
+  double wireTime;
+
+  epicsMutexMustLock(mutex_);
+  wireTime = baud_ > 0 ? bytes*LINK_BITS_PER_CHAR/baud_ : 0;
+  epicsMutexUnlock(mutex_);
+  return wireTime;
+}
+
+/** Prints the units of the bus with their telegram rates since the last report
+  * \param[in] fp  Output
+  */
+void phytronBus::report(FILE *fp)
+{
+  epicsTimeStamp now;
+  double elapsed;
+
+  epicsMutexMustLock(mutex_);
+  epicsTimeGetCurrent(&now);
+  elapsed = epicsTimeDiffInSeconds(&now, &reportTime_);
+  reportTime_ = now;
+
+  fprintf(fp, "Serial line %s, %d units\n", name_, (int) units_.size());
+  for(size_t i = 0; i < units_.size(); i++){
+    phytronBusUnit *pUnit = &units_[i];
+    fprintf(fp, "  %-16s address %X, %8.1f telegrams/s", pUnit->name, pUnit->address,
+            elapsed > 0 ? (pUnit->telegrams - reportTelegrams_[i])/elapsed : 0);
+    if(pUnit->budget > 0) fprintf(fp, " (budget %.1f)", pUnit->budget);
+    if(pUnit->polling){
+      fprintf(fp, ", polls %lu, skipped %lu, turn timeouts %lu, wait avg %.1f ms max %.1f ms",
+              pUnit->polls, pUnit->skipped, pUnit->timeouts,
+              pUnit->polls ? pUnit->waitSum/pUnit->polls*1000 : 0, pUnit->waitMax*1000);
+    }
+    fprintf(fp, "\n");
+    reportTelegrams_[i] = pUnit->telegrams;
+  }
+
+  if(baud_ > 0){
+    fprintf(fp, "  Link %.0f baud, window %.1f ms, peak utilization %.1f %%\n", baud_, window_*1000, peak_*100);
+  } else {
+    fprintf(fp, "  Link baud rate not set, wire time unknown\n");
+  }
+  for(int i = 0; i < LINK_CLASSES; i++){
+    phytronLinkUsage *pUsage = &usage_[i];
+    fprintf(fp, "  %-10s share %3.0f %%, used %5.1f %%, %lu telegrams, %lu bytes, %lu overruns, %lu throttled\n",
+            linkClassNames[i], pUsage->share*100, elapsed > 0 ? pUsage->total/elapsed*100 : 0,
+            pUsage->telegrams, pUsage->bytes, pUsage->overruns, pUsage->throttled);
+    pUsage->total = 0;
+  }
+  peak_ = 0;
+  epicsMutexUnlock(mutex_);
+}
+
+/** Prints the units sharing a serial line and their telegram rates
+  * Configuration command, called directly or from iocsh
+  * \param[in] asynPortName  Name of the asyn port of the serial line, empty for all lines
+  */
+extern "C" int phytronBusReport(const char *asynPortName)
+{
+  phytronBus *pBus;
+
+  if(!asynPortName || !strlen(asynPortName)){
+    for(size_t i = 0; i < buses.size(); i++) buses[i]->report(stdout);
+    return 0;
+  }
+
+  pBus = phytronBus::find(asynPortName);
+  if(!pBus){
+    printf("ERROR: phytronBusReport: No unit uses port %s\n", asynPortName);
+    return -1;
+  }
+  pBus->report(stdout);
+  return 0;
+}
+
+/** Sets the baud rate of a serial line, which enables the link budget
+  * Configuration command, called directly or from iocsh
+  * \param[in] asynPortName  Name of the asyn port of the serial line
+  * \param[in] baud          Baud rate, 0 disables throttling
+  * \param[in] window        Period the shares of the traffic classes refer to in ms,
+  *                          typically the moving poll period, 0 for 1 s
+  */
+extern "C" int phytronSetLinkBudget(const char *asynPortName, double baud, double window)
+{
+  phytronBus *pBus = phytronBus::find(asynPortName);
+  if(!pBus){
+    printf("ERROR: phytronSetLinkBudget: No unit uses port %s\n", asynPortName);
+    return -1;
+  }
+  pBus->setLink(baud, window/1000);
+  return 0;
+}
+
+/** Sets the part of the link budget window a traffic class may use
+  * Configuration command, called directly or from iocsh
+  * \param[in] asynPortName  Name of the asyn port of the serial line
+  * \param[in] className     poll, command, io or diagnostic
+  * \param[in] share         Part of the window, 0..1
+  */
+extern "C" int phytronSetLinkShare(const char *asynPortName, const char *className, double share)
+{
+  phytronBus *pBus = phytronBus::find(asynPortName);
+  if(!pBus){
+    printf("ERROR: phytronSetLinkShare: No unit uses port %s\n", asynPortName);
+    return -1;
+  }
+  if(pBus->setShare(className, share)){
+    printf("ERROR: phytronSetLinkShare: Unknown traffic class %s, must be poll, command, io or diagnostic\n", className);
+    return -1;
+  }
+  return 0;
+}
+
+/** Parameters for iocsh bus commands */
+static const iocshArg phytronBusReportArg0 = {"Asyn port name", iocshArgString};
+static const iocshArg * const phytronBusReportArgs[] = {&phytronBusReportArg0};
+
+static const iocshArg phytronSetLinkBudgetArg1 = {"Baud rate", iocshArgDouble};
+static const iocshArg phytronSetLinkBudgetArg2 = {"Window (ms)", iocshArgDouble};
+static const iocshArg * const phytronSetLinkBudgetArgs[] = {&phytronBusReportArg0,
+                                                           &phytronSetLinkBudgetArg1,
+                                                           &phytronSetLinkBudgetArg2};
+
+static const iocshArg phytronSetLinkShareArg1 = {"Traffic class", iocshArgString};
+static const iocshArg phytronSetLinkShareArg2 = {"Share (0..1)", iocshArgDouble};
+static const iocshArg * const phytronSetLinkShareArgs[] = {&phytronBusReportArg0,
+                                                          &phytronSetLinkShareArg1,
+                                                          &phytronSetLinkShareArg2};
+
+static const iocshFuncDef phytronBusReportDef = {"phytronBusReport", 1, phytronBusReportArgs};
+static const iocshFuncDef phytronSetLinkBudgetDef = {"phytronSetLinkBudget", 3, phytronSetLinkBudgetArgs};
+static const iocshFuncDef phytronSetLinkShareDef = {"phytronSetLinkShare", 3, phytronSetLinkShareArgs};
+
+static void phytronBusReportCallFunc(const iocshArgBuf *args)
+{
+  phytronBusReport(args[0].sval);
+}
+
+static void phytronSetLinkBudgetCallFunc(const iocshArgBuf *args)
+{
+  phytronSetLinkBudget(args[0].sval, args[1].dval, args[2].dval);
+}
+
+static void phytronSetLinkShareCallFunc(const iocshArgBuf *args)
+{
+  phytronSetLinkShare(args[0].sval, args[1].sval, args[2].dval);
+}
+
+static void phytronBusRegister(void)
+{
+  iocshRegister(&phytronBusReportDef, phytronBusReportCallFunc);
+  iocshRegister(&phytronSetLinkBudgetDef, phytronSetLinkBudgetCallFunc);
+  iocshRegister(&phytronSetLinkShareDef, phytronSetLinkShareCallFunc);
+}
+
+extern "C" {
+epicsExportRegistrar(phytronBusRegister);
+}
@@ -0,0 +1,119 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+#ifndef phytronBus_H
+#define phytronBus_H
+
+#include <stdio.h>
+#include <deque>
+#include <vector>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <epicsTime.h>
+
+#define MAX_BUS_ADDRESS  15   //Units are addressed 0..F on a serial line
+#define BUS_TURN_TIMEOUT 1.0  //A unit waiting longer for its turn polls anyway
+#define LINK_BITS_PER_CHAR 10 //Start bit, 8 data bits, stop bit
+#define LINK_DEFAULT_WINDOW 1.0
+
+/* Traffic classes of the link budget */
+enum phytronLinkClass{
+  linkPoll,       //Motion polls
+  linkCommand,    //Moves, stops, record writes
+  linkIo,         //IO module reads
+  linkDiagnostic, //Parameter reads, snapshot, health monitor, configuration
+  LINK_CLASSES
+};
+
+/* One phyMotion unit (controller or IO port) sharing a serial line */
+typedef struct {
+  char          *name;
+  int           address;
+  bool          polling;    //Takes part in the poll arbitration
+  double        budget;     //Telegrams per second, 0 for no limit
+  double        tokens;     //Telegrams the unit may still send, negative while over budget
+  epicsTimeStamp refill;    //Time tokens was last refilled
+  epicsEventId  turn;       //Signalled when the unit is granted the line for a poll cycle
+  unsigned long telegrams;
+  unsigned long polls;
+  unsigned long skipped;    //Poll cycles skipped while over budget
+  unsigned long timeouts;   //Poll cycles started without a turn after BUS_TURN_TIMEOUT
+  double        waitSum;    //Time spent waiting for a turn
+  double        waitMax;
+} phytronBusUnit;
+
+/* Wire time used by a traffic class */
+typedef struct {
+  double        share;      //Part of the window the class may use
+  double        used;       //Wire time in the current window
+  double        total;      //Wire time since the last report
+  unsigned long bytes;
+  unsigned long telegrams;
+  unsigned long overruns;   //Windows in which the class used more than its share
+  unsigned long throttled;  //Telegrams delayed to a later window
+} phytronLinkUsage;
+
+/** Arbitration of the poll cycles of several units on one serial line (asyn port).
+  * Poll cycles are granted one at a time in the order they are requested, so
+  * the polls of all units interleave instead of queueing telegram by telegram
+  * behind each other. A unit may be given a budget of poll telegrams per
+  * second; its poll cycles are skipped while it is over budget. Commands are
+  * never delayed and do not use up the budget.
+  * The bus also keeps the link budget: the wire time of every telegram is
+  * estimated from its length and the baud rate and accounted to its traffic
+  * class. IO and diagnostic telegrams wait for the next window once their
+  * class has used its share, or once the polls have used theirs.
+  */
+class phytronBus {
+public:
+  static phytronBus *attach(const char *asynPortName);
+  static phytronBus *find(const char *asynPortName);
+
+  int  addUnit(const char *name, int address, bool polling);
+  void setBudget(int unit, double telegramsPerSecond);
+  bool beginPoll(int unit);
+  void endPoll(int unit);
+  void count(int unit, phytronLinkClass linkClass, int telegrams = 1);
+  void report(FILE *fp);
+
+  void setLink(double baud, double window);
+  int  setShare(const char *className, double share);
+  void throttle(phytronLinkClass linkClass);
+  void account(phytronLinkClass linkClass, size_t txBytes, size_t rxBytes);
+  double wireTime(size_t bytes);
+
+  const char *getName() {return name_;}
+
+private:
+  phytronBus(const char *asynPortName);
+
+  char *name_;
+  epicsMutexId mutex_;
+  std::vector<phytronBusUnit> units_;
+  std::deque<int> waiting_;   //Units waiting for their turn, oldest first
+  int owner_;                 //Unit polling, -1 if the line is free
+  epicsTimeStamp reportTime_; //Start of the rates printed by report()
+  std::vector<unsigned long> reportTelegrams_;
+
+  double baud_;               //0 if unknown, telegrams are then counted but not throttled
+  double window_;             //Period the shares refer to, typically the moving poll period
+  epicsTimeStamp windowStart_;
+  double peak_;               //Highest utilization of a window since the last report
+  phytronLinkUsage usage_[LINK_CLASSES];
+  void rollWindow(epicsTimeStamp *pNow);
+};
+
+#endif /* phytronBus_H */
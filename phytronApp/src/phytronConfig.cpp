@@ -0,0 +1,65 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+#include <stdio.h>
+#include <ctype.h>
+
+#include "phytronConfig.h"
+
+/** Splits a configuration string into commands
+  * \param[in]  config    Commands separated by ';' or new lines
+  * \param[out] commands  Commands are appended, empty ones are skipped
+  */
+void phytronSplitConfig(const char *config, std::vector<std::string> &commands)
+{
+  std::string command;
+  bool comment = false;
+
+  for(const char *c = config; ; c++){
+    if(*c == 0 || *c == ';' || *c == '\n' || *c == '\r'){
+      size_t first = command.find_first_not_of(" \t");
+      size_t last = command.find_last_not_of(" \t");
+      if(first != std::string::npos) commands.push_back(command.substr(first, last - first + 1));
+      command.clear();
+      if(*c != ';') comment = false;
+      if(*c == 0) break;
+    } else if(*c == '#'){
+      comment = true;
+    } else if(!comment){
+      command += *c;
+    }
+  }
+}
+
+/** Reads the commands of a configuration file
+  * \param[in]  fileName  File with commands separated by ';' or new lines
+  * \param[out] commands  Commands are appended
+  * \return 0 on success, -1 if the file cannot be read
+  */
+int phytronReadConfigFile(const char *fileName, std::vector<std::string> &commands)
+{
+  std::string config;
+  char buffer[256];
+  size_t n;
+  FILE *fp = fopen(fileName, "r");
+
+  if(!fp) return -1;
+  while((n = fread(buffer, 1, sizeof(buffer), fp)) > 0) config.append(buffer, n);
+  fclose(fp);
+
+  phytronSplitConfig(config.c_str(), commands);
+  return 0;
+}
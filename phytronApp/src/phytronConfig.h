@@ -0,0 +1,28 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+#ifndef phytronConfig_H
+#define phytronConfig_H
+
+#include <string>
+#include <vector>
+
+/* Configuration strings and files: commands are separated by ';' or new lines,
+ * '#' starts a comment that ends with the line, blanks around commands are ignored */
+void phytronSplitConfig(const char *config, std::vector<std::string> &commands);
+int  phytronReadConfigFile(const char *fileName, std::vector<std::string> &commands);
+
+#endif /* phytronConfig_H */
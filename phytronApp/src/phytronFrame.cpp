@@ -0,0 +1,287 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+#include <string.h>
+
+#include <epicsTime.h>
+#include <epicsString.h>
+#include "phytronFrame.h"
+
+phytronFramer::phytronFramer()
+  : pasynUser_(NULL), pasynOctet_(NULL), octetPvt_(NULL), quiet_(0), mismatched_(false),
+    exchanges_(0), timeouts_(0), staleBytes_(0), staleFrames_(0), mismatches_(0), drains_(0), eosFrames_(0)
+{
+}
+
+phytronFramer::~phytronFramer()
+{
+  if(pasynUser_){
+    pasynManager->disconnect(pasynUser_);
+    pasynManager->freeAsynUser(pasynUser_);
+  }
+}
+
+/** Returns the reply expected to a telegram: one value per command if all
+  * commands read, no data if all set parameters (contain '='), else anything
+  * \param[in]  commands  Blank separated commands, without STX and address
+  * \param[in]  isQuery   Returns true for a command that only reads
+  * \param[out] values    Number of commands
+  */
+phytronReplyShape phytronExpectedReply(const char *commands, phytronQueryFunc isQuery, int *values)
+{
+  bool queries = true;
+  bool sets = true;
+  const char *end;
+  size_t len;
+
+  *values = 0;
+  while(*commands){
+    while(*commands == ' ') commands++;
+    if(!*commands) break;
+    end = strchr(commands, ' ');
+    len = end ? (size_t) (end - commands) : strlen(commands);
+
+    if(isQuery(commands, len)) sets = false;
+    else {
+      queries = false;
+      if(!memchr(commands, '=', len)) sets = false;
+    }
+    (*values)++;
+    commands += len;
+  }
+
+  if(*values == 0) return replyAny;
+  if(queries) return replyValues;
+  if(sets) return replyEmpty;
+  return replyAny;
+}
+
+/** Returns true if a reply frame may answer a request. A NAK fits any request.
+  * \param[in] frame     Reply, STX...ETX
+  * \param[in] frameLen  Length of the reply
+  * \param[in] shape     Reply expected by the request
+  * \param[in] values    Values expected by replyValues
+  */
+bool phytronReplyFits(const char *frame, size_t frameLen, phytronReplyShape shape, int values)
+{
+  const char *data, *end;
+  int fields = 0;
+
+  if(shape == replyAny || frameLen < 2 || frame[1] != FRAME_ACK) return true;
+
+  //STX ACK data : checksum ETX, data is empty for an acknowledge
+  data = frame + 2;
+  end = (const char *) memchr(data, ':', frameLen - 2);
+  if(!end) end = frame + frameLen - 1;
+  for(const char *c = data; c < end; c++){
+    if(*c != ' ' && (c == data || c[-1] == ' ')) fields++;
+  }
+
+  return shape == replyEmpty ? fields == 0 : fields == values;
+}
+
+/** Splits the data of a reply into its blank separated values
+  * \param[in]  data    Data of the reply, modified
+  * \param[out] fields  Values
+  * \return Number of values
+  */
+size_t phytronSplitReply(char *data, std::vector<std::string> &fields)
+{
+  char *lasts;
+
+  fields.clear();
+  //Controllers split their replies at the same time, strtok is not reentrant
+  for(char *field = epicsStrtok_r(data, " ", &lasts); field; field = epicsStrtok_r(NULL, " ", &lasts))
+    fields.push_back(field);
+  return fields.size();
+}
+
+/** Connects to the octet interface of a port
+  * \param[in] asynPortName  Name of the asyn port connected to the controller
+  * \param[in] addr          asyn address
+  */
+asynStatus phytronFramer::connect(const char *asynPortName, int addr)
+{
+  asynInterface *pasynInterface;
+  asynStatus status;
+
+  pasynUser_ = pasynManager->createAsynUser(0, 0);
+  status = pasynManager->connectDevice(pasynUser_, asynPortName, addr);
+  if(status) return status;
+
+  //The interposed interface is used, so an EOS set in st.cmd still ends a read
+  pasynInterface = pasynManager->findInterface(pasynUser_, asynOctetType, 1);
+  if(!pasynInterface){
+    pasynManager->disconnect(pasynUser_);
+    return asynError;
+  }
+  pasynOctet_ = (asynOctet *) pasynInterface->pinterface;
+  octetPvt_ = pasynInterface->drvPvt;
+
+  return asynSuccess;
+}
+
+/** Reads and drops whatever arrives until the line has been quiet for quiet_,
+  * at most for FRAME_DRAIN_MAX. Must be called with the port locked.
+  * \param[in] chunk  Buffer of FRAME_CHUNK_SIZE bytes
+  */
+void phytronFramer::drain(char *chunk)
+{
+  epicsTimeStamp start, now;
+  size_t nread;
+  int eomReason;
+  asynStatus status;
+
+  drains_++;
+  epicsTimeGetCurrent(&start);
+  pasynUser_->timeout = quiet_;
+  do {
+    nread = 0;
+    status = pasynOctet_->read(octetPvt_, pasynUser_, chunk, FRAME_CHUNK_SIZE, &nread, &eomReason);
+    staleBytes_ += nread;
+    epicsTimeGetCurrent(&now);
+  } while(nread > 0 && (status == asynSuccess || status == asynTimeout) &&
+          epicsTimeDiffInSeconds(&now, &start) < FRAME_DRAIN_MAX);
+  quiet_ = 0;
+}
+
+/** Writes a request and reads its reply frame. The port is locked for the
+  * whole exchange, so units sharing the port cannot take the reply.
+  * \param[in]  tx        Request, STX...ETX
+  * \param[in]  txLen     Length of the request
+  * \param[out] frame     Reply, STX...ETX, null terminated
+  * \param[in]  frameMax  Size of frame
+  * \param[in]  timeout   Time in s the reply must be complete in
+  * \param[out] frameLen  Length of the reply
+  * \param[in]  shape     Reply expected by the request, see phytronExpectedReply
+  * \param[in]  values    Values expected by replyValues
+  * \return asynError without a reply if only frames not fitting the request
+  *         were received in time, mismatched() is then true
+  */
+asynStatus phytronFramer::writeRead(const char *tx, size_t txLen, char *frame, size_t frameMax, double timeout, size_t *frameLen,
+                                    phytronReplyShape shape, int values)
+{
+  char chunk[FRAME_CHUNK_SIZE];
+  epicsTimeStamp start, now;
+  size_t nwrite, nread, i;
+  size_t len = 0;
+  int eomReason;
+  double remaining;
+  bool inFrame = false;
+  bool complete = false;
+  bool overflow = false;
+  bool mismatch = false;
+  asynStatus status;
+
+  *frameLen = 0;
+  frame[0] = 0;
+  mismatched_ = false;
+  if(!pasynOctet_) return asynDisconnected;
+
+  status = pasynManager->queueLockPort(pasynUser_);
+  if(status) return status;
+
+  exchanges_++;
+
+  //Whatever is pending belongs to an earlier exchange, and after a timeout its reply may still arrive
+  pasynOctet_->flush(octetPvt_, pasynUser_);
+  if(quiet_ > 0) drain(chunk);
+
+  pasynUser_->timeout = timeout;
+  status = pasynOctet_->write(octetPvt_, pasynUser_, tx, txLen, &nwrite);
+  epicsTimeGetCurrent(&start);
+
+  while(!status && !complete){
+    epicsTimeGetCurrent(&now);
+    remaining = timeout - epicsTimeDiffInSeconds(&now, &start);
+    if(remaining <= 0){
+      status = asynTimeout;
+      break;
+    }
+
+    nread = 0;
+    eomReason = 0;
+    pasynUser_->timeout = remaining;
+    status = pasynOctet_->read(octetPvt_, pasynUser_, chunk, sizeof(chunk), &nread, &eomReason);
+    if(status == asynTimeout && nread > 0) status = asynSuccess;
+    if(status) break;
+
+    for(i = 0; i < nread && !complete; i++){
+      if(chunk[i] == FRAME_STX){
+        if(inFrame) staleFrames_++;
+        inFrame = true;
+        overflow = false;
+        len = 0;
+      } else if(!inFrame){
+        staleBytes_++;
+        continue;
+      }
+      if(len < frameMax - 1) frame[len++] = chunk[i];
+      else overflow = true;
+      if(chunk[i] != FRAME_ETX) continue;
+
+      //A complete frame which does not fit is the late reply of an earlier request
+      inFrame = false;
+      if(overflow || phytronReplyFits(frame, len, shape, values)) complete = true;
+      else {
+        mismatches_++;
+        mismatch = true;
+      }
+    }
+    staleBytes_ += nread - i;
+
+    if(!complete && inFrame && (eomReason & ASYN_EOM_EOS)){
+      if(len < frameMax - 1) frame[len++] = FRAME_ETX;
+      else overflow = true;
+      eosFrames_++;
+      inFrame = false;
+      if(overflow || phytronReplyFits(frame, len, shape, values)) complete = true;
+      else {
+        mismatches_++;
+        mismatch = true;
+      }
+    }
+  }
+
+  if(status == asynTimeout){
+    timeouts_++;
+    //The reply may still arrive, the next exchange drains it first
+    quiet_ = timeout < FRAME_QUIET_MAX ? timeout : FRAME_QUIET_MAX;
+    if(mismatch){
+      mismatched_ = true;
+      status = asynError;
+    }
+  }
+
+  pasynManager->queueUnlockPort(pasynUser_);
+
+  if(!complete) len = 0;
+  if(!status && overflow) status = asynOverflow;
+
+  frame[len] = 0;
+  *frameLen = len;
+  return status;
+}
+
+/** Prints the framing statistics
+  * \param[in] fp    Output
+  * \param[in] name  Connection name
+  */
+void phytronFramer::report(FILE *fp, const char *name)
+{
+  fprintf(fp, "  %s: %lu exchanges, %lu timeouts, %lu drains, %lu stale bytes, %lu stale frames, %lu frames not fitting the request, %lu frames ended by EOS\n",
+          name, exchanges_, timeouts_, drains_, staleBytes_, staleFrames_, mismatches_, eosFrames_);
+}
@@ -0,0 +1,89 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+#ifndef phytronFrame_H
+#define phytronFrame_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <asynDriver.h>
+#include <asynOctet.h>
+
+#define FRAME_STX 0x02
+#define FRAME_ETX 0x03
+#define FRAME_ACK 0x06
+#define FRAME_NAK 0x15
+#define FRAME_CHUNK_SIZE 64   //Bytes requested from the port per read
+#define FRAME_QUIET_MAX  0.1  //Longest quiet time in s that ends the drain after a timeout
+#define FRAME_DRAIN_MAX  1.0  //Longest drain in s, the line is used anyway afterwards
+
+/* Reply a request expects, checked by phytronFramer::writeRead */
+enum phytronReplyShape{
+  replyAny,     //Not checked
+  replyValues,  //One blank separated value per command
+  replyEmpty    //Acknowledge without data
+};
+
+/* Returns true if a single command, not blank terminated, only reads */
+typedef bool (*phytronQueryFunc)(const char *command, size_t len);
+
+phytronReplyShape phytronExpectedReply(const char *commands, phytronQueryFunc isQuery, int *values);
+bool phytronReplyFits(const char *frame, size_t frameLen, phytronReplyShape shape, int values);
+size_t phytronSplitReply(char *data, std::vector<std::string> &fields);
+
+/** Request/reply exchange framed on STX and ETX by the driver itself.
+  * Bytes are read as they arrive and the reply is complete as soon as its ETX
+  * is received, whatever input EOS the port is configured with (an ETX
+  * stripped by an EOS of "\3" is restored). Replies carry no sequence number,
+  * so only bytes received after the request was written can belong to it:
+  * input pending from an earlier exchange is flushed before writing, and
+  * after a timeout the line is drained until it has been quiet for a while,
+  * as the lost reply may still be on its way. Bytes outside STX...ETX are
+  * dropped, a frame interrupted by a new STX is discarded as the remainder of
+  * a stale reply, and so is a complete frame that does not fit the request
+  * (values where none are expected or the wrong number of them).
+  */
+class phytronFramer {
+public:
+  phytronFramer();
+  ~phytronFramer();
+
+  asynStatus connect(const char *asynPortName, int addr);
+  asynStatus writeRead(const char *tx, size_t txLen, char *frame, size_t frameMax, double timeout, size_t *frameLen,
+                       phytronReplyShape shape = replyAny, int values = 0);
+  bool mismatched() {return mismatched_;}
+  void report(FILE *fp, const char *name);
+
+private:
+  void drain(char *chunk);
+
+  asynUser *pasynUser_;
+  asynOctet *pasynOctet_;
+  void *octetPvt_;
+  double quiet_;               //Quiet time ending the drain before the next exchange, 0 if none is due
+  bool mismatched_;            //The last exchange failed as no received frame fitted the request
+
+  unsigned long exchanges_;
+  unsigned long timeouts_;
+  unsigned long staleBytes_;   //Bytes received outside a frame
+  unsigned long staleFrames_;  //Incomplete frames followed by a new STX
+  unsigned long mismatches_;   //Complete frames not fitting the request
+  unsigned long drains_;       //Drains after a timeout
+  unsigned long eosFrames_;    //Frames whose ETX was stripped by the input EOS
+};
+
+#endif /* phytronFrame_H */
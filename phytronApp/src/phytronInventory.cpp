@@ -0,0 +1,76 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+#include <ctype.h>
+#include <string.h>
+
+#include "phytronInventory.h"
+
+static const char *kindNames[] = {"empty", "power stage", "digital IO", "analog IO", "not supported"};
+
+/** Identifies a module by its type
+  * \param[in]  type  Reply to IMn
+  * \param[out] axes  Axes of a power stage, the digit following the leading I
+  */
+static phytronModuleKind classifyModule(const std::string &type, int *axes)
+{
+  *axes = 0;
+  if(type.empty() || type == "NACK" || type == "ERR") return moduleEmpty;
+  if(type.find("DIOM") != std::string::npos) return moduleDigitalIo;
+  if(type.find("AIOM") != std::string::npos) return moduleAnalogIo;
+  if(type.size() > 2 && type[0] == 'I' && isdigit((unsigned char) type[1])){
+    *axes = type[1] - '0';
+    if(*axes > 0) return modulePowerStage;
+  }
+  return moduleOther;
+}
+
+/** Builds the inventory of a rack
+  * \param[in]  types    Reply to IMn of each slot, "" if there was none
+  * \param[out] modules  Module of each slot
+  */
+void phytronBuildInventory(const std::vector<std::string> &types, std::vector<phytronModule> &modules)
+{
+  int count[moduleOther + 1];
+  phytronModule module;
+
+  memset(count, 0, sizeof(count));
+  modules.clear();
+  for(size_t i = 0; i < types.size(); i++){
+    module.type = types[i];
+    module.kind = classifyModule(types[i], &module.axes);
+    module.index = ++count[module.kind];
+    modules.push_back(module);
+  }
+}
+
+/** Prints the inventory, one line per slot
+  * \param[in] fp       Output
+  * \param[in] modules  Inventory built by phytronBuildInventory
+  */
+void phytronReportInventory(FILE *fp, const std::vector<phytronModule> &modules)
+{
+  fprintf(fp, "slot\t| module\t| kind\n");
+  for(size_t i = 0; i < modules.size(); i++){
+    if(modules[i].kind == moduleEmpty){
+      fprintf(fp, "  %d\t| -\t\t| empty\n", (int) i + 1);
+      continue;
+    }
+    fprintf(fp, "  %d\t| %s\t| %s %d", (int) i + 1, modules[i].type.c_str(), kindNames[modules[i].kind], modules[i].index);
+    if(modules[i].kind == modulePowerStage) fprintf(fp, ", %d axes", modules[i].axes);
+    fprintf(fp, "\n");
+  }
+}
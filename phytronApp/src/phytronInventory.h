@@ -0,0 +1,48 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+#ifndef phytronInventory_H
+#define phytronInventory_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#define MAX_MODULE_SLOTS 16   //Slots probed with IM1..IM16
+
+/* Kinds of modules in a phyMotion rack */
+enum phytronModuleKind{
+  moduleEmpty,       //IMn refused or not answered
+  modulePowerStage,  //I1AM01, I4..., one or more axes
+  moduleDigitalIo,   //DIOM01
+  moduleAnalogIo,    //AIOM01
+  moduleOther        //Known to the controller, not supported by the driver
+};
+
+/* Module of a slot, as identified by IMn */
+typedef struct {
+  std::string type;        //Reply to IMn, e.g. I1AM01
+  phytronModuleKind kind;
+  int index;               //Number of the module among the modules of its kind, 1..n, as used by the commands
+  int axes;                //Axes of a power stage
+} phytronModule;
+
+/* Builds the inventory from the replies to IM1..IMn, an empty reply is an empty slot.
+ * Power stages and IO modules are numbered in slot order, each kind on its own. */
+void phytronBuildInventory(const std::vector<std::string> &types, std::vector<phytronModule> &modules);
+void phytronReportInventory(FILE *fp, const std::vector<phytronModule> &modules);
+
+#endif /* phytronInventory_H */
@@ -15,6 +15,8 @@
 *   You should have received a copy of the GNU General Public License
 *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 \*************************************************************************/
+#include <ctype.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -32,6 +34,7 @@
 #include <shareLib.h>
 #include <cantProceed.h>
 #include "phytronIoCtrl.h"
+#include "phytronConfig.h"
 
 static const char *driverName = "asynPhytronIoCtrl";
 
@@ -42,6 +45,39 @@ static std::vector<phytronIoCtrl*> controllers;
 #define STATE2STRMAX 6
 const char *state2str[STATE2STRMAX] ={"Success","Timeout","Overflow","Error","Disconnected","Disabled"};
 
+/* Ranges of the T modes of ADn.m and DAn.m: span of the full scale and value at 0 counts */
+#define RANGE_MODES 4
+static const struct { double span; double zero; const char *units; } ranges[RANGE_MODES] = {
+    {10, 0, "0..10 V"},
+    {10, 0, "-10..10 V"},
+    {20, 0, "0..20 mA"},
+    {16, 4, "4..20 mA"}
+};
+
+static double coalesceTaskC(void *drvPvt)
+{
+    phytronIoCtrl *pC = (phytronIoCtrl*)drvPvt;
+    return pC->coalesceTask();
+}
+
+static double commandTaskC(void *drvPvt)
+{
+    phytronIoCtrl *pC = (phytronIoCtrl*)drvPvt;
+    return pC->commandTask();
+}
+
+static double sampleTaskC(void *drvPvt)
+{
+    phytronIoCtrl *pC = (phytronIoCtrl*)drvPvt;
+    return pC->sampleTask();
+}
+
+static double edgeTaskC(void *drvPvt)
+{
+    phytronIoCtrl *pC = (phytronIoCtrl*)drvPvt;
+    return pC->edgeTask();
+}
+
 phytronIoCtrl* findController(const char *portName)
 {
     phytronIoCtrl* ctr = NULL;
@@ -55,19 +91,6 @@ phytronIoCtrl* findController(const char *portName)
    return ctr;
 }
 
-std::string trim(const std::string &s)
-{
-    std::string::const_iterator it = s.begin();
-    while (it != s.end() && isspace(*it))
-        it++;
-
-    std::string::const_reverse_iterator rit = s.rbegin();
-    while (rit.base() != it && isspace(*rit))
-        rit++;
-
-    return std::string(it, rit.base());
-}
-
 /** Creates a new phytronIoCtrl object.
   * Phytron IO commands address the first module,channel or bit by 1 not by 0!
   * - phytronIoCtrl cardNr means the number of the card as found on the bus, first analog: cardNr=1,
@@ -75,10 +98,10 @@ std::string trim(const std::string &s)
   * - asynPortDriver maxAddress=9 to address the channels 1-n for analog cards or for digital cards addr=0 all
   *   bits of the port and addr. 1..n to access single bits.
   */
-phytronIoCtrl::phytronIoCtrl(const char *portName, const char *asynPortName, int cardNr,int timeout)
+phytronIoCtrl::phytronIoCtrl(const char *portName, const char *asynPortName, int cardNr,int timeout,int busAddress)
   : asynPortDriver(portName, 9,
-      asynOctetMask | asynInt32Mask | asynFloat64Mask | asynGenericPointerMask | asynDrvUserMask,
-      asynOctetMask | asynInt32Mask | asynFloat64Mask | asynGenericPointerMask,
+      asynOctetMask | asynInt32Mask | asynFloat64Mask | asynInt32ArrayMask | asynFloat64ArrayMask | asynGenericPointerMask | asynDrvUserMask,
+      asynOctetMask | asynInt32Mask | asynFloat64Mask | asynInt32ArrayMask | asynFloat64ArrayMask | asynGenericPointerMask,
       ASYN_CANBLOCK | ASYN_MULTIDEVICE, NUM_PHYIO_PARAMS, 0, 0)
 {
     static const char *functionName = "phytronIoCtrl";
@@ -95,6 +118,52 @@ phytronIoCtrl::phytronIoCtrl(const char *portName, const char *asynPortName, int
     strcpy(this->controllerName_, portName);
     this->cardNr = cardNr;
 
+    coalesceInterval_ = 0;
+    coalesceTask_ = new phytronTask("phytronCoalesce", coalesceTaskC, this, epicsThreadPriorityMedium);
+    bitsSet_ = 0;
+    bitsCleared_ = 0;
+    portPending_ = false;
+    portValue_ = 0;
+    shadowValid_ = false;
+    portShadow_ = 0;
+    coalescedWrites_ = 0;
+    flushTelegrams_ = 0;
+
+    cmdMutex_ = epicsMutexMustCreate();
+    commandTask_ = new phytronTask("phytronIoCmd", commandTaskC, this, epicsThreadPriorityMedium);
+    cmdDoneEventId_ = epicsEventMustCreate(epicsEventEmpty);
+    nextCmdId_ = 1;
+    cmdTelegrams_ = 0;
+    cmdCompleted_ = 0;
+
+    samplePeriod_ = 0;
+    decimation_ = 1;
+    blockSamples_ = 0;
+    memset(accu_, 0, sizeof(accu_));
+    memset(ainStats_, 0, sizeof(ainStats_));
+    sampleTask_ = new phytronTask("phytronSample", sampleTaskC, this, epicsThreadPriorityMedium);
+    samples_ = 0;
+    sampleTelegrams_ = 0;
+    sampleErrors_ = 0;
+
+    for(int i = 0; i < MAX_IO_CHANNELS; i++) {
+        ainCal_[i].mode = aoutCal_[i].mode = -1;
+        ainCal_[i].scale = aoutCal_[i].scale = 1;
+        ainCal_[i].zero = aoutCal_[i].zero = 0;
+        ainCal_[i].gain = aoutCal_[i].gain = 1;
+        ainCal_[i].offset = aoutCal_[i].offset = 0;
+    }
+
+    edgePeriod_ = 0;
+    edgeTask_ = new phytronTask("phytronEdge", edgeTaskC, this, epicsThreadPriorityMedium);
+    inputsValid_ = false;
+    inputs_ = 0;
+    edges_ = 0;
+    memset(rises_, 0, sizeof(rises_));
+    memset(falls_, 0, sizeof(falls_));
+    edgePolls_ = 0;
+    edgeErrors_ = 0;
+
     /* Create the base set of card parameters */
     createParam(dInString, asynParamInt32, &dIn_);
     createParam(ainString, asynParamInt32, &ain_);
@@ -103,8 +172,27 @@ phytronIoCtrl::phytronIoCtrl(const char *portName, const char *asynPortName, int
     createParam(aoutString, asynParamInt32,&aout_);
     createParam(cmdString, asynParamOctet, &cmd_);
 
+    createParam(ainMeanString, asynParamFloat64, &ainMean_);
+    createParam(ainMinString, asynParamFloat64, &ainMin_);
+    createParam(ainMaxString, asynParamFloat64, &ainMax_);
+    createParam(ainSdevString, asynParamFloat64, &ainSdev_);
+    createParam(ainMeanArrayString, asynParamFloat64Array, &ainMeanArray_);
+    createParam(ainMinArrayString, asynParamFloat64Array, &ainMinArray_);
+    createParam(ainMaxArrayString, asynParamFloat64Array, &ainMaxArray_);
+    createParam(ainSdevArrayString, asynParamFloat64Array, &ainSdevArray_);
+    createParam(ainArrayString, asynParamFloat64Array, &ainArray_);
+
+    createParam(edgeRisesString, asynParamInt32, &edgeRises_);
+    createParam(edgeFallsString, asynParamInt32, &edgeFalls_);
+    createParam(edgeCountString, asynParamInt32, &edgeCount_);
+    createParam(edgeBitArrayString, asynParamInt32Array, &edgeBitArray_);
+    createParam(edgeDirArrayString, asynParamInt32Array, &edgeDirArray_);
+    createParam(edgeTimeArrayString, asynParamFloat64Array, &edgeTimeArray_);
+    createParam(edgeResetString, asynParamInt32, &edgeReset_);
+
     /* Connect to phytron controller */
     status = pasynOctetSyncIO->connect(asynPortName, 0, &pController_, NULL);
+    if (!status) status = framer_.connect(asynPortName, 0);
     if (status) {
         asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
                   "%s: cannot connect to phytron controller\n",
@@ -113,28 +201,39 @@ phytronIoCtrl::phytronIoCtrl(const char *portName, const char *asynPortName, int
     else
         controllers.push_back(this);
 
+    telegramLog_ = new phytronTelegramLog(portName);
+
+    if(busAddress < 0 || busAddress > MAX_BUS_ADDRESS) {
+        printf("%s: invalid bus address %d, must be in range 0 to %d, using 0\n", driverName, busAddress, MAX_BUS_ADDRESS);
+        busAddress = 0;
+    }
+    busAddress_ = "0123456789ABCDEF"[busAddress];
+    bus_ = phytronBus::attach(asynPortName);
+    busUnit_ = bus_->addUnit(portName, busAddress, false);
+
+    commandTask_->wake();
+
     asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: constructor complete\n", driverName, functionName);
 }
 
-static char outBuf[MAX_CONTROLLER_STRING_SIZE];
-char* toHex(const char *in)
+/* Formats in as comma separated hex bytes into out, which must hold MAX_CONTROLLER_STRING_SIZE chars */
+static char* toHex(const char *in, char *out)
 {
     int i;
     int inLen = (int) strlen(in);
-    char   *set = outBuf;
+    char   *set = out;
 
-    if( inLen*4 < MAX_CONTROLLER_STRING_SIZE-1) {
-        sprintf(set,"x%02X",in[0]);
+    *out = 0x0;
+    if( inLen > 0 && inLen*4 < MAX_CONTROLLER_STRING_SIZE-1) {
+        sprintf(set,"x%02X",(unsigned char) in[0]);
         set += 3;
         for(i=1;i<inLen;i++){
-            sprintf(set,",x%02X",in[i]);
+            sprintf(set,",x%02X",(unsigned char) in[i]);
             set += 4 ;
         }
 
     }
-    else
-        *outBuf=0x0;
-    return outBuf;
+    return out;
 }
 
 phytronIoCtrl::~phytronIoCtrl() {}
@@ -144,22 +243,37 @@ phytronIoCtrl::~phytronIoCtrl() {}
   * \param[in] timeout Timeout before returning an error.*/
 asynStatus phytronIoCtrl::writeController(const char *output, double timeout)
 {
-  size_t nwrite;
+  size_t nread;
   asynStatus status;
   char cmdBuf[MAX_CONTROLLER_STRING_SIZE+6];
+  char inBuf[MAX_CONTROLLER_STRING_SIZE+6];
+  char hexBuf[MAX_CONTROLLER_STRING_SIZE];
   char functionName[] = "phytronIoCtrl::writeController";
+  epicsTimeStamp sent, received;
+  phytronReplyShape shape;
+  int values;
 
-  sprintf(cmdBuf,"\x02\x30%s:XX\x03",output);
-  status = pasynOctetSyncIO->write(pController_, cmdBuf,strlen(cmdBuf), timeout, &nwrite);
-  asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,"%s: cmd:'%s',write:%lu,[%s]:'%s'\n",
-            functionName,output,nwrite,toHex(cmdBuf),cmdBuf);
+  sprintf(cmdBuf,"\x02%c%s:XX\x03",busAddress_,output);
+  shape = phytronExpectedReply(output, isQuery, &values);
+  epicsTimeGetCurrent(&sent);
+  //The acknowledge is read too, left unread it would be taken for the reply of the next command
+  status = framer_.writeRead(cmdBuf, strlen(cmdBuf), inBuf, sizeof(inBuf), timeout, &nread, shape, values);
+  epicsTimeGetCurrent(&received);
+  telegramLog_->record(0, cmdBuf, strlen(cmdBuf), inBuf, status ? 0 : nread, &sent, &received, status);
+  bus_->count(busUnit_, linkCommand);
+  bus_->account(linkCommand, strlen(cmdBuf), status ? 0 : nread);
+  if(status == asynSuccess && inBuf[1] != 0x6)
+      status = asynError;
+  if(pasynTrace->getTraceMask(this->pasynUserSelf) & ASYN_TRACE_FLOW)
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,"%s: cmd:'%s',write:%lu,[%s]:'%s'\n",
+                functionName,output,(unsigned long) strlen(cmdBuf),toHex(cmdBuf,hexBuf),cmdBuf);
   return status;
 }
 
 /* Command syntax: <STX><ADDR>comand:[CS|XX]<ETX> or <STX><ACK><ETX>
  * Response syntax:<STX><ACK>data:CS<ETX> or <STX><ACK><ETX>
  *
- * STX=0x2, ACK=0x6/0x15 acknowledge/not acknowledge, ADDR=0, ':'=seperator,
+ * STX=0x2, ACK=0x6/0x15 acknowledge/not acknowledge, ADDR=bus address 0..F, ':'=seperator,
  * CS=Checksum or 'XX' to ignore checksum, <ETX>=0x3
 */
 asynStatus phytronIoCtrl::writeReadController(asynUser *pasynUser, const char *value, size_t maxChars,char *data, int *acknowledge, size_t *response_len)
@@ -168,9 +282,12 @@ asynStatus phytronIoCtrl::writeReadController(asynUser *pasynUser, const char *v
     asynStatus status = asynSuccess;
 
     char outBuf[MAX_CONTROLLER_STRING_SIZE+6];
-    char inBuf[MAX_CONTROLLER_STRING_SIZE];
-    size_t nwrite;
-    int eomReason;
+    char inBuf[MAX_CONTROLLER_STRING_SIZE+6];
+    char outHex[MAX_CONTROLLER_STRING_SIZE];
+    char inHex[MAX_CONTROLLER_STRING_SIZE];
+    epicsTimeStamp sent, received;
+    phytronReplyShape shape;
+    int values;
 
     if(strlen(value) >= MAX_CONTROLLER_STRING_SIZE) {
         status =asynError;
@@ -180,8 +297,16 @@ asynStatus phytronIoCtrl::writeReadController(asynUser *pasynUser, const char *v
             return status;
         }
     }
-    sprintf(outBuf,"\x02\x30%s:XX\x03",value);
-    status = pasynOctetSyncIO->writeRead(pController_, outBuf,strlen(outBuf), inBuf, MAX_CONTROLLER_STRING_SIZE+6, this->timeout_,&nwrite, response_len, &eomReason);
+    sprintf(outBuf,"\x02%c%s:XX\x03",busAddress_,value);
+    //A late reply to an earlier request is told apart by its values
+    shape = phytronExpectedReply(value, isQuery, &values);
+    bus_->throttle(linkIo);
+    epicsTimeGetCurrent(&sent);
+    status = framer_.writeRead(outBuf, strlen(outBuf), inBuf, sizeof(inBuf), this->timeout_, response_len, shape, values);
+    epicsTimeGetCurrent(&received);
+    telegramLog_->record(0, outBuf, strlen(outBuf), inBuf, status ? 0 : *response_len, &sent, &received, status);
+    bus_->count(busUnit_, linkIo);
+    bus_->account(linkIo, strlen(outBuf), status ? 0 : *response_len);
     if(status == asynSuccess) {
         char *sep, *parse;
         parse = inBuf;
@@ -203,8 +328,10 @@ asynStatus phytronIoCtrl::writeReadController(asynUser *pasynUser, const char *v
         else
             status = asynError;
     }
-    asynPrint(this->pasynUserSelf, ASYN_TRACEIO_DRIVER,"%s cmd '%s' write: [%s] response %lu,'%s'[%s]\n",
-              functionName,value,toHex(outBuf),*response_len,this->cmdBuf,toHex(this->cmdBuf));
+    //Formatting is only done when the trace is enabled, the telegram log keeps the raw bytes
+    if(pasynTrace->getTraceMask(this->pasynUserSelf) & ASYN_TRACEIO_DRIVER)
+        asynPrint(this->pasynUserSelf, ASYN_TRACEIO_DRIVER,"%s cmd '%s' write: [%s] response %lu,'%s'[%s]\n",
+                  functionName,value,toHex(outBuf,outHex),(unsigned long) *response_len,inBuf,toHex(inBuf,inHex));
 
     if( (status == asynError) && (status != lastStatus) ) {
         asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,"%s: Communication failed \n",functionName);
@@ -216,68 +343,125 @@ asynStatus phytronIoCtrl::writeReadController(asynUser *pasynUser, const char *v
 
 }
 
+/** CMD:<channel> connects a record to its own command channel, a plain CMD
+  * shares the default channel, see writeOctet
+  */
+asynStatus phytronIoCtrl::drvUserCreate(asynUser *pasynUser, const char *drvInfo, const char **pptypeName, size_t *psize)
+{
+    char *channel;
+    asynStatus status;
+
+    if(strncmp(drvInfo, cmdString ":", strlen(cmdString) + 1))
+        return asynPortDriver::drvUserCreate(pasynUser, drvInfo, pptypeName, psize);
+
+    status = asynPortDriver::drvUserCreate(pasynUser, cmdString, pptypeName, psize);
+    if(status == asynSuccess) {
+        channel = (char *) mallocMustSucceed(strlen(drvInfo) - strlen(cmdString),
+            "phytronIoCtrl::drvUserCreate: channel name memory allocation failed.\n");
+        strcpy(channel, drvInfo + strlen(cmdString) + 1);
+        pasynUser->drvUser = channel;
+    }
+    return status;
+}
+
+/** Frees the channel name of a CMD:<channel> connection */
+asynStatus phytronIoCtrl::drvUserDestroy(asynUser *pasynUser)
+{
+    if(pasynUser->reason == cmd_ && pasynUser->drvUser) {
+        free(pasynUser->drvUser);
+        pasynUser->drvUser = NULL;
+    }
+    return asynPortDriver::drvUserDestroy(pasynUser);
+}
+
+/** Submits the command to the command channel, the response is read by readOctet.
+  * A plain CMD record often only writes, so a write to the default channel waits
+  * for its response and fails on NAK or timeout; a later read returns the response
+  * of the newest write. A write to a CMD:<channel> returns at once.
+  */
 asynStatus phytronIoCtrl::writeOctet(asynUser *pasynUser, const char *value, size_t maxChars,size_t *nActual)
 {
     char functionName[] = "phytronIoCtrl::writeOctet";
+    const char *channel = pasynUser->drvUser ? (const char *) pasynUser->drvUser : "";
+    char response[MAX_CONTROLLER_STRING_SIZE];
     asynStatus status = asynSuccess;
-    size_t response_len;
-    int acknowledge=0;
-    char buf[MAX_CONTROLLER_STRING_SIZE];
-
-    status = writeReadController(pasynUser,value,maxChars,buf,&acknowledge,&response_len);
-    if(status == asynSuccess){
-        *nActual = strlen(value);   /* satisfy writeOcted caller when be shure that write is done successfully */
-        if(acknowledge == 0x6) {
-            if(strlen(buf)>0)
-                strcpy(this->cmdBuf,buf);
-            else
-                strcpy(this->cmdBuf,"ACK");
-        }
-        else if(acknowledge == 0x15)
-            strcpy(this->cmdBuf,"NACK");
-        else {
-            strcpy(this->cmdBuf,"ERR");
-            status = asynError;
-        }
+    int id;
+
+    if(strlen(value) >= MAX_CONTROLLER_STRING_SIZE) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,"%s: command size > MAX_CONTROLLER_STRING_SIZE (%s) \n",functionName,value);
+        return asynError;
+    }
+    id = submitCommand(value, channel);
+    if(!id) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,"%s: queue full, '%s' not sent\n",functionName,value);
+        return asynError;
     }
-    asynPrint(this->pasynUserSelf, ASYN_TRACEIO_DRIVER,"%s write:'%s'\t response: %s\n",functionName,value,this->cmdBuf);
+    *nActual = strlen(value);
+    asynPrint(this->pasynUserSelf, ASYN_TRACEIO_DRIVER,"%s channel:'%s' write:'%s' request %d\n",functionName,channel,value,id);
 
-    if( (status == asynError) && (status != lastStatus) ) {
-        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,"%s: Communication failed \n",functionName);
-        lastStatus = status;
+    if(!pasynUser->drvUser) {
+        //commandTask needs the port to send the request
+        unlock();
+        status = waitCommand(id, response, sizeof(response));
+        lock();
+        if(status == asynSuccess && !strcmp(response, "NACK"))
+            status = asynError;
+        if(status != asynSuccess)
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,"%s: '%s' failed with status %d, response '%s'\n",
+                      functionName,value,status,response);
     }
-    else
-        lastStatus = asynSuccess;
     return status;
 }
 
+/** Waits for the response to the last command written to the channel */
 asynStatus phytronIoCtrl::readOctet(asynUser *pasynUser, char *value, size_t maxChars,size_t *nActual, int *eomReason)
 {
     asynStatus status = asynSuccess;
     char functionName[] = "phytronIoCtrl:readOctet";
-    *nActual = strlen(this->cmdBuf);
+    const char *channel = pasynUser->drvUser ? (const char *) pasynUser->drvUser : "";
+    std::map<std::string, int>::iterator it;
+    char response[MAX_CONTROLLER_STRING_SIZE];
+    int id = 0;
 
-    if(pasynUser->reason == cmd_) {
-        if(*nActual > maxChars) {
-            status = asynError;
-            if(status == asynError){
-                if (status != lastStatus) {
-                    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
-                              "%s: Failed with status %d for reason %d\n",functionName,status, pasynUser->reason);
-                    lastStatus = status;
-                }
-            }
-        }
-        else {
-            strcpy(value,this->cmdBuf);
-            *eomReason = ASYN_EOM_EOS;
-            asynPrint(this->pasynUserSelf, ASYN_TRACEIO_DRIVER,"%s read: '%s'\n",functionName,value);
-        }
+    *nActual = 0;
+    if(pasynUser->reason != cmd_)
+        return status;
+
+    epicsMutexMustLock(cmdMutex_);
+    it = cmdChannels_.find(channel);
+    if(it != cmdChannels_.end()) id = it->second;
+    epicsMutexUnlock(cmdMutex_);
 
-        lastStatus = asynSuccess;
+    *response = 0;
+    if(id) {
+        //commandTask needs the port to send the request
+        unlock();
+        status = waitCommand(id, response, sizeof(response));
+        lock();
+    }
+
+    if(strlen(response) >= maxChars) {
+        status = asynOverflow;
+        strncpy(value, response, maxChars);
+        *nActual = maxChars;
+    }
+    else {
+        strcpy(value, response);
+        *nActual = strlen(response);
+        *eomReason = ASYN_EOM_EOS;
     }
+    if(status != asynSuccess) {
+        if(status != lastStatus)
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                      "%s: Failed with status %d (%s) for channel '%s' request %d\n",functionName,status,
+                      (status<STATE2STRMAX)?state2str[status]:"Illegal status",channel,id);
+        lastStatus = status;
+    }
+    else
+        asynPrint(this->pasynUserSelf, ASYN_TRACEIO_DRIVER,"%s channel:'%s' request %d read: '%s'\n",functionName,channel,id,value);
     return status;
 }
+
 /** asynUsers use this to read integer parameters
  * \param[in] pasynUser   asynUser structure containing the reason
  * \param[out] value      Parameter value
@@ -302,6 +486,10 @@ asynStatus phytronIoCtrl::readInt32(asynUser *pasynUser, epicsInt32 *value)
         return status;
     }
 
+    //Parameters maintained by the driver
+    if(reason != dIn_ && reason != dOut_ && reason != ain_ && reason != aout_)
+        return asynPortDriver::readInt32(pasynUser, value);
+
     if(reason == dIn_)                      // read digital input
         if(chanNr==0)
             sprintf(outBuf, "EG%dR",this->cardNr);
@@ -316,8 +504,10 @@ asynStatus phytronIoCtrl::readInt32(asynUser *pasynUser, epicsInt32 *value)
         sprintf(outBuf, "AD%d.%d",this->cardNr,chanNr);
     else if(reason == aout_)
         sprintf(outBuf, "DA%d.%d",this->cardNr,chanNr);
-    else if(reason == cmd_) {
-    }
+
+    //A readback must not miss output writes which are still coalesced
+    if(reason == dOut_ || reason == aout_)
+        flushOutputs();
 
     status = writeReadController(pasynUser, outBuf, MAX_CONTROLLER_STRING_SIZE,inBuf, &acknowledge, &response_len);
     if(acknowledge != 0x06)
@@ -333,6 +523,10 @@ asynStatus phytronIoCtrl::readInt32(asynUser *pasynUser, epicsInt32 *value)
         return status;
     }
     *value = atoi(inBuf);
+    if(reason == dOut_ && chanNr == 0) {
+        portShadow_ = *value;
+        shadowValid_ = true;
+    }
     asynPrint(this->pasynUserSelf, ASYN_TRACEIO_DRIVER,"%s card%d.%d cmd:'%s' read: %d\n",functionName,this->cardNr,chanNr,outBuf,*value);
     lastStatus = asynSuccess;
     return status;
@@ -360,6 +554,35 @@ asynStatus phytronIoCtrl::writeInt32(asynUser *pasynUser, epicsInt32 value)
       return status;
   }
 
+  if(reason == edgeReset_) {
+      resetEdges();
+      return asynSuccess;
+  }
+  if(reason != dOut_ && reason != aout_)
+      return asynPortDriver::writeInt32(pasynUser, value);
+
+  //Coalesced writes are sent by coalesceTask, the latest value of each output wins
+  if(coalesceInterval_ > 0 && (reason == dOut_ || reason == aout_)) {
+      if(reason == aout_)
+          aoutPending_[chanNr] = value;
+      else if(chanNr == 0) {
+          portPending_ = true;
+          portValue_ = value;
+          bitsSet_ = bitsCleared_ = 0;
+      }
+      else if(value) {
+          bitsSet_ |= 1u << (chanNr-1);
+          bitsCleared_ &= ~(1u << (chanNr-1));
+      }
+      else {
+          bitsCleared_ |= 1u << (chanNr-1);
+          bitsSet_ &= ~(1u << (chanNr-1));
+      }
+      coalescedWrites_++;
+      asynPrint(this->pasynUserSelf, ASYN_TRACEIO_DRIVER,"%s: card:%d.%d reason:%d value %d coalesced\n",functionName,this->cardNr,chanNr,reason,value);
+      return asynSuccess;
+  }
+
   if(reason == dOut_)
       if(chanNr==0)
           sprintf(outBuf, "AG%dS%d",this->cardNr,value);
@@ -369,6 +592,14 @@ asynStatus phytronIoCtrl::writeInt32(asynUser *pasynUser, epicsInt32 value)
       sprintf(outBuf, "DA%d.%d=%d",this->cardNr,chanNr,value);
   asynPrint(this->pasynUserSelf, ASYN_TRACEIO_DRIVER,"%s: card:%d.%d reason:%d cmd: '%s'\n",functionName,this->cardNr,chanNr,pasynUser->reason,outBuf);
   status = writeController(outBuf, timeout_) ;
+  if(reason == dOut_ && status != asynSuccess)
+      shadowValid_ = false;
+  else if(reason == dOut_ && chanNr == 0) {
+      portShadow_ = value;
+      shadowValid_ = true;
+  }
+  else if(reason == dOut_)
+      portShadow_ = value ? (portShadow_ | (1 << (chanNr-1))) : (portShadow_ & ~(1 << (chanNr-1)));
   if(status == asynError){
     if (status != lastStatus) {
       asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
@@ -382,68 +613,906 @@ asynStatus phytronIoCtrl::writeInt32(asynUser *pasynUser, epicsInt32 value)
 }
 void phytronIoCtrl::report(FILE *fp, int level)
 {
+    if(level > 0) {
+        framer_.report(fp, this->controllerName_);
+        epicsMutexMustLock(cmdMutex_);
+        fprintf(fp, "  command channel: %lu requests in %lu telegrams, %d queued\n",
+                cmdCompleted_, cmdTelegrams_, (int) cmdQueue_.size());
+        epicsMutexUnlock(cmdMutex_);
+        if(coalesceInterval_ > 0)
+            fprintf(fp, "  output writes coalesced every %.1f ms: %lu writes, %lu telegrams\n",
+                    coalesceInterval_*1000, coalescedWrites_, flushTelegrams_);
+        if(samplePeriod_ > 0)
+            fprintf(fp, "  %d analog inputs sampled every %.1f ms, statistics of %d samples: %lu samples, %lu telegrams, %lu failed\n",
+                    (int) sampleChannels_.size(), samplePeriod_*1000, decimation_, samples_, sampleTelegrams_, sampleErrors_);
+        for(int i = 0; i < MAX_IO_CHANNELS; i++) {
+            if(ainCal_[i].mode >= 0 || ainCal_[i].gain != 1 || ainCal_[i].offset != 0)
+                fprintf(fp, "  AIN %d: %s, gain %g, offset %g\n", i + 1,
+                        ainCal_[i].mode >= 0 ? ranges[ainCal_[i].mode].units : "counts", ainCal_[i].gain, ainCal_[i].offset);
+            if(aoutCal_[i].mode >= 0 || aoutCal_[i].gain != 1 || aoutCal_[i].offset != 0)
+                fprintf(fp, "  AOUT %d: %s, gain %g, offset %g\n", i + 1,
+                        aoutCal_[i].mode >= 0 ? ranges[aoutCal_[i].mode].units : "counts", aoutCal_[i].gain, aoutCal_[i].offset);
+        }
+        if(edgePeriod_ > 0)
+            fprintf(fp, "  digital inputs polled every %.1f ms for edges: %lu polls, %lu failed, %lu edges\n",
+                    edgePeriod_*1000, edgePolls_, edgeErrors_, edges_);
+    }
 }
 
-asynStatus phytronIoCtrl::setParam(const char *paramStr, int dbg)
+/** Sets the interval coalesced output writes are flushed in
+  * \param[in] interval  Flush interval in s, 0 sends every write immediately
+  */
+void phytronIoCtrl::setCoalescing(double interval)
 {
+    lock();
+    coalesceInterval_ = interval > 0 ? interval : 0;
+    if(coalesceInterval_ <= 0)
+        flushOutputs();
+
+    if(coalesceInterval_ > 0 || coalesceTask_->started())
+        coalesceTask_->wake();
+    unlock();
+}
+
+/** Sends the pending output writes: all bit writes and a port write of the card
+  * as one port write, the latest value of each analog output, in one telegram
+  * if the controller accepts it. Must be called with the port locked.
+  */
+asynStatus phytronIoCtrl::flushOutputs()
+{
+    std::vector<std::string> commands;
+    std::vector<std::string> responses;
+    std::vector<asynStatus> statuses;
+    std::map<int, epicsInt32>::iterator it;
+    char command[MAX_CONTROLLER_STRING_SIZE];
+    char inBuf[MAX_CONTROLLER_STRING_SIZE];
+    asynStatus status = asynSuccess;
+    size_t response_len;
+    epicsInt32 value = 0;
+    bool portWrite = false;
+    int acknowledge = 0;
+    int telegrams = 0;
+    static const char *functionName = "flushOutputs";
+
+    if(portPending_ || bitsSet_ || bitsCleared_) {
+        if(portPending_)
+            value = portValue_;
+        else {
+            //Bit writes are merged into the port value last written or read
+            if(!shadowValid_) {
+                sprintf(command, "AG%dR", this->cardNr);
+                status = writeReadController(pController_, command, MAX_CONTROLLER_STRING_SIZE, inBuf, &acknowledge, &response_len);
+                telegrams++;
+                if(status == asynSuccess && acknowledge == 0x6) {
+                    portShadow_ = atoi(inBuf);
+                    shadowValid_ = true;
+                }
+            }
+            value = shadowValid_ ? (epicsInt32) ((portShadow_ & ~bitsCleared_) | bitsSet_) : 0;
+        }
+        if(portPending_ || shadowValid_) {
+            sprintf(command, "AG%dS%d", this->cardNr, value);
+            commands.push_back(command);
+            portWrite = true;
+        }
+        else {
+            //Port state unknown, fall back to a write per bit
+            for(int bit = 0; bit < 32; bit++) {
+                if(!((bitsSet_ | bitsCleared_) & (1u << bit))) continue;
+                sprintf(command, "A%d.%d%c", this->cardNr, bit+1, (bitsSet_ & (1u << bit)) ? 'S' : 'R');
+                commands.push_back(command);
+            }
+        }
+        portPending_ = false;
+        bitsSet_ = bitsCleared_ = 0;
+    }
+
+    for(it = aoutPending_.begin(); it != aoutPending_.end(); ++it) {
+        sprintf(command, "DA%d.%d=%d", this->cardNr, it->first, it->second);
+        commands.push_back(command);
+    }
+    aoutPending_.clear();
+
+    if(commands.empty())
+        return status;
+
+    status = sendBatch(commands, responses, statuses, &telegrams);
+    flushTelegrams_ += telegrams;
+
+    for(size_t i = 0; i < commands.size(); i++) {
+        if(statuses[i] == asynSuccess && responses[i] != "NACK") continue;
+        if(status == asynSuccess) status = asynError;
+        if(status != lastStatus)
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,"%s: card:%d '%s' failed: %s\n",
+                      functionName, this->cardNr, commands[i].c_str(), responses[i].c_str());
+    }
+    if(portWrite) {
+        shadowValid_ = (statuses[0] == asynSuccess && responses[0] != "NACK");
+        portShadow_ = value;
+    }
+    lastStatus = status;
+    return status;
+}
+
+/** Flushes the coalesced output writes, runs every coalesceInterval_ seconds */
+double phytronIoCtrl::coalesceTask()
+{
+    double interval;
+
+    lock();
+    flushOutputs();
+    interval = coalesceInterval_;
+    unlock();
+    return interval > 0 ? interval : -1;
+}
+
+/** AIN and AOUT in engineering units, the other parameters from the parameter library
+ * \param[in] pasynUser   asynUser structure containing the reason
+ * \param[out] value      Parameter value
+ */
+asynStatus phytronIoCtrl::readFloat64(asynUser *pasynUser, epicsFloat64 *value)
+{
+    int reason = pasynUser->reason;
+    int chanNr;
+    epicsInt32 counts;
     asynStatus status;
-    char functionName[] = "setParam";
-    int pos=0, fnd=0;
-    std::string parse(paramStr);
-    std::string delim(";");
-    std::string param;
-    std::string resp;
-    char response[MAX_CONTROLLER_STRING_SIZE];
 
-    if(strlen(paramStr)==0)
+    if(reason != ain_ && reason != aout_)
+        return asynPortDriver::readFloat64(pasynUser, value);
+
+    getAddress(pasynUser, &chanNr);
+    if(chanNr < 1 || chanNr > MAX_IO_CHANNELS)
+        return asynError;
+    status = readInt32(pasynUser, &counts);
+    if(status == asynSuccess)
+        *value = toUnits(reason == ain_ ? &ainCal_[chanNr-1] : &aoutCal_[chanNr-1], counts);
+    return status;
+}
+
+/** Writes AOUT in engineering units, clipped to the range of the output
+ * \param[in] pasynUser   asynUser structure containing the reason
+ * \param[in] value       Parameter value to be written
+ */
+asynStatus phytronIoCtrl::writeFloat64(asynUser *pasynUser, epicsFloat64 value)
+{
+    int reason = pasynUser->reason;
+    int chanNr;
+    const phytronCalibration *pCal;
+    double counts;
+
+    if(reason != aout_)
+        return asynPortDriver::writeFloat64(pasynUser, value);
+
+    getAddress(pasynUser, &chanNr);
+    if(chanNr < 1 || chanNr > MAX_IO_CHANNELS)
+        return asynError;
+    pCal = &aoutCal_[chanNr-1];
+    if(pCal->gain == 0 || pCal->scale == 0)
+        return asynError;
+    counts = ((value - pCal->offset)/pCal->gain - pCal->zero)/pCal->scale;
+    if(pCal->mode >= 0)
+        counts = counts > AOUT_FULL_SCALE - 1 ? AOUT_FULL_SCALE - 1 : (counts < -AOUT_FULL_SCALE ? -AOUT_FULL_SCALE : counts);
+    return writeInt32(pasynUser, (epicsInt32) floor(counts + 0.5));
+}
+
+/** Returns the edge log, oldest edge first */
+asynStatus phytronIoCtrl::readInt32Array(asynUser *pasynUser, epicsInt32 *value, size_t nElements, size_t *nIn)
+{
+    int reason = pasynUser->reason;
+
+    if(reason == edgeBitArray_)
+        *nIn = copyEdges(0, value, nElements);
+    else if(reason == edgeDirArray_)
+        *nIn = copyEdges(1, value, nElements);
+    else
+        return asynPortDriver::readInt32Array(pasynUser, value, nElements, nIn);
+    return asynSuccess;
+}
+
+/** Returns the last statistics of the oversampled inputs, indexed by channel-1,
+  * or the times of the edge log
+  */
+asynStatus phytronIoCtrl::readFloat64Array(asynUser *pasynUser, epicsFloat64 *value, size_t nElements, size_t *nIn)
+{
+    int reason = pasynUser->reason;
+    int stat;
+
+    if(reason == edgeTimeArray_) {
+        *nIn = copyEdges(2, value, nElements);
         return asynSuccess;
+    }
+
+    if(reason == ainArray_) {
+        //All channels in one telegram, converted in one pass
+        std::vector<std::string> commands;
+        std::vector<std::string> responses;
+        std::vector<asynStatus> statuses;
+        char command[MAX_CONTROLLER_STRING_SIZE];
+        int telegrams = 0;
+        asynStatus status;
+
+        *nIn = nElements < MAX_IO_CHANNELS ? nElements : MAX_IO_CHANNELS;
+        for(size_t i = 0; i < *nIn; i++) {
+            sprintf(command, "AD%d.%d", this->cardNr, (int) i + 1);
+            commands.push_back(command);
+        }
+        status = sendBatch(commands, responses, statuses, &telegrams);
+        for(size_t i = 0; i < *nIn; i++) {
+            if(statuses[i] != asynSuccess || responses[i] == "NACK" || responses[i] == "ACK") {
+                if(status == asynSuccess) status = asynError;
+                value[i] = 0;
+                continue;
+            }
+            value[i] = toUnits(&ainCal_[i], atoi(responses[i].c_str()));
+        }
+        return status;
+    }
+
+    if(reason == ainMeanArray_)     stat = 0;
+    else if(reason == ainMinArray_) stat = 1;
+    else if(reason == ainMaxArray_) stat = 2;
+    else if(reason == ainSdevArray_) stat = 3;
+    else
+        return asynPortDriver::readFloat64Array(pasynUser, value, nElements, nIn);
+
+    *nIn = nElements < MAX_IO_CHANNELS ? nElements : MAX_IO_CHANNELS;
+    memcpy(value, ainStats_[stat], *nIn * sizeof(epicsFloat64));
+    return asynSuccess;
+}
+
+/** Configures the oversampled acquisition of analog inputs
+  * \param[in] channels    Channels to sample, e.g. "1,2,4", "" stops sampling
+  * \param[in] period      Sample period in s, 0 stops sampling
+  * \param[in] decimation  Samples per published statistics
+  */
+asynStatus phytronIoCtrl::setOversampling(const char *channels, double period, int decimation)
+{
+    std::vector<int> list;
+    const char *c = channels ? channels : "";
+    char *end;
+    long channel;
+
+    while(*c) {
+        channel = strtol(c, &end, 10);
+        if(end == c || channel < 1 || channel > MAX_IO_CHANNELS) {
+            printf("%s: invalid channel list '%s', channels must be in range 1 to %d\n", driverName, channels, MAX_IO_CHANNELS);
+            return asynError;
+        }
+        list.push_back((int) channel);
+        c = end;
+        while(*c == ',' || *c == ' ') c++;
+    }
+
+    lock();
+    sampleChannels_ = list;
+    samplePeriod_ = (period > 0 && !list.empty()) ? period : 0;
+    decimation_ = decimation > 1 ? decimation : 1;
+    blockSamples_ = 0;
+    memset(accu_, 0, sizeof(accu_));
+
+    if(samplePeriod_ > 0 || sampleTask_->started())
+        sampleTask_->wake();
+    unlock();
+    return asynSuccess;
+}
+
+/** Reads all sampled inputs, in as few telegrams as possible, and accumulates
+  * the values. Must be called with the port locked.
+  */
+void phytronIoCtrl::sampleInputs()
+{
+    std::vector<std::string> commands;
+    std::vector<std::string> responses;
+    std::vector<asynStatus> statuses;
+    char command[MAX_CONTROLLER_STRING_SIZE];
+    phytronAinAccu *pAccu;
+    epicsInt32 value;
+    int telegrams = 0;
+    size_t i;
+
+    for(i = 0; i < sampleChannels_.size(); i++) {
+        sprintf(command, "AD%d.%d", this->cardNr, sampleChannels_[i]);
+        commands.push_back(command);
+    }
+    sendBatch(commands, responses, statuses, &telegrams);
+    sampleTelegrams_ += telegrams;
+
+    for(i = 0; i < sampleChannels_.size(); i++) {
+        if(statuses[i] != asynSuccess || responses[i] == "NACK" || responses[i] == "ACK") {
+            sampleErrors_++;
+            continue;
+        }
+        value = atoi(responses[i].c_str());
+        pAccu = &accu_[sampleChannels_[i]-1];
+        if(pAccu->n == 0 || value < pAccu->min) pAccu->min = value;
+        if(pAccu->n == 0 || value > pAccu->max) pAccu->max = value;
+        pAccu->sum += value;
+        pAccu->sumSq += (double) value * value;
+        pAccu->n++;
+        samples_++;
+    }
+
+    if(++blockSamples_ >= decimation_)
+        publishStatistics();
+}
+
+/** Publishes mean, min, max and standard deviation of the accumulated samples
+  * and starts the next block. Must be called with the port locked.
+  */
+void phytronIoCtrl::publishStatistics()
+{
+    phytronAinAccu *pAccu;
+    const phytronCalibration *pCal;
+    double mean, variance, slope;
+    int channel;
+    size_t i;
+
+    for(i = 0; i < sampleChannels_.size(); i++) {
+        channel = sampleChannels_[i];
+        pAccu = &accu_[channel-1];
+        if(pAccu->n == 0) {
+            //No sample in this block, the last statistics are kept but flagged
+            setParamStatus(channel, ainMean_, asynError);
+            setParamStatus(channel, ainMin_, asynError);
+            setParamStatus(channel, ainMax_, asynError);
+            setParamStatus(channel, ainSdev_, asynError);
+            callParamCallbacks(channel);
+            continue;
+        }
+        mean = pAccu->sum / pAccu->n;
+        variance = pAccu->sumSq / pAccu->n - mean * mean;
+        //Statistics are taken in counts and converted once per block
+        pCal = &ainCal_[channel-1];
+        slope = pCal->scale * pCal->gain;
+        ainStats_[0][channel-1] = toUnits(pCal, mean);
+        ainStats_[1][channel-1] = toUnits(pCal, slope < 0 ? pAccu->max : pAccu->min);
+        ainStats_[2][channel-1] = toUnits(pCal, slope < 0 ? pAccu->min : pAccu->max);
+        ainStats_[3][channel-1] = variance > 0 ? sqrt(variance) * fabs(slope) : 0;
+
+        setParamStatus(channel, ainMean_, asynSuccess);
+        setParamStatus(channel, ainMin_, asynSuccess);
+        setParamStatus(channel, ainMax_, asynSuccess);
+        setParamStatus(channel, ainSdev_, asynSuccess);
+        setDoubleParam(channel, ainMean_, ainStats_[0][channel-1]);
+        setDoubleParam(channel, ainMin_, ainStats_[1][channel-1]);
+        setDoubleParam(channel, ainMax_, ainStats_[2][channel-1]);
+        setDoubleParam(channel, ainSdev_, ainStats_[3][channel-1]);
+        callParamCallbacks(channel);
+    }
+
+    doCallbacksFloat64Array(ainStats_[0], MAX_IO_CHANNELS, ainMeanArray_, 0);
+    doCallbacksFloat64Array(ainStats_[1], MAX_IO_CHANNELS, ainMinArray_, 0);
+    doCallbacksFloat64Array(ainStats_[2], MAX_IO_CHANNELS, ainMaxArray_, 0);
+    doCallbacksFloat64Array(ainStats_[3], MAX_IO_CHANNELS, ainSdevArray_, 0);
+
+    blockSamples_ = 0;
+    memset(accu_, 0, sizeof(accu_));
+}
+
+/** Samples the configured analog inputs, runs every samplePeriod_ seconds */
+double phytronIoCtrl::sampleTask()
+{
+    double period;
+
+    lock();
+    if(samplePeriod_ > 0)
+        sampleInputs();
+    period = samplePeriod_;
+    unlock();
+    return period > 0 ? period : -1;
+}
+
+/** Sets the period the digital inputs are polled in for edges
+  * \param[in] period  Poll period in s, 0 stops edge capture
+  */
+void phytronIoCtrl::setEdgeCapture(double period)
+{
+    lock();
+    edgePeriod_ = period > 0 ? period : 0;
+    inputsValid_ = false;
+
+    if(edgePeriod_ > 0 || edgeTask_->started())
+        edgeTask_->wake();
+    unlock();
+}
+
+/** Reads the input word of the card and logs the bits that changed since the
+  * last poll. Must be called with the port locked.
+  */
+void phytronIoCtrl::pollEdges()
+{
+    char command[MAX_CONTROLLER_STRING_SIZE];
+    char inBuf[MAX_CONTROLLER_STRING_SIZE];
+    epicsTimeStamp now;
+    epicsUInt32 value, changed;
+    phytronEdge *pEdge;
+    size_t response_len;
+    int acknowledge = 0;
+    asynStatus status;
+
+    sprintf(command, "EG%dR", this->cardNr);
+    *inBuf = 0;
+    status = writeReadController(pController_, command, MAX_CONTROLLER_STRING_SIZE, inBuf, &acknowledge, &response_len);
+    epicsTimeGetCurrent(&now);
+    edgePolls_++;
+    if(status != asynSuccess || acknowledge != 0x6 || !*inBuf) {
+        //Edges during a failed poll are seen, merged, by the next one
+        edgeErrors_++;
+        return;
+    }
+
+    value = (epicsUInt32) strtoul(inBuf, NULL, 10);
+    changed = inputsValid_ ? value ^ inputs_ : 0;
+    inputs_ = value;
+    inputsValid_ = true;
+    if(!changed)
+        return;
+
+    for(int bit = 0; bit < 32; bit++) {
+        if(!(changed & (1u << bit))) continue;
+        pEdge = &edgeLog_[edges_ % EDGE_LOG_SIZE];
+        pEdge->bit = bit + 1;
+        pEdge->rising = (value >> bit) & 1;
+        pEdge->time = now.secPastEpoch + now.nsec * 1e-9;
+        edges_++;
+        if(bit >= MAX_IO_CHANNELS) continue;
+        if(pEdge->rising) setIntegerParam(bit + 1, edgeRises_, ++rises_[bit]);
+        else              setIntegerParam(bit + 1, edgeFalls_, ++falls_[bit]);
+        callParamCallbacks(bit + 1);
+    }
+    publishEdges();
+}
+
+/** Copies a field of the edge log, oldest edge first
+  * \param[in]  field      0 bit, 1 direction (epicsInt32), 2 time (epicsFloat64)
+  * \param[out] value      Array
+  * \param[in]  nElements  Size of value
+  * \return Number of edges copied
+  */
+size_t phytronIoCtrl::copyEdges(int field, void *value, size_t nElements)
+{
+    size_t logged = edges_ < EDGE_LOG_SIZE ? edges_ : EDGE_LOG_SIZE;
+    size_t n = logged < nElements ? logged : nElements;
+    const phytronEdge *pEdge;
+
+    //The newest n edges if the array is shorter than the log
+    for(size_t i = 0; i < n; i++) {
+        pEdge = &edgeLog_[(edges_ - n + i) % EDGE_LOG_SIZE];
+        if(field == 0)      ((epicsInt32 *) value)[i] = pEdge->bit;
+        else if(field == 1) ((epicsInt32 *) value)[i] = pEdge->rising;
+        else                ((epicsFloat64 *) value)[i] = pEdge->time;
+    }
+    return n;
+}
+
+/** Publishes the edge log and the edge count. Must be called with the port locked. */
+void phytronIoCtrl::publishEdges()
+{
+    epicsInt32 bits[EDGE_LOG_SIZE];
+    epicsInt32 directions[EDGE_LOG_SIZE];
+    epicsFloat64 times[EDGE_LOG_SIZE];
+    size_t n;
+
+    n = copyEdges(0, bits, EDGE_LOG_SIZE);
+    copyEdges(1, directions, EDGE_LOG_SIZE);
+    copyEdges(2, times, EDGE_LOG_SIZE);
+    doCallbacksInt32Array(bits, n, edgeBitArray_, 0);
+    doCallbacksInt32Array(directions, n, edgeDirArray_, 0);
+    doCallbacksFloat64Array(times, n, edgeTimeArray_, 0);
+
+    setIntegerParam(0, edgeCount_, (epicsInt32) edges_);
+    callParamCallbacks(0);
+}
+
+/** Clears the edge log and the counters. Must be called with the port locked. */
+void phytronIoCtrl::resetEdges()
+{
+    edges_ = 0;
+    memset(rises_, 0, sizeof(rises_));
+    memset(falls_, 0, sizeof(falls_));
+    for(int bit = 0; bit < MAX_IO_CHANNELS; bit++) {
+        setIntegerParam(bit + 1, edgeRises_, 0);
+        setIntegerParam(bit + 1, edgeFalls_, 0);
+        callParamCallbacks(bit + 1);
+    }
+    publishEdges();
+}
+
+/** Polls the digital inputs for edges, runs every edgePeriod_ seconds */
+double phytronIoCtrl::edgeTask()
+{
+    double period;
+
+    lock();
+    if(edgePeriod_ > 0)
+        pollEdges();
+    period = edgePeriod_;
+    unlock();
+    return period > 0 ? period : -1;
+}
+
+/** Applies a configuration string, see applyConfig
+  * \param[in] paramStr  Commands separated by ';'
+  * \param[in] dbg       Print the response of every command if > 0
+  */
+asynStatus phytronIoCtrl::setParam(const char *paramStr, int dbg)
+{
+    std::vector<std::string> commands;
+
+    phytronSplitConfig(paramStr, commands);
+    if(commands.empty())
+        return asynSuccess;
+
+    return applyConfig(commands, dbg);
+}
+
+/** Applies configuration commands in batched telegrams and reports every
+  * command that failed
+  * \param[in] commands  Commands that set parameters, e.g. DA1.1T1
+  * \param[in] dbg       Print the response of every command if > 0
+  */
+asynStatus phytronIoCtrl::applyConfig(const std::vector<std::string> &commands, int dbg)
+{
+    asynStatus status;
+    char functionName[] = "applyConfig";
+    std::vector<std::string> responses;
+    std::vector<asynStatus> statuses;
+    int telegrams = 0;
+    size_t i;
+
+    lock();
+    status = sendBatch(commands, responses, statuses, &telegrams);
+    unlock();
 
     if(dbg>0)
         printf("Command\t\tResponse\n");
 
-    while(fnd != -1) {
-        fnd = parse.find(delim,pos);
-        param = parse.substr(pos,fnd-pos);
-        param = trim(param);
-        //std::cout << len << ", "<<pos << ", "<<fnd << ", '"<< param <<"'"<< std::endl;
-        pos = fnd+1;
-
-        status = cmd(param.c_str(), response, MAX_CONTROLLER_STRING_SIZE);
+    for(i = 0; i < commands.size(); i++) {
         if(dbg>0)
-            printf("'%s'\t'%s'\t%s\n",param.c_str(),response,((status>0)&&(status<STATE2STRMAX))?state2str[status]:"");
-        asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: set: %s, %s\n", driverName, functionName,param.c_str(),response);
-        if(status != asynSuccess) {
-            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: set param failed: %s\n", driverName, functionName,
-                      (status<STATE2STRMAX)?state2str[status]:"Illegal status");
-        }
-        resp = response;
-        if(resp == "NACK" || resp == "ERR")
+            printf("'%s'\t'%s'\t%s\n",commands[i].c_str(),responses[i].c_str(),
+                   ((statuses[i]>0)&&(statuses[i]<STATE2STRMAX))?state2str[statuses[i]]:"");
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: set: %s, %s\n", driverName, functionName,
+                  commands[i].c_str(),responses[i].c_str());
+        if(statuses[i] != asynSuccess)
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: set param failed: '%s' %s\n", driverName, functionName,
+                      commands[i].c_str(),(statuses[i]<STATE2STRMAX)?state2str[statuses[i]]:"Illegal status");
+        else if(responses[i] == "NACK" || responses[i] == "ERR")
             asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: set param failed: '%s' %s\n",
-                      driverName, functionName,param.c_str(),resp.c_str());
+                      driverName, functionName,commands[i].c_str(),responses[i].c_str());
+        else
+            setRange(commands[i]);
+    }
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: %d commands in %d telegrams\n", driverName, functionName,
+              (int) commands.size(), telegrams);
+    return status;
+}
+
+/** Takes the range of an analog channel from a mode command of this card,
+  * ADn.mTx or DAn.mTx, that the controller accepted
+  * \param[in] command  Configuration command
+  */
+void phytronIoCtrl::setRange(const std::string &command)
+{
+    phytronCalibration *pCal;
+    int card, channel, mode;
+    char kind[3];
+    char end;
 
+    if(sscanf(command.c_str(), "%2[ADA]%d.%dT%d%c", kind, &card, &channel, &mode, &end) != 4)
+        return;
+    if(card != this->cardNr || channel < 1 || channel > MAX_IO_CHANNELS || mode < 0 || mode >= RANGE_MODES)
+        return;
+    if(!strcmp(kind, "AD"))
+        pCal = &ainCal_[channel-1];
+    else if(!strcmp(kind, "DA"))
+        pCal = &aoutCal_[channel-1];
+    else
+        return;
+
+    pCal->mode = mode;
+    pCal->scale = ranges[mode].span / (pCal == &ainCal_[channel-1] ? AIN_FULL_SCALE : AOUT_FULL_SCALE);
+    pCal->zero = ranges[mode].zero;
+}
+
+/** Sets the calibration of an analog channel, applied after the range
+  * \param[in] reasonName  AIN or AOUT
+  * \param[in] channel     Channel 1..8
+  * \param[in] gain        Factor, 1 if uncalibrated
+  * \param[in] offset      Added after the gain
+  */
+asynStatus phytronIoCtrl::setCalibration(const char *reasonName, int channel, double gain, double offset)
+{
+    phytronCalibration *pCal;
+
+    if(channel < 1 || channel > MAX_IO_CHANNELS || gain == 0) {
+        printf("%s: invalid calibration, channel must be in range 1 to %d, gain not 0\n", driverName, MAX_IO_CHANNELS);
+        return asynError;
+    }
+    if(reasonName && !strcmp(reasonName, ainString))
+        pCal = &ainCal_[channel-1];
+    else if(reasonName && !strcmp(reasonName, aoutString))
+        pCal = &aoutCal_[channel-1];
+    else {
+        printf("%s: invalid reason '%s', must be %s or %s\n", driverName, reasonName ? reasonName : "", ainString, aoutString);
+        return asynError;
+    }
+
+    lock();
+    pCal->gain = gain;
+    pCal->offset = offset;
+    unlock();
+    return asynSuccess;
+}
+
+/** Sends commands that set parameters in as few telegrams as possible. Up to
+  * IO_BATCH_SIZE commands are sent in one telegram, separated by blanks. An
+  * acknowledge acknowledges all commands of the telegram; if it is refused or
+  * answered with a reply that does not fit, the commands of that telegram are
+  * sent one by one. Must be called with the port locked.
+  * \param[in]  commands   Commands to send
+  * \param[out] responses  Response of each command: data, "ACK", "NACK" or "ERR"
+  * \param[out] statuses   Status of each command
+  * \param[out] telegrams  Incremented by the number of telegrams sent
+  */
+asynStatus phytronIoCtrl::sendBatch(const std::vector<std::string> &commands, std::vector<std::string> &responses,
+                                    std::vector<asynStatus> &statuses, int *telegrams)
+{
+    char telegram[MAX_CONTROLLER_STRING_SIZE];
+    char data[MAX_CONTROLLER_STRING_SIZE];
+    std::vector<std::string> fields;
+    asynStatus status = asynSuccess;
+    asynStatus cmdStatus;
+    size_t response_len;
+    size_t first = 0, count, length, i;
+    int acknowledge;
+
+    responses.assign(commands.size(), "");
+    statuses.assign(commands.size(), asynSuccess);
+
+    while(first < commands.size()) {
+        //Pack as many commands as fit into one telegram
+        length = 0;
+        count = 0;
+        while(first + count < commands.size() && count < IO_BATCH_SIZE &&
+              length + commands[first + count].size() + 1 < MAX_IO_BATCH_LENGTH) {
+            if(count) telegram[length++] = ' ';
+            strcpy(telegram + length, commands[first + count].c_str());
+            length += commands[first + count].size();
+            count++;
+        }
+
+        if(count > 1) {
+            *data = 0;
+            acknowledge = 0;
+            cmdStatus = writeReadController(pController_, telegram, MAX_CONTROLLER_STRING_SIZE, data, &acknowledge, &response_len);
+            (*telegrams)++;
+            if(cmdStatus != asynSuccess && !framer_.mismatched()) {
+                //No answer at all, sending the commands one by one would only multiply the timeouts
+                for(i = 0; i < count; i++) {
+                    statuses[first + i] = cmdStatus;
+                    responses[first + i] = "ERR";
+                }
+                status = cmdStatus;
+                first += count;
+                continue;
+            }
+            if(acknowledge == 0x6) {
+                phytronSplitReply(data, fields);
+                if(fields.empty() || fields.size() == count) {
+                    for(i = 0; i < count; i++) responses[first + i] = fields.empty() ? "ACK" : fields[i];
+                    first += count;
+                    continue;
+                }
+            }
+        }
+
+        //Send one by one, either a single command or the controller refused the batch
+        if(count == 0) count = 1;
+        for(i = 0; i < count; i++) {
+            *data = 0;
+            acknowledge = 0;
+            cmdStatus = writeReadController(pController_, commands[first + i].c_str(), MAX_CONTROLLER_STRING_SIZE,
+                                            data, &acknowledge, &response_len);
+            (*telegrams)++;
+            statuses[first + i] = cmdStatus;
+            if(cmdStatus != asynSuccess) {
+                responses[first + i] = "ERR";
+                status = cmdStatus;
+            }
+            else if(acknowledge == 0x6)
+                responses[first + i] = strlen(data) ? data : "ACK";
+            else if(acknowledge == 0x15)
+                responses[first + i] = "NACK";
+            else {
+                responses[first + i] = "ERR";
+                statuses[first + i] = status = asynError;
+            }
+        }
+        first += count;
     }
     return status;
 }
 
-asynStatus phytronIoCtrl::cmd(const char *cmd, char*response, size_t MaxResponseLen)
+/** Returns true if a command only reads, a refused telegram resends such commands
+  * one by one without side effects
+  * \param[in] command  Single command, not necessarily null terminated
+  * \param[in] len      Length of the command
+  */
+bool phytronIoCtrl::isQuery(const char *command, size_t len)
 {
-    size_t nActual;
-    asynStatus status = this->writeOctet(pController_, cmd, MaxResponseLen, &nActual);
-    if(status == asynSuccess) {
-        strncpy(response,this->cmdBuf,MaxResponseLen);
+    const char *c = command;
+    size_t i;
+
+    if(len == 0 || memchr(c, ' ', len) || memchr(c, '=', len))
+        return false;
+    //Module inventory, inputs and output readbacks: IMn, ADn.m, DAn.m, EZn.m, AZn.m
+    if(len >= 2 && (!strncmp(c, "IM", 2) || !strncmp(c, "AD", 2) || !strncmp(c, "DA", 2) || !strncmp(c, "EZ", 2) || !strncmp(c, "AZ", 2))) {
+        for(i = 2; i < len; i++)
+            if(!isdigit((unsigned char) c[i]) && c[i] != '.') return false;
+        return true;
+    }
+    //Parameter and port reads: ...PnnR, EGnR, AGnR
+    if(c[len-1] != 'R')
+        return false;
+    for(i = len - 1; i > 0 && isdigit((unsigned char) c[i-1]); i--);
+    if(i == len - 1 || i == 0)
+        return false;
+    return c[i-1] == 'P' || (i == 2 && (!strncmp(c, "EG", 2) || !strncmp(c, "AG", 2)));
+}
+
+/** Queues a command for commandTask
+  * \param[in] command  Command without framing, e.g. IM1
+  * \param[in] channel  CMD channel whose next read returns the response, NULL for none
+  * \return Request ID to wait for the response with waitCommand, 0 if the command was
+  *         refused as the queue holds CMD_QUEUE_MAX requests
+  */
+int phytronIoCtrl::submitCommand(const char *command, const char *channel)
+{
+    phytronCmdRequest request;
+    int id;
+
+    request.command = command;
+    request.status = asynSuccess;
+    request.done = false;
+
+    epicsMutexMustLock(cmdMutex_);
+    if(cmdQueue_.size() >= CMD_QUEUE_MAX) {
+        epicsMutexUnlock(cmdMutex_);
+        return 0;
+    }
+    id = nextCmdId_++;
+    if(nextCmdId_ <= 0) nextCmdId_ = 1;
+    cmdRequests_[id] = request;
+    cmdQueue_.push_back(id);
+    if(channel) cmdChannels_[channel] = id;
+
+    //Forget the oldest completed requests
+    while(cmdRequests_.size() > CMD_HISTORY + cmdQueue_.size() && cmdRequests_.begin()->second.done)
+        cmdRequests_.erase(cmdRequests_.begin());
+    epicsMutexUnlock(cmdMutex_);
+
+    commandTask_->wake();
+    return id;
+}
+
+/** Waits for the response to a request, must be called with the port unlocked
+  * \param[in]  id        Request ID returned by submitCommand
+  * \param[out] response  Data, "ACK", "NACK" or "ERR"
+  * \param[in]  maxLen    Size of response
+  */
+asynStatus phytronIoCtrl::waitCommand(int id, char *response, size_t maxLen)
+{
+    std::map<int, phytronCmdRequest>::iterator it;
+    epicsTimeStamp start, now;
+    asynStatus status;
+    double timeout;
+
+    epicsTimeGetCurrent(&start);
+    epicsMutexMustLock(cmdMutex_);
+    //Requests queued before are sent first, IO_BATCH_SIZE per telegram at best
+    timeout = timeout_ * (2 + cmdQueue_.size());
+    while(1) {
+        it = cmdRequests_.find(id);
+        if(it == cmdRequests_.end()) {
+            strncpy(response, "ERR", maxLen);
+            status = asynError;   //Unknown or dropped from the history
+            break;
+        }
+        if(it->second.done) {
+            strncpy(response, it->second.response.c_str(), maxLen);
+            response[maxLen-1] = 0;
+            status = it->second.status;
+            break;
+        }
+        epicsTimeGetCurrent(&now);
+        if(epicsTimeDiffInSeconds(&now, &start) > timeout) {
+            strncpy(response, "ERR", maxLen);
+            status = asynTimeout;
+            break;
+        }
+        epicsMutexUnlock(cmdMutex_);
+        //Several clients may wait, so the event is not relied on to wake this one
+        epicsEventWaitWithTimeout(cmdDoneEventId_, 0.01);
+        epicsMutexMustLock(cmdMutex_);
     }
+    epicsMutexUnlock(cmdMutex_);
     return status;
 }
+
+/** Sends the queued commands in submission order, one telegram per run.
+  * Consecutive queries of any client share a telegram, up to IO_BATCH_SIZE;
+  * every other command is sent in a telegram of its own, as a refused telegram
+  * is resent one command by one.
+  */
+double phytronIoCtrl::commandTask()
+{
+    std::vector<std::string> commands;
+    std::vector<std::string> responses;
+    std::vector<asynStatus> statuses;
+    std::vector<int> ids;
+    std::map<int, phytronCmdRequest>::iterator it;
+    bool query;
+    bool writes = false;
+    bool more;
+    int telegrams = 0;
+    size_t i;
+
+    epicsMutexMustLock(cmdMutex_);
+    while(!cmdQueue_.empty() && ids.size() < IO_BATCH_SIZE) {
+        const std::string &command = cmdRequests_[cmdQueue_.front()].command;
+        query = isQuery(command.c_str(), command.size());
+        if(!query && !ids.empty()) break;
+        ids.push_back(cmdQueue_.front());
+        commands.push_back(command);
+        cmdQueue_.pop_front();
+        if(!query) {
+            writes = true;
+            break;
+        }
+    }
+    epicsMutexUnlock(cmdMutex_);
+    if(ids.empty())
+        return -1;
+
+    lock();
+    sendBatch(commands, responses, statuses, &telegrams);
+    if(writes)
+        shadowValid_ = false;   /* the command may have written the outputs */
+    unlock();
+
+    epicsMutexMustLock(cmdMutex_);
+    for(i = 0; i < ids.size(); i++) {
+        it = cmdRequests_.find(ids[i]);
+        if(it == cmdRequests_.end()) continue;
+        it->second.response = responses[i];
+        it->second.status = statuses[i];
+        it->second.done = true;
+    }
+    cmdTelegrams_ += telegrams;
+    cmdCompleted_ += ids.size();
+    more = !cmdQueue_.empty();
+    epicsMutexUnlock(cmdMutex_);
+    epicsEventSignal(cmdDoneEventId_);
+
+    //Queued commands are sent in the next run, at once
+    return more ? 0 : -1;
+}
+
+asynStatus phytronIoCtrl::cmd(const char *cmd, char*response, size_t MaxResponseLen)
+{
+    return waitCommand(submitCommand(cmd), response, MaxResponseLen);
+}
 /** Creates a new phytronController object.
   * Configuration command, called directly or from iocsh
   * \param[in] portName          The name of the asyn port that will be created for this driver
   * \param[in] phytronPortName   The name of the drvAsynIPPPort that was created previously to connect to the phytron controller
   * \param[in] numController     number of cards that this controller supports
+  * \param[in] busAddress        Address of the unit on the serial line, 0..15
   */
 extern "C" int phytronCreateIoCtrl(const char *phytronPortName, const char *asynPortName,
-                                   int cardNr,int timeout,const char *configStr)
+                                   int cardNr,int timeout,const char *configStr,int busAddress)
 {
-    phytronIoCtrl* controller = new phytronIoCtrl(asynPortName,phytronPortName,cardNr,timeout);
+    phytronIoCtrl* controller = new phytronIoCtrl(asynPortName,phytronPortName,cardNr,timeout,busAddress);
     if(controller != NULL){
         controller->setParam(configStr);
         return asynError;
@@ -457,17 +1526,19 @@ static const iocshArg phytronCreateIoCtrlArg1 = {"PhytronIo port name for this c
 static const iocshArg phytronCreateIoCtrlArg2 = {"Number of this IO card [1..n]", iocshArgInt};
 static const iocshArg phytronCreateIoCtrlArg3 = {"Timeout [ms]", iocshArgInt};
 static const iocshArg phytronCreateIoCtrlArg4 = {"Module configuration", iocshArgString};
+static const iocshArg phytronCreateIoCtrlArg5 = {"Bus address", iocshArgInt};
 static const iocshArg * const phytronCreateIoCtrlArgs[] = {&phytronCreateIoCtrlArg0,
                                                            &phytronCreateIoCtrlArg1,
                                                            &phytronCreateIoCtrlArg2,
                                                            &phytronCreateIoCtrlArg3,
-                                                           &phytronCreateIoCtrlArg4};
+                                                           &phytronCreateIoCtrlArg4,
+                                                           &phytronCreateIoCtrlArg5};
 
-static const iocshFuncDef phytronCreateIoCtrlDef = {"phytronCreateIoCtrl", 5, phytronCreateIoCtrlArgs};
+static const iocshFuncDef phytronCreateIoCtrlDef = {"phytronCreateIoCtrl", 6, phytronCreateIoCtrlArgs};
 
 static void phytronCreateIoCtrlCallFunc(const iocshArgBuf *args)
 {
-  phytronCreateIoCtrl(args[0].sval, args[1].sval, args[2].ival, args[3].ival, args[4].sval);
+  phytronCreateIoCtrl(args[0].sval, args[1].sval, args[2].ival, args[3].ival, args[4].sval, args[5].ival);
 }
 
 /** Parameters for iocsh phytron controller registration */
@@ -479,6 +1550,7 @@ static const iocshFuncDef phytronReportDef = {"phyreport", 1, phytronReportArgs}
 static void phytronReport(const iocshArgBuf *args)
 {
     int i;
+    int ids[16];
     char cmd[MAX_CONTROLLER_STRING_SIZE];
     asynStatus status;
     phytronIoCtrl* controller = findController(args[0].sval);
@@ -486,10 +1558,14 @@ static void phytronReport(const iocshArgBuf *args)
         printf("Cann't find controller '%s'\n",args[0].sval);
         return;
     }
-    printf("phyMotion Device\nslot nr\t| card type:\n");
+    //All queries are submitted at once to share telegrams
     for(i=1;i<=16;i++) {
         sprintf(cmd,"IM%d",i);
-        status = controller->cmd(cmd,cmd,MAX_CONTROLLER_STRING_SIZE);
+        ids[i-1] = controller->submitCommand(cmd);
+    }
+    printf("phyMotion Device\nslot nr\t| card type:\n");
+    for(i=1;i<=16;i++) {
+        status = controller->waitCommand(ids[i-1],cmd,MAX_CONTROLLER_STRING_SIZE);
         if(status == asynSuccess)
             printf("  %d\t| %s\n", i, cmd);
         else
@@ -526,11 +1602,158 @@ static void phycmd(const iocshArgBuf *args)
 }
 
 
+/** Parameters for iocsh phytron IO configuration file */
+static const iocshArg phytronIoApplyConfigArg0 = {"Port", iocshArgString};
+static const iocshArg phytronIoApplyConfigArg1 = {"Configuration file", iocshArgString};
+static const iocshArg * const phytronIoApplyConfigArgs[] = {&phytronIoApplyConfigArg0,&phytronIoApplyConfigArg1};
+
+static const iocshFuncDef phytronIoApplyConfigDef = {"phytronIoApplyConfig", 2, phytronIoApplyConfigArgs};
+
+static void phytronIoApplyConfig(const iocshArgBuf *args)
+{
+    std::vector<std::string> commands;
+    phytronIoCtrl* controller = findController(args[0].sval);
+    if(controller == NULL){
+        printf("Cann't find controller '%s'\n",args[0].sval);
+        return;
+    }
+    if(phytronReadConfigFile(args[1].sval, commands)) {
+        printf("ERROR cannot read '%s'\n",args[1].sval);
+        return;
+    }
+    controller->applyConfig(commands, 1);
+}
+
+static const iocshArg phytronIoSetCoalescingArg0 = {"Port", iocshArgString};
+static const iocshArg phytronIoSetCoalescingArg1 = {"Flush interval [ms]", iocshArgDouble};
+static const iocshArg * const phytronIoSetCoalescingArgs[] = {&phytronIoSetCoalescingArg0,&phytronIoSetCoalescingArg1};
+
+static const iocshFuncDef phytronIoSetCoalescingDef = {"phytronIoSetCoalescing", 2, phytronIoSetCoalescingArgs};
+
+static void phytronIoSetCoalescing(const iocshArgBuf *args)
+{
+    phytronIoCtrl* controller = findController(args[0].sval);
+    if(controller == NULL){
+        printf("Cann't find controller '%s'\n",args[0].sval);
+        return;
+    }
+    controller->setCoalescing(args[1].dval/1000);
+}
+
+static const iocshArg phytronIoSubmitArg0 = {"Port", iocshArgString};
+static const iocshArg phytronIoSubmitArg1 = {"Command", iocshArgString};
+static const iocshArg * const phytronIoSubmitArgs[] = {&phytronIoSubmitArg0,&phytronIoSubmitArg1};
+
+static const iocshFuncDef phytronIoSubmitDef = {"phytronIoSubmit", 2, phytronIoSubmitArgs};
+
+static void phytronIoSubmit(const iocshArgBuf *args)
+{
+    phytronIoCtrl* controller = findController(args[0].sval);
+    if(controller == NULL){
+        printf("Cann't find controller '%s'\n",args[0].sval);
+        return;
+    }
+    if(!args[1].sval || strlen(args[1].sval) == 0 || strlen(args[1].sval) >= MAX_CONTROLLER_STRING_SIZE) {
+        printf("ERROR illegal input\n");
+        return;
+    }
+    int id = controller->submitCommand(args[1].sval);
+    if(!id)
+        printf("ERROR queue full\n");
+    else
+        printf("%d\n", id);
+}
+
+static const iocshArg phytronIoResultArg0 = {"Port", iocshArgString};
+static const iocshArg phytronIoResultArg1 = {"Request ID", iocshArgInt};
+static const iocshArg * const phytronIoResultArgs[] = {&phytronIoResultArg0,&phytronIoResultArg1};
+
+static const iocshFuncDef phytronIoResultDef = {"phytronIoResult", 2, phytronIoResultArgs};
+
+static void phytronIoResult(const iocshArgBuf *args)
+{
+    char response[MAX_CONTROLLER_STRING_SIZE];
+    asynStatus status;
+    phytronIoCtrl* controller = findController(args[0].sval);
+    if(controller == NULL){
+        printf("Cann't find controller '%s'\n",args[0].sval);
+        return;
+    }
+    status = controller->waitCommand(args[1].ival, response, MAX_CONTROLLER_STRING_SIZE);
+    if(status == asynSuccess)
+        printf("%s\n", response);
+    else
+        printf("ERROR status: '%s' (%d)\n", (status<STATE2STRMAX)?state2str[status]:"Illegal status",status);
+}
+
+static const iocshArg phytronIoSetOversamplingArg0 = {"Port", iocshArgString};
+static const iocshArg phytronIoSetOversamplingArg1 = {"Channels, e.g. 1,2,4", iocshArgString};
+static const iocshArg phytronIoSetOversamplingArg2 = {"Sample period [ms]", iocshArgDouble};
+static const iocshArg phytronIoSetOversamplingArg3 = {"Samples per statistics", iocshArgInt};
+static const iocshArg * const phytronIoSetOversamplingArgs[] = {&phytronIoSetOversamplingArg0,&phytronIoSetOversamplingArg1,
+                                                                &phytronIoSetOversamplingArg2,&phytronIoSetOversamplingArg3};
+
+static const iocshFuncDef phytronIoSetOversamplingDef = {"phytronIoSetOversampling", 4, phytronIoSetOversamplingArgs};
+
+static void phytronIoSetOversampling(const iocshArgBuf *args)
+{
+    phytronIoCtrl* controller = findController(args[0].sval);
+    if(controller == NULL){
+        printf("Cann't find controller '%s'\n",args[0].sval);
+        return;
+    }
+    controller->setOversampling(args[1].sval, args[2].dval/1000, args[3].ival);
+}
+
+static const iocshArg phytronIoSetEdgeCaptureArg0 = {"Port", iocshArgString};
+static const iocshArg phytronIoSetEdgeCaptureArg1 = {"Poll period [ms]", iocshArgDouble};
+static const iocshArg * const phytronIoSetEdgeCaptureArgs[] = {&phytronIoSetEdgeCaptureArg0,&phytronIoSetEdgeCaptureArg1};
+
+static const iocshFuncDef phytronIoSetEdgeCaptureDef = {"phytronIoSetEdgeCapture", 2, phytronIoSetEdgeCaptureArgs};
+
+static void phytronIoSetEdgeCapture(const iocshArgBuf *args)
+{
+    phytronIoCtrl* controller = findController(args[0].sval);
+    if(controller == NULL){
+        printf("Cann't find controller '%s'\n",args[0].sval);
+        return;
+    }
+    controller->setEdgeCapture(args[1].dval/1000);
+}
+
+static const iocshArg phytronIoSetCalibrationArg0 = {"Port", iocshArgString};
+static const iocshArg phytronIoSetCalibrationArg1 = {"AIN or AOUT", iocshArgString};
+static const iocshArg phytronIoSetCalibrationArg2 = {"Channel", iocshArgInt};
+static const iocshArg phytronIoSetCalibrationArg3 = {"Gain", iocshArgDouble};
+static const iocshArg phytronIoSetCalibrationArg4 = {"Offset", iocshArgDouble};
+static const iocshArg * const phytronIoSetCalibrationArgs[] = {&phytronIoSetCalibrationArg0,&phytronIoSetCalibrationArg1,
+                                                               &phytronIoSetCalibrationArg2,&phytronIoSetCalibrationArg3,
+                                                               &phytronIoSetCalibrationArg4};
+
+static const iocshFuncDef phytronIoSetCalibrationDef = {"phytronIoSetCalibration", 5, phytronIoSetCalibrationArgs};
+
+static void phytronIoSetCalibration(const iocshArgBuf *args)
+{
+    phytronIoCtrl* controller = findController(args[0].sval);
+    if(controller == NULL){
+        printf("Cann't find controller '%s'\n",args[0].sval);
+        return;
+    }
+    controller->setCalibration(args[1].sval, args[2].ival, args[3].dval, args[4].dval);
+}
+
 static void phytronIoRegister(void)
 {
     iocshRegister(&phytronCreateIoCtrlDef, phytronCreateIoCtrlCallFunc);
     iocshRegister(&phytronReportDef, phytronReport);
     iocshRegister(&phycmdDef, phycmd);
+    iocshRegister(&phytronIoApplyConfigDef, phytronIoApplyConfig);
+    iocshRegister(&phytronIoSetCoalescingDef, phytronIoSetCoalescing);
+    iocshRegister(&phytronIoSubmitDef, phytronIoSubmit);
+    iocshRegister(&phytronIoResultDef, phytronIoResult);
+    iocshRegister(&phytronIoSetOversamplingDef, phytronIoSetOversampling);
+    iocshRegister(&phytronIoSetEdgeCaptureDef, phytronIoSetEdgeCapture);
+    iocshRegister(&phytronIoSetCalibrationDef, phytronIoSetCalibration);
 }
 
 extern "C" {
@@ -18,16 +18,33 @@
 #ifndef phytronIoCtrl_H
 #define phytronIoCtrl_H
 
+#include <deque>
+#include <map>
 #include <string>
+#include <vector>
 #include <epicsTypes.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
 
 #ifdef __cplusplus
 #include <asynPortDriver.h>
+#include "phytronTelegramLog.h"
+#include "phytronBus.h"
+#include "phytronFrame.h"
+#include "phytronPool.h"
 
 #define MAX_CONTROLLER_STRING_SIZE 256
 #define DEFAULT_CONTROLLER_TIMEOUT 2.0
+#define IO_BATCH_SIZE 10            //Maximum number of configuration commands per telegram
+#define MAX_IO_BATCH_LENGTH 200
+#define CMD_HISTORY 256             //Completed CMD requests kept for waitCommand
+#define CMD_QUEUE_MAX 256           //Requests queued at most, further ones are refused
+#define MAX_IO_CHANNELS 8           //Channels 1..8 of a card, asyn addresses 1..8
+#define EDGE_LOG_SIZE 256           //Digital input edges kept in the event log
+#define AIN_FULL_SCALE  8191.0      //Counts of a full scale analog input
+#define AOUT_FULL_SCALE 32768.0     //Counts of a full scale analog output
 
-#define NUM_PHYIO_PARAMS 5
+#define NUM_PHYIO_PARAMS 21
 #define dInString            "DIN"
 #define ainString            "AIN"
 
@@ -35,25 +52,120 @@
 #define aoutString           "AOUT"
 #define cmdString            "CMD"
 
+/* Statistics of oversampled analog inputs, per channel and as arrays indexed by channel-1 */
+#define ainMeanString        "AIN_MEAN"
+#define ainMinString         "AIN_MIN"
+#define ainMaxString         "AIN_MAX"
+#define ainSdevString        "AIN_SDEV"
+#define ainMeanArrayString   "AIN_MEAN_ARRAY"
+#define ainMinArrayString    "AIN_MIN_ARRAY"
+#define ainMaxArrayString    "AIN_MAX_ARRAY"
+#define ainSdevArrayString   "AIN_SDEV_ARRAY"
+#define ainArrayString       "AIN_ARRAY"        /* All analog inputs, read in one telegram */
+
+/* Edges of the digital inputs: counters per bit, the event log as arrays at address 0 */
+#define edgeRisesString      "EDGE_RISES"
+#define edgeFallsString      "EDGE_FALLS"
+#define edgeCountString      "EDGE_COUNT"
+#define edgeBitArrayString   "EDGE_BIT_ARRAY"
+#define edgeDirArrayString   "EDGE_DIR_ARRAY"
+#define edgeTimeArrayString  "EDGE_TIME_ARRAY"
+#define edgeResetString      "EDGE_RESET"
+
+/* Command submitted to the CMD channel */
+typedef struct {
+    std::string command;
+    std::string response;   /* Data, "ACK", "NACK" or "ERR" */
+    asynStatus status;
+    bool done;
+} phytronCmdRequest;
+
+/* Samples of an analog input accumulated since the last statistics */
+typedef struct {
+    double sum;
+    double sumSq;
+    epicsInt32 min;
+    epicsInt32 max;
+    int n;
+} phytronAinAccu;
+
+/* Conversion of an analog channel: value = (counts*scale + zero)*gain + offset,
+ * scale and zero follow from the T mode, gain and offset from the calibration */
+typedef struct {
+    int mode;               /* T mode set by the configuration, -1 if unknown: counts are passed */
+    double scale;
+    double zero;
+    double gain;
+    double offset;
+} phytronCalibration;
+
+/* Edge of a digital input */
+typedef struct {
+    epicsInt32 bit;         /* 1..32 */
+    epicsInt32 rising;      /* 1 rising, 0 falling */
+    epicsFloat64 time;      /* Time of the poll that saw the edge, s since the EPICS epoch */
+} phytronEdge;
+
 class phytronIoCtrl : public asynPortDriver {
 public:
-    phytronIoCtrl(const char *portName, const char *asynPortName, int numCards,int timeout);
+    phytronIoCtrl(const char *portName, const char *asynPortName, int numCards,int timeout,int busAddress=0);
     virtual ~phytronIoCtrl();
     virtual asynStatus readInt32(asynUser *pasynUser, epicsInt32 *value);
     virtual asynStatus readOctet(asynUser *pasynUser, char *value, size_t maxChars,size_t *nActual, int *eomReason);
     virtual asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
     virtual asynStatus writeOctet(asynUser *pasynUser, const char *value, size_t maxChars,size_t *nActual);
+    virtual asynStatus readFloat64(asynUser *pasynUser, epicsFloat64 *value);
+    virtual asynStatus writeFloat64(asynUser *pasynUser, epicsFloat64 value);
+    virtual asynStatus readInt32Array(asynUser *pasynUser, epicsInt32 *value, size_t nElements, size_t *nIn);
+    virtual asynStatus readFloat64Array(asynUser *pasynUser, epicsFloat64 *value, size_t nElements, size_t *nIn);
+    virtual asynStatus drvUserCreate(asynUser *pasynUser, const char *drvInfo, const char **pptypeName, size_t *psize);
+    virtual asynStatus drvUserDestroy(asynUser *pasynUser);
     virtual void       report(FILE *fp, int level);
-    char *getCmdBuf() {return cmdBuf;}
     char *getControllerName() {return controllerName_;}
 
     /* Functions for direct controller access, work with the first created port */
     asynStatus cmd(const char *cmd, char*response, size_t MaxResponseLen) ;
     asynStatus setParam(const char *paramStr, int dbg=0);
+    asynStatus applyConfig(const std::vector<std::string> &commands, int dbg=0);
+
+    /* Coalescing of DOUT/AOUT writes */
+    void setCoalescing(double interval);
+    asynStatus flushOutputs();
+    double coalesceTask();
+
+    /* Command channel shared by CMD records, phycmd and scripts */
+    int submitCommand(const char *command, const char *channel=NULL);
+    asynStatus waitCommand(int id, char *response, size_t maxLen);
+    double commandTask();
+    static bool isQuery(const char *command, size_t len);
+
+    /* Oversampled acquisition of analog inputs */
+    asynStatus setOversampling(const char *channels, double period, int decimation);
+    double sampleTask();
+
+    /* Edge capture of the digital inputs */
+    void setEdgeCapture(double period);
+    double edgeTask();
+
+    /* Conversion of analog values to engineering units */
+    asynStatus setCalibration(const char *reasonName, int channel, double gain, double offset);
 private:
+    void setRange(const std::string &command);
+    double toUnits(const phytronCalibration *pCal, double counts) {return (counts*pCal->scale + pCal->zero)*pCal->gain + pCal->offset;}
+
+    void pollEdges();
+    void publishEdges();
+    void resetEdges();
+    size_t copyEdges(int field, void *value, size_t nElements);
+
+    void sampleInputs();
+    void publishStatistics();
+
     /* These are convenience functions for controllers that use asynOctet interfaces to the hardware */
     asynStatus writeController(const char *output, double timeout);
     asynStatus writeReadController(asynUser *pasynUser, const char *value, size_t maxChars,char *data, int *acknowledge, size_t *response_len);
+    asynStatus sendBatch(const std::vector<std::string> &commands, std::vector<std::string> &responses,
+                         std::vector<asynStatus> &statuses, int *telegrams);
     int cardNr;
     char * controllerName_;
 
@@ -66,13 +178,81 @@ private:
     int aout_;
 
     int cmd_;
-    char cmdBuf[MAX_CONTROLLER_STRING_SIZE]; // store last response of stringout writeRead
+    epicsMutexId cmdMutex_;         /* Guards the command requests, never held with the port locked */
+    phytronTask *commandTask_;
+    epicsEventId cmdDoneEventId_;   /* Signalled when requests completed */
+    int nextCmdId_;
+    std::deque<int> cmdQueue_;                        /* Requests not sent yet */
+    std::map<int, phytronCmdRequest> cmdRequests_;    /* Queued and the last CMD_HISTORY completed requests */
+    std::map<std::string, int> cmdChannels_;          /* Last request of each CMD:<channel> */
+    unsigned long cmdTelegrams_;
+    unsigned long cmdCompleted_;
 
     double timeout_;
     asynStatus lastStatus;
+
+    phytronTelegramLog *telegramLog_;
+    phytronFramer framer_;
+    char busAddress_;       /* Address character of the unit on the serial line */
+    phytronBus *bus_;
+    int busUnit_;
+
+    double coalesceInterval_;       /* Flush interval of output writes in s, 0 sends them immediately */
+    phytronTask *coalesceTask_;
+    epicsUInt32 bitsSet_;           /* DOUT bits written 1 since the last flush */
+    epicsUInt32 bitsCleared_;       /* DOUT bits written 0 since the last flush */
+    bool portPending_;              /* A DOUT port write is pending in portValue_ */
+    epicsInt32 portValue_;
+    bool shadowValid_;              /* portShadow_ holds the DOUT port value last written or read */
+    epicsInt32 portShadow_;
+    std::map<int, epicsInt32> aoutPending_;  /* Latest AOUT value per channel */
+    unsigned long coalescedWrites_;
+    unsigned long flushTelegrams_;
+
+    int ainMean_;
+    int ainMin_;
+    int ainMax_;
+    int ainSdev_;
+    int ainMeanArray_;
+    int ainMinArray_;
+    int ainMaxArray_;
+    int ainSdevArray_;
+    int ainArray_;
+    phytronCalibration ainCal_[MAX_IO_CHANNELS];
+    phytronCalibration aoutCal_[MAX_IO_CHANNELS];
+    double samplePeriod_;           /* Sample period of the oversampled inputs in s, 0 stops sampling */
+    int decimation_;                /* Samples per published statistics */
+    int blockSamples_;              /* Samples taken since the last statistics */
+    std::vector<int> sampleChannels_;
+    phytronAinAccu accu_[MAX_IO_CHANNELS];
+    epicsFloat64 ainStats_[4][MAX_IO_CHANNELS];   /* Last mean, min, max and sdev of each channel */
+    phytronTask *sampleTask_;
+    unsigned long samples_;
+    unsigned long sampleTelegrams_;
+    unsigned long sampleErrors_;
+
+    int edgeRises_;
+    int edgeFalls_;
+    int edgeCount_;
+    int edgeBitArray_;
+    int edgeDirArray_;
+    int edgeTimeArray_;
+    int edgeReset_;
+    double edgePeriod_;             /* Poll period of the digital inputs in s, 0 stops edge capture */
+    phytronTask *edgeTask_;
+    bool inputsValid_;              /* inputs_ holds the input word of the last poll */
+    epicsUInt32 inputs_;
+    phytronEdge edgeLog_[EDGE_LOG_SIZE];    /* Ring, edge n is at n % EDGE_LOG_SIZE */
+    unsigned long edges_;           /* Edges since the last reset */
+    epicsInt32 rises_[MAX_IO_CHANNELS];
+    epicsInt32 falls_[MAX_IO_CHANNELS];
+    unsigned long edgePolls_;
+    unsigned long edgeErrors_;
 };
 
 phytronIoCtrl* findController(const char *portName);
+extern "C" int phytronCreateIoCtrl(const char *phytronPortName, const char *asynPortName,
+                                   int cardNr,int timeout,const char *configStr,int busAddress);
 
 #endif /* _cplusplus */
 #endif /*  */
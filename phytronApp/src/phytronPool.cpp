@@ -0,0 +1,298 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+
+#include <epicsAtomic.h>
+#include <epicsThread.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+#include "phytronPool.h"
+
+/* The pool, NULL while every task has a thread of its own */
+static phytronPool *pool = NULL;
+
+size_t phytronPool::ownThreads_ = 0;
+
+phytronTask::phytronTask(const char *name, phytronTaskFunc func, void *pvt, unsigned int priority, bool pooled)
+  : name_(name), func_(func), pvt_(pvt), priority_(priority), pooled_(pooled), started_(false), pool_(NULL),
+    waiting_(false), running_(false), woken_(false), runs_(0)
+{
+  mutex_ = epicsMutexMustCreate();
+  event_ = epicsEventMustCreate(epicsEventEmpty);
+  epicsTimeGetCurrent(&due_);
+}
+
+/** Runs the task as soon as possible, starting it if it was not started yet */
+void phytronTask::wake()
+{
+  phytronPool *pPool;
+
+  //The task is started and added to the pool before another wake can see started_
+  epicsMutexMustLock(mutex_);
+  if(!started_){
+    started_ = true;
+    pool_ = pooled_ ? phytronPool::get() : NULL;
+    if(pool_){
+      pool_->add(this);
+    } else {
+      epicsAtomicIncrSizeT(&phytronPool::ownThreads_);
+      epicsThreadCreate(name_.c_str(), priority_, epicsThreadGetStackSize(epicsThreadStackMedium),
+                        (EPICSTHREADFUNC)threadC, this);
+    }
+    epicsMutexUnlock(mutex_);
+    return;
+  }
+  pPool = pool_;
+  epicsMutexUnlock(mutex_);
+
+  if(pPool) pPool->wake(this);
+  else      epicsEventSignal(event_);
+}
+
+/** Returns true once the task was started by its first wake */
+bool phytronTask::started()
+{
+  bool started;
+
+  epicsMutexMustLock(mutex_);
+  started = started_;
+  epicsMutexUnlock(mutex_);
+  return started;
+}
+
+void phytronTask::threadC(void *pvt)
+{
+  ((phytronTask *) pvt)->thread();
+}
+
+void phytronTask::thread()
+{
+  double delay;
+
+  while(1){
+    delay = func_(pvt_);
+    runs_++;
+    if(delay < 0) epicsEventWait(event_);
+    else          epicsEventWaitWithTimeout(event_, delay);
+  }
+}
+
+phytronPool::phytronPool(int threads)
+  : next_(0), threads_(threads), busy_(0), wakeups_(0), runs_(0)
+{
+  char name[20];
+
+  mutex_ = epicsMutexMustCreate();
+  work_ = epicsEventMustCreate(epicsEventEmpty);
+  for(int i = 0; i < threads; i++){
+    sprintf(name, "phytronWorker%d", i);
+    epicsThreadCreate(name, epicsThreadPriorityMedium, epicsThreadGetStackSize(epicsThreadStackMedium),
+                      (EPICSTHREADFUNC)workerC, this);
+  }
+}
+
+/** Returns the pool, NULL if none was configured */
+phytronPool* phytronPool::get()
+{
+  return pool;
+}
+
+/** Creates the pool; tasks started afterwards run in it
+  * \param[in] threads  Number of worker threads
+  */
+int phytronPool::configure(int threads)
+{
+  if(pool){
+    printf("ERROR: phytronSetWorkerPool: The pool exists with %d threads\n", pool->threads_);
+    return -1;
+  }
+  if(threads < 1 || threads > MAX_POOL_THREADS){
+    printf("ERROR: phytronSetWorkerPool: Number of threads must be in range 1 to %d\n", MAX_POOL_THREADS);
+    return -1;
+  }
+  pool = new phytronPool(threads);
+  return 0;
+}
+
+/** Adds a task which is due at once */
+void phytronPool::add(phytronTask *task)
+{
+  epicsMutexMustLock(mutex_);
+  epicsTimeGetCurrent(&task->due_);
+  tasks_.push_back(task);
+  epicsMutexUnlock(mutex_);
+  epicsEventSignal(work_);
+}
+
+/** Makes a task due at once */
+void phytronPool::wake(phytronTask *task)
+{
+  epicsMutexMustLock(mutex_);
+  epicsTimeGetCurrent(&task->due_);
+  task->waiting_ = false;
+  if(task->running_) task->woken_ = true;
+  epicsMutexUnlock(mutex_);
+  epicsEventSignal(work_);
+}
+
+void phytronPool::workerC(void *pvt)
+{
+  ((phytronPool *) pvt)->worker();
+}
+
+void phytronPool::worker()
+{
+  phytronTask *task;
+  epicsTimeStamp now;
+  double delay, wait;
+  size_t i, n;
+
+  epicsMutexMustLock(mutex_);
+  while(1){
+    //Next due task, round robin
+    task = NULL;
+    wait = POOL_IDLE_WAIT;
+    epicsTimeGetCurrent(&now);
+    n = tasks_.size();
+    for(i = 0; i < n; i++){
+      phytronTask *candidate = tasks_[(next_ + i) % n];
+      if(candidate->running_ || candidate->waiting_) continue;
+      delay = epicsTimeDiffInSeconds(&candidate->due_, &now);
+      if(delay <= 0){
+        task = candidate;
+        next_ = (next_ + i + 1) % n;
+        break;
+      }
+      if(delay < wait) wait = delay;
+    }
+
+    if(!task){
+      epicsMutexUnlock(mutex_);
+      epicsEventWaitWithTimeout(work_, wait);
+      epicsMutexMustLock(mutex_);
+      wakeups_++;
+      continue;
+    }
+
+    task->running_ = true;
+    busy_++;
+    epicsMutexUnlock(mutex_);
+    delay = task->func_(task->pvt_);
+    epicsMutexMustLock(mutex_);
+    busy_--;
+    task->running_ = false;
+    task->runs_++;
+    runs_++;
+
+    epicsTimeGetCurrent(&task->due_);
+    if(task->woken_)
+      task->woken_ = false;
+    else if(delay < 0)
+      task->waiting_ = true;
+    else
+      epicsTimeAddSeconds(&task->due_, delay);
+    //Another worker may be sleeping while this task or one skipped meanwhile is due
+    if(busy_ < threads_) epicsEventSignal(work_);
+  }
+}
+
+/* Threads and context switches of the whole IOC, Linux only */
+static void reportProcess(FILE *fp)
+{
+#ifdef __linux__
+  char line[128];
+  FILE *status = fopen("/proc/self/status", "r");
+
+  if(!status) return;
+  while(fgets(line, sizeof(line), status)){
+    if(!strncmp(line, "Threads:", 8) || strstr(line, "ctxt_switches:")) fprintf(fp, "  IOC %s", line);
+  }
+  fclose(status);
+#endif
+}
+
+/** Prints the workers, tasks and runs
+  * \param[in] fp     Output
+  * \param[in] level  > 0 prints every task
+  */
+void phytronPool::report(FILE *fp, int level)
+{
+  epicsMutexMustLock(mutex_);
+  fprintf(fp, "Worker pool: %d threads, %d busy, %d tasks, %lu runs, %lu worker wakeups\n",
+          threads_, busy_, (int) tasks_.size(), runs_, wakeups_);
+  if(level > 0){
+    for(size_t i = 0; i < tasks_.size(); i++)
+      fprintf(fp, "  %-20s %lu runs%s%s\n", tasks_[i]->name_.c_str(), tasks_[i]->runs_,
+              tasks_[i]->running_ ? ", running" : "", tasks_[i]->waiting_ ? ", sleeping" : "");
+  }
+  epicsMutexUnlock(mutex_);
+}
+
+/** Creates the worker pool. Background tasks of controllers and IO ports
+  * created afterwards run in the pool instead of on threads of their own.
+  * Configuration command, called directly or from iocsh
+  * \param[in] threads  Number of worker threads
+  */
+extern "C" int phytronSetWorkerPool(int threads)
+{
+  return phytronPool::configure(threads);
+}
+
+/** Prints the worker pool, the threads of tasks outside it and the threads
+  * and context switches of the IOC
+  * Configuration command, called directly or from iocsh
+  * \param[in] level  > 0 prints every task of the pool
+  */
+extern "C" int phytronPoolReport(int level)
+{
+  if(pool) pool->report(stdout, level);
+  else     printf("No worker pool\n");
+  printf("  %lu tasks on threads of their own\n", (unsigned long) epicsAtomicGetSizeT(&phytronPool::ownThreads_));
+  printf("  Not pooled: the poller and the asyn port thread of every controller and IO port\n");
+  reportProcess(stdout);
+  return 0;
+}
+
+/** Parameters for iocsh pool commands */
+static const iocshArg phytronSetWorkerPoolArg0 = {"Number of threads", iocshArgInt};
+static const iocshArg * const phytronSetWorkerPoolArgs[] = {&phytronSetWorkerPoolArg0};
+static const iocshArg phytronPoolReportArg0 = {"Level", iocshArgInt};
+static const iocshArg * const phytronPoolReportArgs[] = {&phytronPoolReportArg0};
+
+static const iocshFuncDef phytronSetWorkerPoolDef = {"phytronSetWorkerPool", 1, phytronSetWorkerPoolArgs};
+static const iocshFuncDef phytronPoolReportDef = {"phytronPoolReport", 1, phytronPoolReportArgs};
+
+static void phytronSetWorkerPoolCallFunc(const iocshArgBuf *args)
+{
+  phytronSetWorkerPool(args[0].ival);
+}
+
+static void phytronPoolReportCallFunc(const iocshArgBuf *args)
+{
+  phytronPoolReport(args[0].ival);
+}
+
+static void phytronPoolRegister(void)
+{
+  iocshRegister(&phytronSetWorkerPoolDef, phytronSetWorkerPoolCallFunc);
+  iocshRegister(&phytronPoolReportDef, phytronPoolReportCallFunc);
+}
+
+extern "C" {
+epicsExportRegistrar(phytronPoolRegister);
+}
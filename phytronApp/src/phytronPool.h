@@ -0,0 +1,106 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+#ifndef phytronPool_H
+#define phytronPool_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <epicsTime.h>
+
+#define MAX_POOL_THREADS 16
+#define POOL_IDLE_WAIT   1.0   //s a worker sleeps at most while no task is due
+
+/* One run of a background task. Returns the time in s until the next run, or
+ * a negative value to sleep until the task is woken. */
+typedef double (*phytronTaskFunc)(void *pvt);
+
+class phytronPool;
+
+/** Background task of a controller or IO port (snapshot, health monitor,
+  * output coalescing, ...). The task runs on a thread of its own, or in the
+  * worker pool if phytronSetWorkerPool was called before it was started. It is
+  * started by its first wake; concurrent first wakes start it once, guarded by
+  * mutex_. Latency critical tasks are created with pooled false and always get
+  * a thread of their own, so they never wait for a worker.
+  */
+class phytronTask {
+public:
+  phytronTask(const char *name, phytronTaskFunc func, void *pvt, unsigned int priority, bool pooled = true);
+
+  void wake();
+  bool started();
+
+private:
+  static void threadC(void *pvt);
+  void thread();
+
+  std::string name_;
+  phytronTaskFunc func_;
+  void *pvt_;
+  unsigned int priority_;
+  bool pooled_;             //May run in the pool
+  epicsMutexId mutex_;      //Guards started_ and pool_
+  bool started_;
+  epicsEventId event_;      //Wakes the own thread
+  phytronPool *pool_;       //NULL if the task has its own thread
+
+  //State in the pool, guarded by the pool mutex
+  epicsTimeStamp due_;      //Time of the next run
+  bool waiting_;            //Sleeps until woken
+  bool running_;
+  bool woken_;              //Woken while running, runs again at once
+  unsigned long runs_;
+
+friend class phytronPool;
+};
+
+/** Fixed set of worker threads that runs the background tasks of all
+  * controllers and IO ports. A free worker runs the next task that is due,
+  * searching round robin from the task after the one run last, so tasks of
+  * all controllers get their turn however many are due. A task never runs on
+  * two workers at once.
+  */
+class phytronPool {
+public:
+  static phytronPool *get();
+  static int configure(int threads);
+
+  void add(phytronTask *task);
+  void wake(phytronTask *task);
+  void report(FILE *fp, int level);
+
+  static size_t ownThreads_;          //Tasks started on threads of their own
+
+private:
+  phytronPool(int threads);
+  static void workerC(void *pvt);
+  void worker();
+
+  epicsMutexId mutex_;
+  epicsEventId work_;                 //A task became due
+  std::vector<phytronTask*> tasks_;
+  size_t next_;                       //Round robin start of the search for a due task
+  int threads_;
+  int busy_;                          //Workers running a task
+  unsigned long wakeups_;             //Worker wakeups, each one a context switch
+  unsigned long runs_;
+};
+
+#endif /* phytronPool_H */
@@ -0,0 +1,178 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "phytronRtt.h"
+
+static const char *commandClassNames[COMMAND_CLASSES] = {"read", "write", "slow"};
+
+phytronRtt::phytronRtt()
+  : staticTimeout_(1.0), minTimeout_(0), retries_(0)
+{
+  mutex_ = epicsMutexMustCreate();
+  memset(stats_, 0, sizeof(stats_));
+}
+
+/** Returns true if a single command only reads
+  * \param[in] command  Command, not necessarily null terminated
+  * \param[in] len      Length of the command
+  */
+bool phytronRtt::isRead(const char *command, size_t len)
+{
+  const char *body = command;
+  size_t bodyLen;
+
+  if(len == 2 && !strncmp(command, "ST", 2)) return true;
+
+  //Skip the axis, e.g. M1.1
+  if(*body == 'M'){
+    body++;
+    while(body < command + len && (isdigit((unsigned char) *body) || *body == '.')) body++;
+  }
+  bodyLen = len - (body - command);
+
+  if(bodyLen == 3 && !strncmp(body, "==H", 3)) return true;
+  if(bodyLen == 2 && !strncmp(body, "SE", 2)) return true;
+  if(bodyLen >= 3 && body[0] == 'P' && body[bodyLen-1] == 'R'){
+    for(size_t i = 1; i < bodyLen - 1; i++){
+      if(!isdigit((unsigned char) body[i])) return false;
+    }
+    return true;
+  }
+  return false;
+}
+
+/** Returns the class of a command, commandRead only if all commands of a batch read
+  * \param[in] command  Command or blank separated commands, without STX and address
+  */
+phytronCommandClass phytronRtt::classify(const char *command)
+{
+  phytronCommandClass commandClass = commandRead;
+  const char *end;
+  size_t len;
+
+  while(*command){
+    while(*command == ' ') command++;
+    if(!*command) break;
+    end = strchr(command, ' ');
+    len = end ? (size_t) (end - command) : strlen(command);
+
+    if(len == 2 && !strncmp(command, "CR", 2)) return commandSlow;
+    if(!isRead(command, len)) commandClass = commandWrite;
+
+    command += len;
+  }
+  return commandClass;
+}
+
+/** Sets the bounds of the timeouts
+  * \param[in] staticTimeout  Timeout of slow commands and upper bound in s
+  * \param[in] minTimeout     Lower bound in s, 0 disables the adaptive timeouts
+  * \param[in] retries        Retries of reads after a timeout
+  */
+void phytronRtt::configure(double staticTimeout, double minTimeout, int retries)
+{
+  epicsMutexMustLock(mutex_);
+  staticTimeout_ = staticTimeout;
+  minTimeout_ = minTimeout > 0 ? minTimeout : 0;
+  retries_ = retries > 0 ? retries : 0;
+  epicsMutexUnlock(mutex_);
+}
+
+/** Returns the timeout of the next command of a class in s
+  * \param[in] commandClass  Class of the command
+  * \param[in] wireTime      Time the request and the expected reply take on the line in s
+  */
+double phytronRtt::timeout(phytronCommandClass commandClass, double wireTime)
+{
+  phytronRttStats *pStats = &stats_[commandClass];
+  double timeout;
+
+  epicsMutexMustLock(mutex_);
+  if(commandClass == commandSlow || minTimeout_ <= 0 || pStats->samples < RTT_MIN_SAMPLES){
+    timeout = staticTimeout_;
+  } else {
+    timeout = (pStats->srtt + 4*pStats->rttvar)*(1 << pStats->backoff) + wireTime;
+    if(timeout < minTimeout_) timeout = minTimeout_;
+    if(timeout > staticTimeout_) timeout = staticTimeout_;
+  }
+  epicsMutexUnlock(mutex_);
+
+  return timeout;
+}
+
+/** Returns the number of retries of a command of a class after a timeout.
+  * Only reads are retried: a retry repeats the same request, so a late reply to
+  * the lost attempt answers it as well, and the framer discards replies that do
+  * not carry one value per read.
+  */
+int phytronRtt::retries(phytronCommandClass commandClass)
+{
+  if(commandClass != commandRead || minTimeout_ <= 0) return 0;
+  return retries_;
+}
+
+/** Adds the round trip time of a reply
+  * \param[in] commandClass  Class of the command
+  * \param[in] rtt           Round trip time in s
+  * \param[in] wireTime      Time the request and the reply took on the line in s
+  */
+void phytronRtt::sample(phytronCommandClass commandClass, double rtt, double wireTime)
+{
+  phytronRttStats *pStats = &stats_[commandClass];
+
+  rtt = rtt > wireTime ? rtt - wireTime : 0;
+  epicsMutexMustLock(mutex_);
+  if(pStats->samples == 0){
+    pStats->srtt = rtt;
+    pStats->rttvar = rtt/2;
+  } else {
+    pStats->rttvar = 0.75*pStats->rttvar + 0.25*fabs(pStats->srtt - rtt);
+    pStats->srtt = 0.875*pStats->srtt + 0.125*rtt;
+  }
+  pStats->samples++;
+  pStats->backoff = 0;
+  epicsMutexUnlock(mutex_);
+}
+
+/** Backs the timeout of a class off after a timeout
+  * \param[in] commandClass  Class of the command
+  * \param[in] retry         The command is sent again
+  */
+void phytronRtt::timedOut(phytronCommandClass commandClass, bool retry)
+{
+  phytronRttStats *pStats = &stats_[commandClass];
+
+  epicsMutexMustLock(mutex_);
+  pStats->timeouts++;
+  if(retry) pStats->retries++;
+  if(pStats->backoff < RTT_MAX_BACKOFF) pStats->backoff++;
+  epicsMutexUnlock(mutex_);
+}
+
+/** Prints the statistics and current timeout of each class */
+void phytronRtt::report(FILE *fp)
+{
+  for(int i = 0; i < COMMAND_CLASSES; i++){
+    phytronRttStats *pStats = &stats_[i];
+    fprintf(fp, "  %-5s rtt %.2f ms +- %.2f ms without wire time, timeout %.1f ms + wire time, %lu replies, %lu timeouts, %lu retries\n",
+            commandClassNames[i], pStats->srtt*1000, pStats->rttvar*1000,
+            timeout((phytronCommandClass) i)*1000, pStats->samples, pStats->timeouts, pStats->retries);
+  }
+}
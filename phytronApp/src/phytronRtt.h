@@ -0,0 +1,76 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+#ifndef phytronRtt_H
+#define phytronRtt_H
+
+#include <stdio.h>
+#include <epicsMutex.h>
+
+#define RTT_MIN_SAMPLES         8     //Replies measured before the timeout adapts
+#define RTT_MAX_BACKOFF         4     //The adaptive timeout doubles per timeout, at most 16 times
+#define RTT_REPLY_OVERHEAD      5     //STX, ACK, separator and checksum XX, ETX of a reply
+#define RTT_VALUE_BYTES         12    //Characters expected per value of a reply, e.g. -1234567.89 and a blank
+
+/* Command classes with separate round trip statistics */
+enum phytronCommandClass{
+  commandRead,  //Idempotent reads (P..R, ==H, SE, ST), retried after a timeout
+  commandWrite, //Moves, stops and parameter writes, never retried
+  commandSlow,  //Controller reset, always waits for the static timeout
+  COMMAND_CLASSES
+};
+
+/* Round trip statistics of a command class */
+typedef struct {
+  double        srtt;     //Smoothed round trip time without the wire time in s
+  double        rttvar;   //Smoothed mean deviation in s
+  int           backoff;  //Timeouts since the last reply
+  unsigned long samples;
+  unsigned long timeouts;
+  unsigned long retries;
+} phytronRttStats;
+
+/** Timeouts derived from the measured round trip times, as TCP derives its
+  * retransmission timeout: srtt + 4*rttvar per command class, doubled after
+  * each timeout, bounded by a minimum and by the static timeout configured
+  * for the controller. The round trips are measured without the time the
+  * telegrams take on the wire, which is added back per telegram, so a long
+  * batched reply is not timed by the round trips of short ones.
+  * Disabled until configured with a minimum timeout.
+  */
+class phytronRtt {
+public:
+  phytronRtt();
+
+  static phytronCommandClass classify(const char *command);
+  static bool isRead(const char *command, size_t len);
+
+  void   configure(double staticTimeout, double minTimeout, int retries);
+  double timeout(phytronCommandClass commandClass, double wireTime = 0);
+  int    retries(phytronCommandClass commandClass);
+  void   sample(phytronCommandClass commandClass, double rtt, double wireTime = 0);
+  void   timedOut(phytronCommandClass commandClass, bool retry);
+  void   report(FILE *fp);
+
+private:
+  epicsMutexId mutex_;
+  double staticTimeout_;
+  double minTimeout_;   //0 disables the adaptive timeouts
+  int retries_;
+  phytronRttStats stats_[COMMAND_CLASSES];
+};
+
+#endif /* phytronRtt_H */
@@ -0,0 +1,139 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+#include <string.h>
+#include <errno.h>
+
+#if defined(__linux__) || defined(__APPLE__)
+#define PHYTRON_SHM_SUPPORTED
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include <epicsTime.h>
+#include <epicsAtomic.h>
+#include "phytronShm.h"
+
+phytronShm::phytronShm(const char *name, phytronShmSegment *pSegment)
+  : name_(name), pSegment_(pSegment), updates_(0), full_(0)
+{
+}
+
+/** Creates or takes over a segment and clears it
+  * \param[in] name        Name of the segment, e.g. "/phytron_MCM1"
+  * \param[in] controller  Name of the controller port, kept in the segment
+  * \return The segment, NULL if it cannot be created
+  */
+phytronShm *phytronShm::create(const char *name, const char *controller)
+{
+#ifdef PHYTRON_SHM_SUPPORTED
+  phytronShmSegment *pSegment;
+  void *pMap;
+  int fd;
+
+  fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+  if(fd < 0){
+    printf("ERROR: phytronShm: Cannot open %s: %s\n", name, strerror(errno));
+    return NULL;
+  }
+  if(ftruncate(fd, sizeof(phytronShmSegment))){
+    printf("ERROR: phytronShm: Cannot size %s: %s\n", name, strerror(errno));
+    close(fd);
+    return NULL;
+  }
+  pMap = mmap(NULL, sizeof(phytronShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(pMap == MAP_FAILED){
+    printf("ERROR: phytronShm: Cannot map %s: %s\n", name, strerror(errno));
+    return NULL;
+  }
+
+  //Readers ignore the segment until the magic is written
+  pSegment = (phytronShmSegment *) pMap;
+  epicsAtomicSetIntT((int *) &pSegment->magic, 0);
+  epicsAtomicWriteMemoryBarrier();
+  memset(&pSegment->version, 0, sizeof(phytronShmSegment) - sizeof(pSegment->magic));
+  pSegment->version = PHYTRON_SHM_VERSION;
+  pSegment->headerSize = sizeof(phytronShmSegment);
+  pSegment->axisSize = sizeof(phytronShmAxis);
+  pSegment->pid = getpid();
+  strncpy(pSegment->controller, controller, PHYTRON_SHM_NAME_SIZE - 1);
+  epicsAtomicWriteMemoryBarrier();
+  epicsAtomicSetIntT((int *) &pSegment->magic, (int) PHYTRON_SHM_MAGIC);
+
+  return new phytronShm(name, pSegment);
+#else
+  printf("ERROR: phytronShm: Shared memory is not supported on this target\n");
+  return NULL;
+#endif
+}
+
+/** Writes the state of an axis into its slot, taking a free slot for a new axis.
+  * Called by the poller only.
+  * \param[in] pState  State, seq and updateTime are set here
+  */
+void phytronShm::publish(const phytronShmAxis *pState)
+{
+  phytronShmAxis *pSlot = NULL;
+  epicsTimeStamp now;
+  int axes = pSegment_->axes;
+  int seq;
+
+  for(int i = 0; i < axes; i++){
+    if(pSegment_->axis[i].axisNo == pState->axisNo){
+      pSlot = &pSegment_->axis[i];
+      break;
+    }
+  }
+  if(!pSlot){
+    if(axes >= PHYTRON_SHM_MAX_AXES){
+      full_++;
+      return;
+    }
+    pSlot = &pSegment_->axis[axes];
+    pSlot->axisNo = pState->axisNo;
+    epicsAtomicWriteMemoryBarrier();
+    epicsAtomicSetIntT(&pSegment_->axes, axes + 1);
+  }
+
+  epicsTimeGetCurrent(&now);
+  seq = pSlot->seq;
+  epicsAtomicSetIntT(&pSlot->seq, seq + 1);
+  epicsAtomicWriteMemoryBarrier();
+
+  pSlot->position = pState->position;
+  pSlot->encoderPosition = pState->encoderPosition;
+  pSlot->status = pState->status;
+  pSlot->axisStatus = pState->axisStatus;
+  pSlot->polls = pState->polls;
+  pSlot->sampleTime = pState->sampleTime;
+  pSlot->updateTime.sec = now.secPastEpoch + POSIX_TIME_AT_EPICS_EPOCH;
+  pSlot->updateTime.nsec = now.nsec;
+
+  epicsAtomicWriteMemoryBarrier();
+  epicsAtomicSetIntT(&pSlot->seq, seq + 2);
+  updates_++;
+}
+
+/** Prints the segment and its update counters
+  * \param[in] fp  Output
+  */
+void phytronShm::report(FILE *fp)
+{
+  fprintf(fp, "  shared memory %s: %d axes, %lu updates, %lu dropped (no free slot)\n",
+          name_.c_str(), pSegment_->axes, updates_, full_);
+}
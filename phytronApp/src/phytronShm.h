@@ -0,0 +1,45 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+#ifndef phytronShm_H
+#define phytronShm_H
+
+#include <stdio.h>
+#include <string>
+#include "phytronShmLayout.h"
+
+/** Shared memory segment a controller publishes the state of its axes in
+  * after every poll (POSIX shm_open). Publishing only copies the state into
+  * the slot of the axis under its sequence lock, it never waits for readers.
+  * Only the poller of the controller writes, so writes need no lock.
+  */
+class phytronShm {
+public:
+  static phytronShm *create(const char *name, const char *controller);
+
+  void publish(const phytronShmAxis *pState);
+  void report(FILE *fp);
+
+private:
+  phytronShm(const char *name, phytronShmSegment *pSegment);
+
+  std::string name_;
+  phytronShmSegment *pSegment_;
+  unsigned long updates_;
+  unsigned long full_;          //Updates dropped, all slots taken by other axes
+};
+
+#endif /* phytronShm_H */
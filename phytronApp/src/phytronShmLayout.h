@@ -0,0 +1,83 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+#ifndef phytronShmLayout_H
+#define phytronShmLayout_H
+
+/* Layout of the shared memory segment a controller publishes its polled axis
+ * state in, see phytronSetSharedMemory. This header only uses standard C, so
+ * consumers can include it without EPICS.
+ *
+ * Every axis slot is guarded by a sequence lock. The IOC makes seq odd before
+ * it updates the slot and even again afterwards. A consistent copy is read by:
+ *
+ *   do {
+ *     s1 = seq;  read barrier;  copy the slot;  read barrier;  s2 = seq;
+ *   } while(s1 != s2 || (s1 & 1));
+ *
+ * Readers never block the IOC; a reader preempted in the middle of a copy
+ * simply retries. Check magic, version and the sizes before using a segment.
+ */
+
+#include <stdint.h>
+
+#define PHYTRON_SHM_MAGIC     0x50485953u  /* "PHYS" */
+#define PHYTRON_SHM_VERSION   1
+#define PHYTRON_SHM_MAX_AXES  64
+#define PHYTRON_SHM_NAME_SIZE 40
+
+/* Bits of phytronShmAxis.status */
+#define PHYTRON_SHM_DONE       0x01
+#define PHYTRON_SHM_MOVING     0x02
+#define PHYTRON_SHM_HIGH_LIMIT 0x04
+#define PHYTRON_SHM_LOW_LIMIT  0x08
+#define PHYTRON_SHM_AT_HOME    0x10
+#define PHYTRON_SHM_HOMED      0x20
+#define PHYTRON_SHM_SLIP       0x40
+#define PHYTRON_SHM_PROBLEM    0x80
+
+/* Time in POSIX seconds and nanoseconds */
+typedef struct {
+  uint32_t sec;
+  uint32_t nsec;
+} phytronShmTime;
+
+/* State of one axis as of its last poll */
+typedef struct {
+  int            seq;             /* Odd while the slot is written */
+  int32_t        axisNo;          /* asyn address, module*10 + axis */
+  double         position;        /* Motor position in steps */
+  double         encoderPosition; /* Encoder position times encoder ratio, as of the last encoder read */
+  uint32_t       status;          /* PHYTRON_SHM_.. bits */
+  int32_t        axisStatus;      /* Status word (SE) of the last status read */
+  uint32_t       polls;           /* Polls of the axis */
+  uint32_t       pad;
+  phytronShmTime sampleTime;      /* Estimated time the controller sampled the last reply */
+  phytronShmTime updateTime;      /* Time the slot was written */
+} phytronShmAxis;
+
+typedef struct {
+  uint32_t       magic;           /* Written last when the segment is created */
+  uint32_t       version;
+  uint32_t       headerSize;      /* sizeof(phytronShmSegment) */
+  uint32_t       axisSize;        /* sizeof(phytronShmAxis) */
+  int32_t        pid;             /* Process of the IOC */
+  int            axes;            /* Slots in use, slots are never freed */
+  char           controller[PHYTRON_SHM_NAME_SIZE];
+  phytronShmAxis axis[PHYTRON_SHM_MAX_AXES];
+} phytronShmSegment;
+
+#endif /* phytronShmLayout_H */
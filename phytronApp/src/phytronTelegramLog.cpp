@@ -0,0 +1,279 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include <epicsAtomic.h>
+#include <epicsThread.h>
+#include <iocsh.h>
+#include <cantProceed.h>
+#include <epicsExport.h>
+#include "phytronTelegramLog.h"
+
+/* All logs, searched by the iocsh commands */
+static std::vector<phytronTelegramLog*> logs;
+
+/** Creates the telegram log of a controller
+  * \param[in] name  Name of the controller port, used by the iocsh commands
+  */
+phytronTelegramLog::phytronTelegramLog(const char *name)
+  : head_(0), errorDump_(0), lastStatus_(0), dumpTicket_(0), dumpStatus_(0), dumpEvent_(NULL)
+{
+  name_ = (char *) mallocMustSucceed(strlen(name)+1,
+      "phytronTelegramLog::phytronTelegramLog: Name memory allocation failed.\n");
+  strcpy(name_, name);
+
+  ring_ = (phytronTelegram *) callocMustSucceed(TELEGRAM_LOG_SIZE, sizeof(phytronTelegram),
+      "phytronTelegramLog::phytronTelegramLog: Ring memory allocation failed.\n");
+
+  logs.push_back(this);
+}
+
+phytronTelegramLog::~phytronTelegramLog()
+{
+  for(size_t i = 0; i < logs.size(); i++){
+    if(logs[i] == this){
+      logs.erase(logs.begin() + i);
+      break;
+    }
+  }
+  free(ring_);
+  free(name_);
+}
+
+/** Returns the log of a controller
+  * \param[in] name  Name of the controller port
+  * \return Log, NULL if there is none
+  */
+phytronTelegramLog *phytronTelegramLog::find(const char *name)
+{
+  for(size_t i = 0; i < logs.size(); i++){
+    if(!strcmp(logs[i]->name_, name)) return logs[i];
+  }
+  return NULL;
+}
+
+/** Records one exchange. Lock-free, may be called concurrently by several threads.
+  * \param[in] channel   Connection the telegram was sent on
+  * \param[in] tx        Bytes sent
+  * \param[in] txLen     Number of bytes sent
+  * \param[in] rx        Bytes received, may be NULL
+  * \param[in] rxLen     Number of bytes received
+  * \param[in] sent      Time the request was handed to the port
+  * \param[in] received  Time the reply was received
+  * \param[in] status    asynStatus of the exchange
+  */
+void phytronTelegramLog::record(int channel, const char *tx, size_t txLen, const char *rx, size_t rxLen,
+                                const epicsTimeStamp *sent, const epicsTimeStamp *received, int status)
+{
+  int ticket = epicsAtomicIncrIntT(&head_);
+  phytronTelegram *pEntry = &ring_[(unsigned)(ticket - 1) & (TELEGRAM_LOG_SIZE - 1)];
+
+  //Readers skip the entry until it is complete
+  epicsAtomicSetIntT(&pEntry->seq, 0);
+  epicsAtomicWriteMemoryBarrier();
+
+  if(!rx) rxLen = 0;
+  pEntry->channel = channel;
+  pEntry->status = status;
+  pEntry->sent = *sent;
+  pEntry->received = *received;
+  pEntry->txTruncated = txLen > TELEGRAM_LOG_MAX_BYTES;
+  pEntry->rxTruncated = rxLen > TELEGRAM_LOG_MAX_BYTES;
+  pEntry->txLen = (unsigned short) (pEntry->txTruncated ? TELEGRAM_LOG_MAX_BYTES : txLen);
+  pEntry->rxLen = (unsigned short) (pEntry->rxTruncated ? TELEGRAM_LOG_MAX_BYTES : rxLen);
+  memcpy(pEntry->tx, tx, pEntry->txLen);
+  if(pEntry->rxLen) memcpy(pEntry->rx, rx, pEntry->rxLen);
+
+  epicsAtomicWriteMemoryBarrier();
+  epicsAtomicSetIntT(&pEntry->seq, ticket);
+
+  //Dump the history leading to the first failure of a sequence
+  if(status == 0){
+    epicsAtomicSetIntT(&lastStatus_, 0);
+  } else if(epicsAtomicCmpAndSwapIntT(&lastStatus_, 0, status) == 0 && errorDump_ > 0 && dumpEvent_){
+    //Printing is left to the dump thread, the caller may hold the controller lock
+    epicsAtomicSetIntT(&dumpStatus_, status);
+    epicsAtomicSetIntT(&dumpTicket_, ticket);
+    epicsEventSignal(dumpEvent_);
+  }
+}
+
+/** Sets the number of telegrams printed when an exchange fails, starting the
+  * dump thread the first time
+  * \param[in] count  Number of telegrams, 0 disables the dump
+  */
+void phytronTelegramLog::setErrorDump(int count)
+{
+  if(count > 0 && !dumpEvent_){
+    dumpEvent_ = epicsEventMustCreate(epicsEventEmpty);
+    epicsThreadCreate("phytronLogDump", epicsThreadPriorityLow,
+                      epicsThreadGetStackSize(epicsThreadStackMedium),
+                      (EPICSTHREADFUNC)dumpTaskC, this);
+  }
+  errorDump_ = count;
+}
+
+void phytronTelegramLog::dumpTaskC(void *pvt)
+{
+  ((phytronTelegramLog *) pvt)->dumpTask();
+}
+
+/** Prints the telegrams leading to a failed exchange, signalled by record() */
+void phytronTelegramLog::dumpTask()
+{
+  int ticket;
+
+  while(1){
+    epicsEventWait(dumpEvent_);
+    ticket = epicsAtomicGetIntT(&dumpTicket_);
+    if(!ticket || errorDump_ <= 0) continue;
+    epicsAtomicSetIntT(&dumpTicket_, 0);
+    printf("phytronTelegramLog: exchange on %s failed with status %d, last telegrams:\n",
+           name_, epicsAtomicGetIntT(&dumpStatus_));
+    dump(stdout, errorDump_, ticket);
+  }
+}
+
+/* Prints telegram bytes, control characters of the protocol by name */
+static void printBytes(FILE *fp, const char *bytes, int len, bool truncated)
+{
+  for(int i = 0; i < len; i++){
+    unsigned char c = (unsigned char) bytes[i];
+    if(c == 0x02)                 fprintf(fp, "<STX>");
+    else if(c == 0x03)            fprintf(fp, "<ETX>");
+    else if(c == 0x06)            fprintf(fp, "<ACK>");
+    else if(c == 0x15)            fprintf(fp, "<NAK>");
+    else if(c < 0x20 || c > 0x7e) fprintf(fp, "\\x%02X", c);
+    else                          fputc(c, fp);
+  }
+  if(truncated) fprintf(fp, "...");
+}
+
+/** Returns the ticket of the last recorded telegram, 0 if none was recorded */
+int phytronTelegramLog::head()
+{
+  return epicsAtomicGetIntT(&head_);
+}
+
+/** Copies a recorded telegram
+  * \param[in]  ticket  Ticket of the telegram, see head()
+  * \param[out] pEntry  Copy of the telegram
+  * \return false if the telegram was overwritten or is being written
+  */
+bool phytronTelegramLog::copy(int ticket, phytronTelegram *pEntry)
+{
+  phytronTelegram *pRing = &ring_[(unsigned)(ticket - 1) & (TELEGRAM_LOG_SIZE - 1)];
+
+  //Copy the entry and drop it if a writer reused it meanwhile
+  if(epicsAtomicGetIntT(&pRing->seq) != ticket) return false;
+  epicsAtomicReadMemoryBarrier();
+  memcpy(pEntry, pRing, sizeof(*pEntry));
+  epicsAtomicReadMemoryBarrier();
+  return epicsAtomicGetIntT(&pRing->seq) == ticket;
+}
+
+/** Prints the last telegrams, oldest first
+  * \param[in] fp     Output
+  * \param[in] count  Number of telegrams, at most TELEGRAM_LOG_SIZE
+  * \param[in] last   Ticket of the last telegram printed, 0 for the last recorded
+  */
+void phytronTelegramLog::dump(FILE *fp, int count, int last)
+{
+  phytronTelegram entry;
+  char time[40];
+  int first;
+
+  if(last <= 0) last = head();
+  if(count <= 0 || count > TELEGRAM_LOG_SIZE) count = TELEGRAM_LOG_SIZE;
+  first = last - count + 1;
+  if(first < 1) first = 1;
+
+  for(int ticket = first; ticket <= last; ticket++){
+    if(!copy(ticket, &entry)) continue;
+
+    epicsTimeToStrftime(time, sizeof(time), "%Y/%m/%d %H:%M:%S.%06f", &entry.sent);
+    fprintf(fp, "%s ch%d %8.3f ms st%d tx: ", time, entry.channel,
+            epicsTimeDiffInSeconds(&entry.received, &entry.sent)*1000, entry.status);
+    printBytes(fp, entry.tx, entry.txLen, entry.txTruncated);
+    fprintf(fp, " rx: ");
+    printBytes(fp, entry.rx, entry.rxLen, entry.rxTruncated);
+    fprintf(fp, "\n");
+  }
+}
+
+/** Prints the last telegrams exchanged with a controller
+  * Configuration command, called directly or from iocsh
+  * \param[in] portName  Name of the controller port (phytronCreateController or phytronCreateIoCtrl)
+  * \param[in] count     Number of telegrams, 0 for all
+  */
+extern "C" int phytronDumpLog(const char *portName, int count)
+{
+  phytronTelegramLog *pLog = phytronTelegramLog::find(portName);
+  if(!pLog){
+    printf("ERROR: phytronDumpLog: Controller %s has no telegram log\n", portName);
+    return -1;
+  }
+  pLog->dump(stdout, count);
+  return 0;
+}
+
+/** Sets the number of telegrams printed when an exchange fails
+  * Configuration command, called directly or from iocsh
+  * \param[in] portName  Name of the controller port (phytronCreateController or phytronCreateIoCtrl)
+  * \param[in] count     Number of telegrams, 0 disables the dump
+  */
+extern "C" int phytronSetLogErrorDump(const char *portName, int count)
+{
+  phytronTelegramLog *pLog = phytronTelegramLog::find(portName);
+  if(!pLog){
+    printf("ERROR: phytronSetLogErrorDump: Controller %s has no telegram log\n", portName);
+    return -1;
+  }
+  pLog->setErrorDump(count);
+  return 0;
+}
+
+/** Parameters for iocsh telegram log commands */
+static const iocshArg phytronDumpLogArg0 = {"Port", iocshArgString};
+static const iocshArg phytronDumpLogArg1 = {"Number of telegrams", iocshArgInt};
+static const iocshArg * const phytronDumpLogArgs[] = {&phytronDumpLogArg0, &phytronDumpLogArg1};
+
+static const iocshFuncDef phytronDumpLogDef = {"phytronDumpLog", 2, phytronDumpLogArgs};
+static const iocshFuncDef phytronSetLogErrorDumpDef = {"phytronSetLogErrorDump", 2, phytronDumpLogArgs};
+
+static void phytronDumpLogCallFunc(const iocshArgBuf *args)
+{
+  phytronDumpLog(args[0].sval, args[1].ival);
+}
+
+static void phytronSetLogErrorDumpCallFunc(const iocshArgBuf *args)
+{
+  phytronSetLogErrorDump(args[0].sval, args[1].ival);
+}
+
+static void phytronLogRegister(void)
+{
+  iocshRegister(&phytronDumpLogDef, phytronDumpLogCallFunc);
+  iocshRegister(&phytronSetLogErrorDumpDef, phytronSetLogErrorDumpCallFunc);
+}
+
+extern "C" {
+epicsExportRegistrar(phytronLogRegister);
+}
@@ -0,0 +1,77 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+#ifndef phytronTelegramLog_H
+#define phytronTelegramLog_H
+
+#include <stdio.h>
+#include <epicsTime.h>
+#include <epicsEvent.h>
+
+#define TELEGRAM_LOG_SIZE      1024 //Number of telegrams kept per controller, must be a power of 2
+#define TELEGRAM_LOG_MAX_BYTES 256  //Longer telegrams are truncated in the log
+
+/* One request/reply exchange as sent and received on the wire */
+typedef struct {
+  int            seq;      //Ticket of the writer, 0 while the entry is being written
+  int            channel;  //Connection the telegram was sent on, e.g. fast or slow path
+  int            status;   //asynStatus of the exchange
+  epicsTimeStamp sent;
+  epicsTimeStamp received;
+  unsigned short txLen;
+  unsigned short rxLen;
+  bool           txTruncated;
+  bool           rxTruncated;
+  char           tx[TELEGRAM_LOG_MAX_BYTES];
+  char           rx[TELEGRAM_LOG_MAX_BYTES];
+} phytronTelegram;
+
+/** Always-on binary log of the telegrams exchanged with a controller.
+  * record() only copies bytes into a fixed-size ring and never blocks or
+  * formats, so it may be called from any thread on the hot path. Text is
+  * only produced by dump(), from iocsh or, when an exchange fails, by a low
+  * priority thread that record() only signals.
+  */
+class phytronTelegramLog {
+public:
+  phytronTelegramLog(const char *name);
+  ~phytronTelegramLog();
+
+  void record(int channel, const char *tx, size_t txLen, const char *rx, size_t rxLen,
+              const epicsTimeStamp *sent, const epicsTimeStamp *received, int status);
+  void dump(FILE *fp, int count, int last = 0);
+  int  head();
+  bool copy(int ticket, phytronTelegram *pEntry);
+  void setErrorDump(int count);
+
+  const char *getName() {return name_;}
+  static phytronTelegramLog *find(const char *name);
+
+private:
+  char *name_;
+  phytronTelegram *ring_;
+  int head_;        //Ticket of the last claimed entry
+  int errorDump_;   //Entries dumped to stdout when an exchange fails after a successful one, 0 disables it
+  int lastStatus_;
+  int dumpTicket_;  //Ticket of the failed exchange to dump, 0 if none is pending
+  int dumpStatus_;
+  epicsEventId dumpEvent_;  //Wakes the dump thread, NULL until the error dump is enabled
+
+  static void dumpTaskC(void *pvt);
+  void dumpTask();
+};
+
+#endif /* phytronTelegramLog_H */
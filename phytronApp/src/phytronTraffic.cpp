@@ -0,0 +1,404 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+/* Recording of controller traffic to a file and a replay server that answers
+ * the recorded requests with the recorded replies and latency.
+ *
+ * File format, one exchange per line, '#' starts a comment:
+ * <sent [s]> <round trip time [s]> <channel> <status> <request hex> <reply hex or ->
+ * Sent is relative to the start of the recording, channel and status are
+ * those of the telegram log. A request or reply cut at TELEGRAM_LOG_MAX_BYTES
+ * ends with TRAFFIC_TRUNCATED, such exchanges are not replayed.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <epicsAtomic.h>
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsTime.h>
+#include <osiSock.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+#include "phytronTelegramLog.h"
+#include "phytronTraffic.h"
+
+#define RECORDER_PERIOD 0.1 //Period of draining the telegram log into the file in s
+
+/* Writes the telegrams of one log into a file */
+typedef struct {
+  phytronTelegramLog *pLog;
+  FILE               *fp;
+  int                next;     //Ticket of the next telegram to write
+  int                lost;     //Telegrams overwritten in the log before they were written
+  int                written;
+  int                stop;     //Set by phytronRecordTraffic, read by recorderTask
+  epicsTimeStamp     start;
+} phytronRecorder;
+
+static std::vector<phytronRecorder*> recorders;
+static epicsMutexId recordersLock = epicsMutexMustCreate();
+
+static void writeHex(FILE *fp, const char *bytes, int len, bool truncated)
+{
+  if(len == 0) fputc('-', fp);
+  for(int i = 0; i < len; i++) fprintf(fp, "%02x", (unsigned char) bytes[i]);
+  if(truncated) fputc(TRAFFIC_TRUNCATED, fp);
+}
+
+static void recorderTask(void *drvPvt)
+{
+  phytronRecorder *pRec = (phytronRecorder*) drvPvt;
+  phytronTelegram entry;
+  int head;
+
+  while(1){
+    epicsThreadSleep(RECORDER_PERIOD);
+
+    head = pRec->pLog->head();
+    if(head - pRec->next >= TELEGRAM_LOG_SIZE){
+      pRec->lost += head - TELEGRAM_LOG_SIZE + 1 - pRec->next;
+      pRec->next = head - TELEGRAM_LOG_SIZE + 1;
+    }
+
+    for(; pRec->next <= head; pRec->next++){
+      if(!pRec->pLog->copy(pRec->next, &entry)){
+        pRec->lost++;
+        continue;
+      }
+      fprintf(pRec->fp, "%.6f %.6f %d %d ", epicsTimeDiffInSeconds(&entry.sent, &pRec->start),
+              epicsTimeDiffInSeconds(&entry.received, &entry.sent), entry.channel, entry.status);
+      writeHex(pRec->fp, entry.tx, entry.txLen, entry.txTruncated);
+      fputc(' ', pRec->fp);
+      writeHex(pRec->fp, entry.rx, entry.rxLen, entry.rxTruncated);
+      fputc('\n', pRec->fp);
+      pRec->written++;
+    }
+    fflush(pRec->fp);
+
+    if(epicsAtomicGetIntT(&pRec->stop)) break;
+  }
+
+  fprintf(pRec->fp, "# %d telegrams, %d lost\n", pRec->written, pRec->lost);
+  fclose(pRec->fp);
+  printf("phytronRecordTraffic: %s: %d telegrams recorded, %d lost\n", pRec->pLog->getName(), pRec->written, pRec->lost);
+  delete pRec;
+}
+
+/** Starts or stops recording the traffic of a controller
+  * Configuration command, called directly or from iocsh
+  * \param[in] portName  Name of the controller port (phytronCreateController or phytronCreateIoCtrl)
+  * \param[in] fileName  File to record to, empty stops the recording
+  */
+extern "C" int phytronRecordTraffic(const char *portName, const char *fileName)
+{
+  phytronTelegramLog *pLog = phytronTelegramLog::find(portName);
+  phytronRecorder *pRec;
+  char time[40];
+
+  if(!pLog){
+    printf("ERROR: phytronRecordTraffic: Controller %s has no telegram log\n", portName);
+    return -1;
+  }
+
+  epicsMutexMustLock(recordersLock);
+  for(size_t i = 0; i < recorders.size(); i++){
+    if(recorders[i]->pLog == pLog){
+      epicsAtomicSetIntT(&recorders[i]->stop, 1);
+      recorders.erase(recorders.begin() + i);
+      break;
+    }
+  }
+  epicsMutexUnlock(recordersLock);
+
+  if(!fileName || !strlen(fileName)) return 0;
+
+  pRec = new phytronRecorder;
+  pRec->fp = fopen(fileName, "w");
+  if(!pRec->fp){
+    printf("ERROR: phytronRecordTraffic: Cannot open %s\n", fileName);
+    delete pRec;
+    return -1;
+  }
+  pRec->pLog = pLog;
+  pRec->next = pLog->head() + 1;
+  pRec->lost = 0;
+  pRec->written = 0;
+  pRec->stop = 0;
+  epicsTimeGetCurrent(&pRec->start);
+
+  epicsTimeToStrftime(time, sizeof(time), "%Y/%m/%d %H:%M:%S.%06f", &pRec->start);
+  fprintf(pRec->fp, "# phytron traffic of %s, started %s\n", portName, time);
+  fprintf(pRec->fp, "# sent rtt channel status request reply\n");
+
+  epicsMutexMustLock(recordersLock);
+  recorders.push_back(pRec);
+  epicsMutexUnlock(recordersLock);
+
+  epicsThreadCreate("phytronRecord", epicsThreadPriorityLow,
+                    epicsThreadGetStackSize(epicsThreadStackMedium),
+                    (EPICSTHREADFUNC)recorderTask, pRec);
+  return 0;
+}
+
+/* Recorded replies to one request, served in the recorded order */
+typedef struct {
+  double      rtt;
+  int         status;
+  std::string reply;
+} phytronReply;
+
+typedef struct {
+  std::vector<phytronReply> replies;
+  size_t                    next;
+} phytronReplies;
+
+/* Replay server state shared by all connections */
+typedef struct {
+  std::map<std::string, phytronReplies> requests;
+  epicsMutexId lock;
+  double       latencyScale; //Recorded round trip times are multiplied by this
+  int          misses;       //Requests not found in the recording
+  SOCKET       listenSock;
+} phytronReplay;
+
+typedef struct {
+  phytronReplay *pReplay;
+  SOCKET        sock;
+} phytronReplayConnection;
+
+static std::string fromHex(const char *hex)
+{
+  std::string bytes;
+  unsigned int byte;
+
+  if(!strcmp(hex, "-")) return bytes;
+  for(; hex[0] && hex[1]; hex += 2){
+    sscanf(hex, "%2x", &byte);
+    bytes += (char) byte;
+  }
+  return bytes;
+}
+
+/** Parses one line of a recording made by phytronRecordTraffic
+  * \param[in]  line     Line of the recording
+  * \param[out] request  Request sent, valid for trafficExchange
+  * \param[out] reply    Reply received, empty if none, valid for trafficExchange
+  * \param[out] pRtt     Round trip time in s
+  * \param[out] pStatus  asynStatus of the exchange
+  * \return trafficExchange, trafficTruncated if the request or reply was cut in the
+  *         recording, trafficIgnored for comments and malformed lines
+  */
+phytronTrafficLine phytronParseTraffic(const char *line, std::string &request, std::string &reply,
+                                       double *pRtt, int *pStatus)
+{
+  char requestHex[2*TELEGRAM_LOG_MAX_BYTES+2];
+  char replyHex[2*TELEGRAM_LOG_MAX_BYTES+2];
+  double sent;
+  int channel;
+
+  if(line[0] == '#') return trafficIgnored;
+  if(sscanf(line, "%lf %lf %d %d %513s %513s", &sent, pRtt, &channel, pStatus, requestHex, replyHex) != 6)
+    return trafficIgnored;
+  if(strchr(requestHex, TRAFFIC_TRUNCATED) || strchr(replyHex, TRAFFIC_TRUNCATED)) return trafficTruncated;
+  request = fromHex(requestHex);
+  reply = fromHex(replyHex);
+  return trafficExchange;
+}
+
+/* Serves one connection: reads requests up to ETX and answers them */
+static void replayConnectionTask(void *drvPvt)
+{
+  phytronReplayConnection *pConn = (phytronReplayConnection*) drvPvt;
+  phytronReplay *pReplay = pConn->pReplay;
+  static const char nak[] = "\x02\x15:XX\x03";
+  std::string request;
+  phytronReply reply;
+  bool found;
+  char c;
+
+  while(recv(pConn->sock, &c, 1, 0) == 1){
+    request += c;
+    if(c != 0x03) continue;
+
+    epicsMutexMustLock(pReplay->lock);
+    std::map<std::string, phytronReplies>::iterator it = pReplay->requests.find(request);
+    found = it != pReplay->requests.end();
+    if(found){
+      reply = it->second.replies[it->second.next];
+      it->second.next = (it->second.next + 1) % it->second.replies.size();
+    } else {
+      pReplay->misses++;
+    }
+    epicsMutexUnlock(pReplay->lock);
+    request.clear();
+
+    if(!found){
+      send(pConn->sock, nak, strlen(nak), 0);
+      continue;
+    }
+
+    epicsThreadSleep(reply.rtt*pReplay->latencyScale);
+    //A timed out exchange is replayed by not answering, the input EOS may have stripped ETX
+    if(reply.status || reply.reply.empty()) continue;
+    if(reply.reply[reply.reply.size()-1] != 0x03) reply.reply += (char) 0x03;
+    send(pConn->sock, reply.reply.data(), reply.reply.size(), 0);
+  }
+
+  epicsSocketDestroy(pConn->sock);
+  delete pConn;
+}
+
+static void replayServerTask(void *drvPvt)
+{
+  phytronReplay *pReplay = (phytronReplay*) drvPvt;
+  phytronReplayConnection *pConn;
+  osiSockAddr addr;
+  osiSocklen_t addrLen;
+  SOCKET sock;
+
+  while(1){
+    addrLen = sizeof(addr);
+    sock = epicsSocketAccept(pReplay->listenSock, &addr.sa, &addrLen);
+    if(sock == INVALID_SOCKET){
+      epicsThreadSleep(1);
+      continue;
+    }
+    pConn = new phytronReplayConnection;
+    pConn->pReplay = pReplay;
+    pConn->sock = sock;
+    epicsThreadCreate("phytronReplayConn", epicsThreadPriorityMedium,
+                      epicsThreadGetStackSize(epicsThreadStackMedium),
+                      (EPICSTHREADFUNC)replayConnectionTask, pConn);
+  }
+}
+
+/** Starts a server on localhost that answers requests with the replies and
+  * latency of a recording made by phytronRecordTraffic. Connect the driver to
+  * it with drvAsynIPPortConfigure("...", "127.0.0.1:<tcpPort>", 0, 0, 1).
+  * Repeated requests are answered with their recorded replies in turn,
+  * requests that were not recorded with NAK.
+  * Configuration command, called directly or from iocsh
+  * \param[in] tcpPort       TCP port to listen on
+  * \param[in] fileName      Recording
+  * \param[in] latencyScale  Recorded round trip times are multiplied by this, 0 selects 1
+  */
+extern "C" int phytronReplayServer(int tcpPort, const char *fileName, double latencyScale)
+{
+  phytronReplay *pReplay;
+  phytronReply reply;
+  FILE *fp;
+  char line[4*TELEGRAM_LOG_MAX_BYTES+100];
+  std::string request;
+  int count = 0;
+  int truncated = 0;
+  osiSockAddr addr;
+
+  fp = fopen(fileName, "r");
+  if(!fp){
+    printf("ERROR: phytronReplayServer: Cannot open %s\n", fileName);
+    return -1;
+  }
+
+  pReplay = new phytronReplay;
+  pReplay->lock = epicsMutexMustCreate();
+  pReplay->latencyScale = latencyScale > 0 ? latencyScale : 1;
+  pReplay->misses = 0;
+
+  while(fgets(line, sizeof(line), fp)){
+    switch(phytronParseTraffic(line, request, reply.reply, &reply.rtt, &reply.status)){
+      case trafficIgnored:   continue;
+      case trafficTruncated: truncated++; continue;
+      case trafficExchange:  break;
+    }
+    phytronReplies &replies = pReplay->requests[request];
+    if(replies.replies.empty()) replies.next = 0;
+    replies.replies.push_back(reply);
+    count++;
+  }
+  fclose(fp);
+
+  osiSockAttach();
+  pReplay->listenSock = epicsSocketCreate(AF_INET, SOCK_STREAM, 0);
+  if(pReplay->listenSock == INVALID_SOCKET){
+    printf("ERROR: phytronReplayServer: Cannot create socket\n");
+    epicsMutexDestroy(pReplay->lock);
+    delete pReplay;
+    return -1;
+  }
+  epicsSocketEnableAddressReuseDuringTimeWaitState(pReplay->listenSock);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.ia.sin_family = AF_INET;
+  addr.ia.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.ia.sin_port = htons((unsigned short) tcpPort);
+  if(bind(pReplay->listenSock, &addr.sa, sizeof(addr.ia)) || listen(pReplay->listenSock, 5)){
+    printf("ERROR: phytronReplayServer: Cannot listen on port %d\n", tcpPort);
+    epicsSocketDestroy(pReplay->listenSock);
+    epicsMutexDestroy(pReplay->lock);
+    delete pReplay;
+    return -1;
+  }
+
+  printf("phytronReplayServer: serving %d telegrams (%d distinct requests) of %s on 127.0.0.1:%d\n",
+         count, (int) pReplay->requests.size(), fileName, tcpPort);
+  if(truncated) printf("phytronReplayServer: %d telegrams skipped, they were truncated in the recording\n", truncated);
+
+  epicsThreadCreate("phytronReplay", epicsThreadPriorityMedium,
+                    epicsThreadGetStackSize(epicsThreadStackMedium),
+                    (EPICSTHREADFUNC)replayServerTask, pReplay);
+  return 0;
+}
+
+/** Parameters for iocsh traffic recording and replay */
+static const iocshArg phytronRecordTrafficArg0 = {"Port", iocshArgString};
+static const iocshArg phytronRecordTrafficArg1 = {"File (empty stops)", iocshArgString};
+static const iocshArg * const phytronRecordTrafficArgs[] = {&phytronRecordTrafficArg0, &phytronRecordTrafficArg1};
+
+static const iocshArg phytronReplayServerArg0 = {"TCP port", iocshArgInt};
+static const iocshArg phytronReplayServerArg1 = {"File", iocshArgString};
+static const iocshArg phytronReplayServerArg2 = {"Latency scale", iocshArgDouble};
+static const iocshArg * const phytronReplayServerArgs[] = {&phytronReplayServerArg0,
+                                                           &phytronReplayServerArg1,
+                                                           &phytronReplayServerArg2};
+
+static const iocshFuncDef phytronRecordTrafficDef = {"phytronRecordTraffic", 2, phytronRecordTrafficArgs};
+static const iocshFuncDef phytronReplayServerDef = {"phytronReplayServer", 3, phytronReplayServerArgs};
+
+static void phytronRecordTrafficCallFunc(const iocshArgBuf *args)
+{
+  phytronRecordTraffic(args[0].sval, args[1].sval);
+}
+
+static void phytronReplayServerCallFunc(const iocshArgBuf *args)
+{
+  phytronReplayServer(args[0].ival, args[1].sval, args[2].dval);
+}
+
+static void phytronTrafficRegister(void)
+{
+  iocshRegister(&phytronRecordTrafficDef, phytronRecordTrafficCallFunc);
+  iocshRegister(&phytronReplayServerDef, phytronReplayServerCallFunc);
+}
+
+extern "C" {
+epicsExportRegistrar(phytronTrafficRegister);
+}
@@ -0,0 +1,34 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+#ifndef phytronTraffic_H
+#define phytronTraffic_H
+
+#include <string>
+
+#define TRAFFIC_TRUNCATED '+' //Appended to a request or reply cut at TELEGRAM_LOG_MAX_BYTES
+
+/* Result of parsing one line of a recording */
+enum phytronTrafficLine{
+  trafficIgnored,   //Comment or malformed line
+  trafficExchange,  //A complete exchange
+  trafficTruncated  //The request or reply was cut in the recording and must not be replayed
+};
+
+phytronTrafficLine phytronParseTraffic(const char *line, std::string &request, std::string &reply,
+                                       double *pRtt, int *pStatus);
+
+#endif
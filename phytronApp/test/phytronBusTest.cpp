@@ -0,0 +1,67 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+/* Tests the ring of the telegram log: tickets, truncation and overwriting */
+/* Tests the poll budget and the wire time estimate of a shared serial line */
+#include <math.h>
+
+#include <epicsUnitTest.h>
+#include <testMain.h>
+#include "phytronBus.h"
+
+static void testBudget()
+{
+  phytronBus *pBus = phytronBus::attach("testBudget");
+  int unit = pBus->addUnit("unit0", 0, true);
+
+  testDiag("poll budget");
+  testOk(phytronBus::find("testBudget") == pBus, "bus found by port name");
+  testOk(phytronBus::attach("testBudget") == pBus, "second unit attaches to the same bus");
+
+  pBus->setBudget(unit, 10);
+  pBus->count(unit, linkCommand, 50);
+  pBus->count(unit, linkIo, 50);
+  pBus->count(unit, linkDiagnostic, 50);
+  testOk(pBus->beginPoll(unit), "commands, IO and diagnostics do not use up the poll budget");
+  pBus->endPoll(unit);
+
+  pBus->count(unit, linkPoll, 20);
+  testOk(!pBus->beginPoll(unit), "poll cycle skipped while over the poll budget");
+
+  pBus->setBudget(unit, 0);
+  pBus->count(unit, linkPoll, 100);
+  testOk(pBus->beginPoll(unit), "no limit without a budget");
+  pBus->endPoll(unit);
+}
+
+static void testWireTime()
+{
+  phytronBus *pBus = phytronBus::attach("testWireTime");
+
+  testDiag("wire time");
+  testOk(pBus->wireTime(100) == 0, "no wire time while the baud rate is unknown");
+  pBus->setLink(9600, 0.1);
+  testOk(fabs(pBus->wireTime(96) - 0.1) < 1e-9, "96 bytes take 0.1 s at 9600 baud");
+  testOk(pBus->wireTime(0) == 0, "no bytes take no time");
+}
+
+MAIN(phytronBusTest)
+{
+  testPlan(8);
+  testBudget();
+  testWireTime();
+  return testDone();
+}
@@ -0,0 +1,83 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+/* Tests the ring of the telegram log: tickets, truncation and overwriting */
+/* Tests the checks of batched replies: the reply a telegram expects,
+ * whether a received frame fits it, and the splitting of its values */
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <epicsUnitTest.h>
+#include <testMain.h>
+#include "phytronFrame.h"
+#include "phytronRtt.h"
+
+static void testExpectedReply()
+{
+  int values;
+
+  testDiag("expected reply");
+  testOk(phytronExpectedReply("M1.1P20R", phytronRtt::isRead, &values) == replyValues && values == 1,
+         "single read expects one value");
+  testOk(phytronExpectedReply("M1.1P20R M1.2P20R  M1.1==H", phytronRtt::isRead, &values) == replyValues && values == 3,
+         "batched reads expect one value each");
+  testOk(phytronExpectedReply("M1.1P45=4 M1.1P46=2", phytronRtt::isRead, &values) == replyEmpty && values == 2,
+         "parameter writes expect an acknowledge");
+  testOk(phytronExpectedReply("M1.1P20R M1.1P45=4", phytronRtt::isRead, &values) == replyAny,
+         "reads mixed with writes are not checked");
+  testOk(phytronExpectedReply("M1.1A100", phytronRtt::isRead, &values) == replyAny, "moves are not checked");
+  testOk(phytronExpectedReply("", phytronRtt::isRead, &values) == replyAny && values == 0, "empty telegram not checked");
+}
+
+static void testReplyFits()
+{
+  static const char values2[] = "\x02\x06" "12 -3.5:XX\x03";
+  static const char ack[] = "\x02\x06:XX\x03";
+  static const char nak[] = "\x02\x15:XX\x03";
+
+  testDiag("reply fits");
+  testOk(phytronReplyFits(values2, strlen(values2), replyValues, 2), "two values answer two reads");
+  testOk(!phytronReplyFits(values2, strlen(values2), replyValues, 3), "two values do not answer three reads");
+  testOk(!phytronReplyFits(ack, strlen(ack), replyValues, 1), "acknowledge does not answer a read");
+  testOk(phytronReplyFits(ack, strlen(ack), replyEmpty, 2), "acknowledge answers writes");
+  testOk(!phytronReplyFits(values2, strlen(values2), replyEmpty, 2), "values do not answer writes");
+  testOk(phytronReplyFits(nak, strlen(nak), replyValues, 2), "NAK answers any request");
+  testOk(phytronReplyFits(values2, strlen(values2), replyAny, 0), "anything answers an unchecked request");
+}
+
+static void testSplitReply()
+{
+  std::vector<std::string> fields;
+  char data[40];
+
+  testDiag("split reply");
+  strcpy(data, "12 -3.5  0");
+  testOk(phytronSplitReply(data, fields) == 3, "three values split");
+  testOk(fields.size() == 3 && fields[0] == "12" && fields[1] == "-3.5" && fields[2] == "0", "values in order");
+  strcpy(data, "");
+  testOk(phytronSplitReply(data, fields) == 0 && fields.empty(), "acknowledge has no values");
+}
+
+MAIN(phytronFrameTest)
+{
+  testPlan(16);
+  testExpectedReply();
+  testReplyFits();
+  testSplitReply();
+  return testDone();
+}
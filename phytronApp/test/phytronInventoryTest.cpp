@@ -0,0 +1,59 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+/* Tests the ring of the telegram log: tickets, truncation and overwriting */
+/* Tests the inventory of a rack built from the replies to IMn */
+#include <string>
+#include <vector>
+
+#include <epicsUnitTest.h>
+#include <testMain.h>
+#include "phytronInventory.h"
+
+MAIN(phytronInventoryTest)
+{
+  std::vector<std::string> types;
+  std::vector<phytronModule> modules;
+
+  testPlan(11);
+
+  types.push_back("I1AM01");
+  types.push_back("");
+  types.push_back("DIOM01");
+  types.push_back("I4AM02");
+  types.push_back("AIOM01");
+  types.push_back("NACK");
+  types.push_back("DIOM01");
+  types.push_back("XYZ");
+  types.push_back("I0AM01");
+  phytronBuildInventory(types, modules);
+
+  testOk(modules.size() == types.size(), "one module per slot");
+  testOk(modules[0].kind == modulePowerStage && modules[0].index == 1 && modules[0].axes == 1,
+         "single axis power stage is power stage 1");
+  testOk(modules[1].kind == moduleEmpty, "slot without a reply is empty");
+  testOk(modules[2].kind == moduleDigitalIo && modules[2].index == 1, "first digital IO module");
+  testOk(modules[3].kind == modulePowerStage && modules[3].index == 2 && modules[3].axes == 4,
+         "four axis power stage is power stage 2");
+  testOk(modules[4].kind == moduleAnalogIo && modules[4].index == 1, "analog IO module numbered on its own");
+  testOk(modules[5].kind == moduleEmpty, "refused slot is empty");
+  testOk(modules[6].kind == moduleDigitalIo && modules[6].index == 2, "second digital IO module");
+  testOk(modules[7].kind == moduleOther, "unknown module not supported");
+  testOk(modules[8].kind == moduleOther && modules[8].axes == 0, "power stage without axes not supported");
+  testOk(modules[3].type == "I4AM02", "type kept");
+
+  return testDone();
+}
@@ -0,0 +1,56 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+/* Tests the ring of the telegram log: tickets, truncation and overwriting */
+/* Tests which commands of the CMD channel are queries, which share telegrams
+ * and leave the output shadow valid */
+#include <string.h>
+
+#include <epicsUnitTest.h>
+#include <testMain.h>
+#include "phytronIoCtrl.h"
+
+static bool query(const char *command)
+{
+  return phytronIoCtrl::isQuery(command, strlen(command));
+}
+
+MAIN(phytronIoQueryTest)
+{
+  testPlan(16);
+
+  testDiag("queries");
+  testOk1(query("IM3"));
+  testOk1(query("AD2.1"));
+  testOk1(query("DA2.1"));
+  testOk1(query("EZ1.8"));
+  testOk1(query("AZ1.3"));
+  testOk1(query("M1.1P20R"));
+  testOk1(query("EG1R"));
+  testOk1(query("AG12R"));
+
+  testDiag("other commands");
+  testOk1(!query(""));
+  testOk1(!query("AD2.1 EZ1.8"));
+  testOk1(!query("AZ1.3=5"));
+  testOk1(!query("M1.1P20=3"));
+  testOk1(!query("M1.1PR"));
+  testOk1(!query("EG1S"));
+  testOk1(!query("A1.2S"));
+  testOk1(!query("IMX"));
+
+  return testDone();
+}
@@ -0,0 +1,100 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+/* Tests the ring of the telegram log: tickets, truncation and overwriting */
+/* Tests the command classes and the adaptive timeouts derived from round trips */
+#include <math.h>
+
+#include <epicsUnitTest.h>
+#include <testMain.h>
+#include "phytronRtt.h"
+
+//Steady round trips, the mean deviation of the first sample has decayed after these
+#define STEADY_SAMPLES 100
+
+static bool near(double a, double b)
+{
+  return fabs(a - b) < 1e-9;
+}
+
+static void testClassify()
+{
+  testDiag("command classes");
+  testOk1(phytronRtt::isRead("ST", 2));
+  testOk1(phytronRtt::isRead("M1.1P20R", 8));
+  testOk1(phytronRtt::isRead("M12.2==H", 8));
+  testOk1(phytronRtt::isRead("M1.1SE", 6));
+  testOk1(!phytronRtt::isRead("M1.1P20=5", 9));
+  testOk1(!phytronRtt::isRead("M1.1PR", 6));
+  testOk1(!phytronRtt::isRead("M1.1A100", 8));
+  testOk1(phytronRtt::classify("M1.1P20R M1.2P20R") == commandRead);
+  testOk1(phytronRtt::classify("M1.1P20R M1.1A100") == commandWrite);
+  testOk1(phytronRtt::classify("CR") == commandSlow);
+}
+
+static void testTimeout()
+{
+  phytronRtt rtt;
+  int i;
+
+  testDiag("timeouts");
+  rtt.configure(1.0, 0, 2);
+  for(i = 0; i < STEADY_SAMPLES; i++) rtt.sample(commandRead, 0.01);
+  testOk(rtt.timeout(commandRead) == 1.0, "static timeout while the adaptive timeouts are disabled");
+  testOk(rtt.retries(commandRead) == 0, "no retries while the adaptive timeouts are disabled");
+
+  rtt.configure(1.0, 0.02, 2);
+  testOk(near(rtt.timeout(commandRead), 0.02), "steady round trips give the minimum timeout");
+  testOk(near(rtt.timeout(commandRead, 0.03), 0.04), "wire time added to the timeout");
+  testOk(rtt.retries(commandRead) == 2, "reads are retried");
+  testOk(rtt.retries(commandWrite) == 0, "writes are never retried");
+  testOk(rtt.timeout(commandWrite) == 1.0, "static timeout before enough samples");
+  testOk(rtt.timeout(commandSlow) == 1.0, "slow commands always wait for the static timeout");
+
+  for(i = 0; i < STEADY_SAMPLES; i++) rtt.sample(commandWrite, 0.1, 0.05);
+  testOk(near(rtt.timeout(commandWrite), 0.05), "round trips measured without the wire time");
+}
+
+static void testBackoff()
+{
+  phytronRtt rtt;
+  int i;
+
+  testDiag("backoff");
+  rtt.configure(10.0, 0.001, 1);
+  for(i = 0; i < STEADY_SAMPLES; i++) rtt.sample(commandRead, 0.1);
+  testOk(near(rtt.timeout(commandRead), 0.1), "timeout of steady round trips");
+  rtt.timedOut(commandRead, true);
+  testOk(near(rtt.timeout(commandRead), 0.2), "timeout doubled after a timeout");
+  rtt.timedOut(commandRead, false);
+  testOk(near(rtt.timeout(commandRead), 0.4), "timeout doubled again");
+  for(i = 0; i < 2*RTT_MAX_BACKOFF; i++) rtt.timedOut(commandRead, false);
+  testOk(near(rtt.timeout(commandRead), 0.1*(1 << RTT_MAX_BACKOFF)), "backoff bounded");
+  rtt.timedOut(commandRead, false);
+  rtt.configure(1.0, 0.001, 1);
+  testOk(rtt.timeout(commandRead) == 1.0, "timeout bounded by the static timeout");
+  rtt.sample(commandRead, 0.1);
+  testOk(near(rtt.timeout(commandRead), 0.1), "backoff reset by a reply");
+}
+
+MAIN(phytronRttTest)
+{
+  testPlan(25);
+  testClassify();
+  testTimeout();
+  testBackoff();
+  return testDone();
+}
@@ -0,0 +1,90 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+/* Tests the ring of the telegram log: tickets, truncation and overwriting */
+#include <string.h>
+
+#include <epicsTime.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+#include "phytronTelegramLog.h"
+
+static void testRecord()
+{
+  phytronTelegramLog log("testRecord");
+  phytronTelegram entry;
+  epicsTimeStamp sent, received;
+  static const char tx[] = "\x02" "0M1.1P20R:XX\x03";
+  static const char rx[] = "\x02\x06" "1234:XX\x03";
+
+  testDiag("record and copy");
+  epicsTimeGetCurrent(&sent);
+  received = sent;
+  epicsTimeAddSeconds(&received, 0.002);
+
+  testOk(log.head() == 0, "empty log has head 0");
+  testOk(phytronTelegramLog::find("testRecord") == &log, "log found by name");
+
+  log.record(1, tx, strlen(tx), rx, strlen(rx), &sent, &received, 0);
+  testOk(log.head() == 1, "first telegram has ticket 1");
+  testOk(log.copy(1, &entry), "telegram 1 copied");
+  testOk(entry.channel == 1 && entry.status == 0, "channel and status kept");
+  testOk(entry.txLen == strlen(tx) && !memcmp(entry.tx, tx, entry.txLen), "request kept");
+  testOk(entry.rxLen == strlen(rx) && !memcmp(entry.rx, rx, entry.rxLen), "reply kept");
+  testOk(!entry.txTruncated && !entry.rxTruncated, "short telegram not truncated");
+
+  log.record(0, tx, strlen(tx), NULL, 5, &sent, &received, 1);
+  testOk(log.copy(2, &entry) && entry.rxLen == 0 && entry.status == 1, "timeout without reply recorded");
+}
+
+static void testTruncate()
+{
+  phytronTelegramLog log("testTruncate");
+  phytronTelegram entry;
+  epicsTimeStamp now;
+  char tx[TELEGRAM_LOG_MAX_BYTES + 10];
+
+  testDiag("truncation");
+  epicsTimeGetCurrent(&now);
+  memset(tx, 'A', sizeof(tx));
+  log.record(0, tx, sizeof(tx), tx, TELEGRAM_LOG_MAX_BYTES, &now, &now, 0);
+  testOk(log.copy(1, &entry), "long telegram copied");
+  testOk(entry.txTruncated && entry.txLen == TELEGRAM_LOG_MAX_BYTES, "long request truncated");
+  testOk(!entry.rxTruncated && entry.rxLen == TELEGRAM_LOG_MAX_BYTES, "reply of the maximum length kept");
+}
+
+static void testOverwrite()
+{
+  phytronTelegramLog log("testOverwrite");
+  phytronTelegram entry;
+  epicsTimeStamp now;
+
+  testDiag("overwriting");
+  epicsTimeGetCurrent(&now);
+  for(int i = 0; i < TELEGRAM_LOG_SIZE + 2; i++) log.record(0, "x", 1, "y", 1, &now, &now, 0);
+  testOk(log.head() == TELEGRAM_LOG_SIZE + 2, "head counts every telegram");
+  testOk(!log.copy(1, &entry) && !log.copy(2, &entry), "overwritten telegrams refused");
+  testOk(log.copy(3, &entry) && log.copy(TELEGRAM_LOG_SIZE + 2, &entry), "telegrams still in the ring copied");
+}
+
+MAIN(phytronTelegramLogTest)
+{
+  testPlan(15);
+  testRecord();
+  testTruncate();
+  testOverwrite();
+  return testDone();
+}
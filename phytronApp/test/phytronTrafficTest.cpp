@@ -0,0 +1,57 @@
+/*************************************************************************\
+* Copyright (c) 2026 The contributors to the phytron EPICS module
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+\*************************************************************************/
+/* Tests the ring of the telegram log: tickets, truncation and overwriting */
+/* Tests the parsing of recordings served by phytronReplayServer */
+#include <string>
+
+#include <epicsUnitTest.h>
+#include <testMain.h>
+#include "phytronTraffic.h"
+
+MAIN(phytronTrafficTest)
+{
+  std::string request, reply;
+  double rtt = 0;
+  int status = -1;
+
+  testPlan(11);
+
+  testDiag("exchanges");
+  testOk(phytronParseTraffic("0.100000 0.002500 0 0 02304d312e3150323052 0206313233340303\n",
+                             request, reply, &rtt, &status) == trafficExchange, "exchange parsed");
+  testOk(request == "\x02" "0M1.1P20R", "request decoded");
+  testOk(reply == "\x02\x06" "1234\x03\x03", "reply decoded");
+  testOk(rtt == 0.0025 && status == 0, "round trip time and status parsed");
+  testOk(phytronParseTraffic("0.2 1.0 1 1 02304d31 -\n", request, reply, &rtt, &status) == trafficExchange,
+         "timeout parsed");
+  testOk(reply.empty() && status == 1, "timeout has no reply");
+
+  testDiag("truncated telegrams");
+  request = "unchanged";
+  testOk(phytronParseTraffic("0.3 0.01 0 0 02304d31+ 0206\n", request, reply, &rtt, &status) == trafficTruncated,
+         "truncated request marked");
+  testOk(request == "unchanged", "truncated request not decoded");
+  testOk(phytronParseTraffic("0.3 0.01 0 0 02304d31 0206+\n", request, reply, &rtt, &status) == trafficTruncated,
+         "truncated reply marked");
+
+  testDiag("other lines");
+  testOk(phytronParseTraffic("# sent rtt channel status request reply\n", request, reply, &rtt, &status) == trafficIgnored,
+         "comment ignored");
+  testOk(phytronParseTraffic("0.1 0.002 0\n", request, reply, &rtt, &status) == trafficIgnored, "malformed line ignored");
+
+  return testDone();
+}